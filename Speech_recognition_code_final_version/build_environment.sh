@@ -7,6 +7,7 @@ function install_dep()
     sudo apt install build-essential
     sudo apt install -y cmake
     sudo apt install -y libsdl2-dev
+    sudo apt install -y libasound2-dev
 }
 
 function setup_whisper_fuzzy()
@@ -0,0 +1,86 @@
+#include "alloc_count.h"
+
+#include <cstdlib>
+#include <new>
+
+
+static thread_local uint64_t g_n_alloc = 0;
+static thread_local int      g_paused  = 0;
+
+
+#ifdef WHISPER_FUZZY_ALLOC_COUNT
+
+static void *alloc_count_new(size_t size)
+{
+    if (!g_paused) {
+        g_n_alloc++;
+    }
+
+    return malloc(size ? size : 1);
+}
+
+
+void *operator new(size_t size)
+{
+    void *p = alloc_count_new(size);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return alloc_count_new(size);
+}
+
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return alloc_count_new(size);
+}
+
+
+void operator delete(void *p) noexcept                          { free(p); }
+void operator delete[](void *p) noexcept                        { free(p); }
+void operator delete(void *p, size_t) noexcept                  { free(p); }
+void operator delete[](void *p, size_t) noexcept                { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept   { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+
+#endif
+
+
+bool alloc_count_enabled()
+{
+#ifdef WHISPER_FUZZY_ALLOC_COUNT
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+uint64_t alloc_count_thread()
+{
+    return g_n_alloc;
+}
+
+
+void alloc_count_pause()
+{
+    g_paused++;
+}
+
+
+void alloc_count_resume()
+{
+    g_paused--;
+}
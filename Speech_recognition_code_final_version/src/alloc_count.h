@@ -0,0 +1,19 @@
+#ifndef __ALLOC_COUNT_H__
+#define __ALLOC_COUNT_H__
+
+#include <cstdint>
+
+
+// Heap allocations of the calling thread. Built with WHISPER_FUZZY_ALLOC_COUNT
+// the global operator new is replaced to count them, otherwise nothing is
+// counted and alloc_count_enabled() is false. malloc() is not seen.
+bool alloc_count_enabled();
+
+// allocations of this thread so far, pauses excluded
+uint64_t alloc_count_thread();
+
+// allocations in between are not counted, e.g. inside whisper_full() or a user callback; nests
+void alloc_count_pause();
+void alloc_count_resume();
+
+#endif //__ALLOC_COUNT_H__
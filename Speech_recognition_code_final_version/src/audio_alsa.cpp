@@ -0,0 +1,280 @@
+#include "audio_alsa.h"
+#include "audio_dsp.h"
+#include "debug.h"
+
+#include <alsa/asoundlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+
+
+// longest wait for a period, so a pause is noticed
+static const int k_wait_ms = 100;
+
+
+
+static int64_t audio_alsa_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+int audio_alsa_init(audio_alsa_t *a, audio_ring_t *ring, const audio_alsa_params_t *params)
+{
+    if (!a || !ring || !params) {
+        LOG_ERR("args fail! a(%p), ring(%p), params(%p)", a, ring, params);
+        return -1;
+    }
+
+    a->params = *params;
+    a->ring   = ring;
+
+    snd_pcm_t           *pcm = nullptr;
+    snd_pcm_hw_params_t *hw  = nullptr;
+    snd_pcm_sw_params_t *sw  = nullptr;
+
+    unsigned int      rate   = params->sample_rate;
+    snd_pcm_uframes_t period = std::max(16, params->period_frames);
+    snd_pcm_uframes_t buffer = params->buffer_frames > 0 ? params->buffer_frames : 4*period;
+    int dir = 0;
+    int err = 0;
+
+    if ((err = snd_pcm_open(&pcm, params->device.c_str(), SND_PCM_STREAM_CAPTURE, 0)) < 0) {
+        LOG_ERR("couldn't open ALSA device '%s' for capture: %s", params->device.c_str(), snd_strerror(err));
+        return -1;
+    }
+    a->pcm = pcm;
+
+    snd_pcm_hw_params_malloc(&hw);
+    snd_pcm_sw_params_malloc(&sw);
+
+    // hw: devices often only do S16 stereo at 48 kHz, plughw: and default convert
+    if ((err = snd_pcm_hw_params_any(pcm, hw)) < 0 ||
+        (err = snd_pcm_hw_params_set_access(pcm, hw, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0 ||
+        (err = snd_pcm_hw_params_set_format(pcm, hw, SND_PCM_FORMAT_S16)) < 0 ||
+        (err = snd_pcm_hw_params_set_channels(pcm, hw, 1)) < 0 ||
+        (err = snd_pcm_hw_params_set_rate_near(pcm, hw, &rate, &dir)) < 0) {
+        LOG_ERR("'%s' does not capture mmap'd mono S16 (try plughw:): %s", params->device.c_str(), snd_strerror(err));
+        goto _err;
+    }
+
+    if ((int) rate != params->sample_rate) {
+        LOG_ERR("'%s' captures at %u Hz, not %d (try plughw:)", params->device.c_str(), rate, params->sample_rate);
+        goto _err;
+    }
+
+    if ((err = snd_pcm_hw_params_set_period_size_near(pcm, hw, &period, &dir)) < 0 ||
+        (err = snd_pcm_hw_params_set_buffer_size_near(pcm, hw, &buffer)) < 0 ||
+        (err = snd_pcm_hw_params(pcm, hw)) < 0) {
+        LOG_ERR("'%s': couldn't set the period and buffer size: %s", params->device.c_str(), snd_strerror(err));
+        goto _err;
+    }
+
+    snd_pcm_hw_params_get_period_size(hw, &period, &dir);
+    snd_pcm_hw_params_get_buffer_size(hw, &buffer);
+
+    // woken once a whole period is in; the stream is started explicitly
+    if ((err = snd_pcm_sw_params_current(pcm, sw)) < 0 ||
+        (err = snd_pcm_sw_params_set_avail_min(pcm, sw, period)) < 0 ||
+        (err = snd_pcm_sw_params_set_start_threshold(pcm, sw, buffer + 1)) < 0 ||
+        (err = snd_pcm_sw_params(pcm, sw)) < 0) {
+        LOG_ERR("'%s': couldn't set the sw params: %s", params->device.c_str(), snd_strerror(err));
+        goto _err;
+    }
+
+    snd_pcm_hw_params_free(hw);
+    snd_pcm_sw_params_free(sw);
+
+    a->period_frames = (int) period;
+    a->buffer_frames = (int) buffer;
+    a->scratch.resize(period);
+
+    LOG_INFO("ALSA capture '%s': %u Hz mono S16, mmap, period %d frames (%.1f ms), buffer %d frames (%.1f ms)",
+        params->device.c_str(), rate, a->period_frames, 1e3*a->period_frames/rate,
+        a->buffer_frames, 1e3*a->buffer_frames/rate);
+
+    return 0;
+
+_err:
+    snd_pcm_hw_params_free(hw);
+    snd_pcm_sw_params_free(sw);
+    audio_alsa_free(a);
+    return -1;
+}
+
+
+// restart after an xrun or a suspend, 0 - running again
+static int audio_alsa_recover(audio_alsa_t *a, int err)
+{
+    snd_pcm_t *pcm = (snd_pcm_t *)a->pcm;
+
+    if (err == -EPIPE) {
+        ++a->n_xruns;
+        LOG_DBG("ALSA capture overrun, %llu so far", (unsigned long long) a->n_xruns.load());
+    } else if (err == -ESTRPIPE) {
+        ++a->n_suspends;
+        while ((err = snd_pcm_resume(pcm)) == -EAGAIN) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (err == 0) {
+            return 0;
+        }
+    } else {
+        LOG_ERR("ALSA capture failed: %s", snd_strerror(err));
+    }
+
+    if ((err = snd_pcm_prepare(pcm)) < 0 || (err = snd_pcm_start(pcm)) < 0) {
+        LOG_ERR("couldn't restart ALSA capture: %s", snd_strerror(err));
+        return err;
+    }
+
+    return 0;
+}
+
+
+// everything available, a contiguous piece of the mmap'd buffer at a time
+static int audio_alsa_drain(audio_alsa_t *a, snd_pcm_uframes_t avail)
+{
+    snd_pcm_t *pcm = (snd_pcm_t *)a->pcm;
+
+    while (avail > 0) {
+        const snd_pcm_channel_area_t *areas = nullptr;
+        snd_pcm_uframes_t offset = 0;
+        snd_pcm_uframes_t frames = std::min<snd_pcm_uframes_t>(avail, a->scratch.size());
+
+        int err = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+        if (err < 0) {
+            return err;
+        }
+
+        const int16_t *src = (const int16_t *)((const uint8_t *)areas[0].addr + (areas[0].first + offset*areas[0].step)/8);
+        audio_dsp_s16_to_f32(src, a->scratch.data(), frames);
+
+        const snd_pcm_sframes_t n = snd_pcm_mmap_commit(pcm, offset, frames);
+        if (n < 0 || (snd_pcm_uframes_t) n != frames) {
+            return n < 0 ? (int) n : -EPIPE;
+        }
+
+        audio_ring_write(a->ring, a->scratch.data(), frames);
+
+        a->n_frames += frames;
+        avail       -= frames;
+    }
+
+    return 0;
+}
+
+
+static void audio_alsa_thread(audio_alsa_t *a)
+{
+    snd_pcm_t *pcm = (snd_pcm_t *)a->pcm;
+
+    if (a->on_thread) {
+        a->on_thread(a->on_thread_userdata);
+    }
+
+    while (a->running) {
+        const snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            if (audio_alsa_recover(a, (int) avail) < 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (avail < a->period_frames) {
+            const int err = snd_pcm_wait(pcm, k_wait_ms);
+            if (err < 0 && audio_alsa_recover(a, err) < 0) {
+                break;
+            }
+            continue;
+        }
+
+        if ((uint64_t) avail > a->avail_max) {
+            a->avail_max = avail;
+        }
+
+        const int err = audio_alsa_drain(a, avail);
+        if (err < 0 && audio_alsa_recover(a, err) < 0) {
+            break;
+        }
+    }
+}
+
+
+int audio_alsa_resume(audio_alsa_t *a)
+{
+    if (!a || !a->pcm) {
+        LOG_ERR("no ALSA device to resume!");
+        return -1;
+    }
+
+    if (a->thread.joinable()) {
+        return 0;
+    }
+
+    snd_pcm_t *pcm = (snd_pcm_t *)a->pcm;
+
+    int err = 0;
+    if ((err = snd_pcm_prepare(pcm)) < 0 || (err = snd_pcm_start(pcm)) < 0) {
+        LOG_ERR("couldn't start ALSA capture: %s", snd_strerror(err));
+        return -1;
+    }
+
+    a->t_resume = audio_alsa_now();
+    a->running  = true;
+    a->thread   = std::thread(audio_alsa_thread, a);
+
+    return 0;
+}
+
+
+int audio_alsa_pause(audio_alsa_t *a)
+{
+    if (!a || !a->pcm) {
+        LOG_ERR("no ALSA device to pause!");
+        return -1;
+    }
+
+    a->running = false;
+    if (a->thread.joinable()) {
+        a->thread.join();
+    }
+
+    if (a->t_resume) {
+        a->t_run   += audio_alsa_now() - a->t_resume;
+        a->t_resume = 0;
+    }
+
+    snd_pcm_drop((snd_pcm_t *)a->pcm);
+
+    return 0;
+}
+
+
+void audio_alsa_free(audio_alsa_t *a)
+{
+    if (!a || !a->pcm)
+        return;
+
+    audio_alsa_pause(a);
+
+    snd_pcm_close((snd_pcm_t *)a->pcm);
+    a->pcm = nullptr;
+}
+
+
+uint64_t audio_alsa_missing(const audio_alsa_t *a)
+{
+    const int64_t t_resume = a->t_resume;
+    const int64_t t_run    = a->t_run + (t_resume ? audio_alsa_now() - t_resume : 0);
+
+    // a full device buffer may still be on its way
+    const uint64_t n_expected = (uint64_t) (t_run*1e-9*a->params.sample_rate);
+    const uint64_t n_have     = a->n_frames + a->buffer_frames;
+
+    return n_expected > n_have ? n_expected - n_have : 0;
+}
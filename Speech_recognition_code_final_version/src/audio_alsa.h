@@ -0,0 +1,65 @@
+#ifndef __AUDIO_ALSA_H__
+#define __AUDIO_ALSA_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_ring.h"
+
+
+struct audio_alsa_params_t {
+    std::string device        = "default";
+    int         sample_rate   = 16000;
+    int         period_frames = 256;    // 16 ms at 16 kHz
+    int         buffer_frames = 0;      // 0 - 4 periods
+};
+
+
+// Microphone capture through ALSA without SDL: a thread waits on the PCM and
+// moves every period from the mmap'd device buffer into an audio_ring_t,
+// converting S16 to float on the way. An overrun of the device buffer (xrun)
+// restarts the PCM and is counted; the samples it cost are estimated from the
+// time the stream has been running.
+struct audio_alsa_t {
+    audio_alsa_params_t params;
+
+    audio_ring_t *ring = nullptr;
+    void         *pcm  = nullptr;         // snd_pcm_t
+
+    int period_frames = 0;                // obtained
+    int buffer_frames = 0;
+
+    std::vector<float> scratch;           // one period, converted
+
+    // called once from the capture thread, e.g. to set its affinity
+    void            (*on_thread)(void *userdata) = nullptr;
+    void             *on_thread_userdata         = nullptr;
+
+    std::thread       thread;
+    std::atomic<bool> running{false};
+
+    // written by the capture thread, read for the report
+    std::atomic<uint64_t> n_frames{0};    // moved into the ring
+    std::atomic<uint64_t> n_xruns{0};
+    std::atomic<uint64_t> n_suspends{0};
+    std::atomic<uint64_t> avail_max{0};   // frames waiting in the device buffer, high-water mark
+    std::atomic<int64_t>  t_resume{0};    // steady clock ns of the last resume, 0 - paused
+    int64_t               t_run = 0;      // ns running before the last pause
+};
+
+
+int audio_alsa_init(audio_alsa_t *a, audio_ring_t *ring, const audio_alsa_params_t *params);
+
+int audio_alsa_resume(audio_alsa_t *a);
+
+int audio_alsa_pause(audio_alsa_t *a);
+
+void audio_alsa_free(audio_alsa_t *a);
+
+// samples the device should have delivered so far but did not, xruns mostly
+uint64_t audio_alsa_missing(const audio_alsa_t *a);
+
+#endif //__AUDIO_ALSA_H__
@@ -0,0 +1,115 @@
+#include "audio_capture.h"
+#include "debug.h"
+
+#include <SDL.h>
+
+#include <cstdio>
+
+
+
+static void audio_capture_callback(void *userdata, uint8_t *stream, int len)
+{
+    audio_capture_t *cap = (audio_capture_t *)userdata;
+
+    if (!cap->thread_started) {
+        cap->thread_started = true;
+        if (cap->on_thread) {
+            cap->on_thread(cap->on_thread_userdata);
+        }
+    }
+
+    audio_ring_write(cap->ring, (const float *)stream, len/sizeof(float));
+}
+
+
+int audio_capture_init(audio_capture_t *cap, audio_ring_t *ring, int capture_id, int sample_rate)
+{
+    if (!cap || !ring) {
+        LOG_ERR("args fail! cap(%p), ring(%p)", cap, ring);
+        return -1;
+    }
+
+    if (SDL_Init(SDL_INIT_AUDIO) < 0) {
+        LOG_ERR("couldn't initialize SDL: %s", SDL_GetError());
+        return -1;
+    }
+
+    SDL_SetHintWithPriority(SDL_HINT_AUDIO_RESAMPLING_MODE, "medium", SDL_HINT_OVERRIDE);
+
+    {
+        int n_devices = SDL_GetNumAudioDevices(SDL_TRUE);
+        LOG_INFO("found %d capture devices:", n_devices);
+        for (int i = 0; i < n_devices; i++) {
+            LOG_INFO("   - capture device #%d: '%s'", i, SDL_GetAudioDeviceName(i, SDL_TRUE));
+        }
+    }
+
+    SDL_AudioSpec spec_requested;
+    SDL_AudioSpec spec_obtained;
+
+    SDL_zero(spec_requested);
+    SDL_zero(spec_obtained);
+
+    spec_requested.freq     = sample_rate;
+    spec_requested.format   = AUDIO_F32;
+    spec_requested.channels = 1;
+    spec_requested.samples  = 512;
+    spec_requested.callback = audio_capture_callback;
+    spec_requested.userdata = cap;
+
+    cap->ring        = ring;
+    cap->sample_rate = sample_rate;
+
+    const char *name = capture_id >= 0 ? SDL_GetAudioDeviceName(capture_id, SDL_TRUE) : nullptr;
+
+    cap->dev_id = SDL_OpenAudioDevice(name, SDL_TRUE, &spec_requested, &spec_obtained, 0);
+    if (!cap->dev_id) {
+        LOG_ERR("couldn't open an audio device for capture: %s", SDL_GetError());
+        return -1;
+    }
+
+    LOG_INFO("obtained spec for input device (SDL Id = %u): rate %d, format %u, channels %d, samples %d",
+        cap->dev_id, spec_obtained.freq, spec_obtained.format, spec_obtained.channels, spec_obtained.samples);
+
+    if (spec_obtained.format != AUDIO_F32 || spec_obtained.channels != 1) {
+        LOG_ERR("capture device must deliver mono float samples");
+        audio_capture_free(cap);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int audio_capture_resume(audio_capture_t *cap)
+{
+    if (!cap || !cap->dev_id) {
+        LOG_ERR("no audio device to resume!");
+        return -1;
+    }
+
+    SDL_PauseAudioDevice(cap->dev_id, 0);
+    return 0;
+}
+
+
+int audio_capture_pause(audio_capture_t *cap)
+{
+    if (!cap || !cap->dev_id) {
+        LOG_ERR("no audio device to pause!");
+        return -1;
+    }
+
+    SDL_PauseAudioDevice(cap->dev_id, 1);
+    return 0;
+}
+
+
+void audio_capture_free(audio_capture_t *cap)
+{
+    if (!cap || !cap->dev_id)
+        return;
+
+    SDL_CloseAudioDevice(cap->dev_id);
+    cap->dev_id = 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __AUDIO_CAPTURE_H__
+#define __AUDIO_CAPTURE_H__
+
+#include <cstdint>
+
+#include "audio_ring.h"
+
+
+// Microphone capture that writes straight into an audio_ring_t from the
+// device callback, without the intermediate buffer of audio_async.
+struct audio_capture_t {
+    audio_ring_t *ring        = nullptr;
+    uint32_t      dev_id      = 0;
+    int           sample_rate = 0;
+
+    // called once from the device callback thread, e.g. to set its affinity
+    void        (*on_thread)(void *userdata) = nullptr;
+    void         *on_thread_userdata         = nullptr;
+    bool          thread_started             = false;
+};
+
+
+int audio_capture_init(audio_capture_t *cap, audio_ring_t *ring, int capture_id, int sample_rate);
+
+int audio_capture_resume(audio_capture_t *cap);
+
+int audio_capture_pause(audio_capture_t *cap);
+
+void audio_capture_free(audio_capture_t *cap);
+
+#endif //__AUDIO_CAPTURE_H__
@@ -0,0 +1,445 @@
+#include "audio_dsp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define AUDIO_DSP_NEON
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define AUDIO_DSP_AVX2
+#define AUDIO_DSP_SSE2
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define AUDIO_DSP_SSE2
+#endif
+
+
+
+const char *audio_dsp_backend()
+{
+#if defined(AUDIO_DSP_NEON)
+    return "neon";
+#elif defined(AUDIO_DSP_AVX2)
+    return "avx2";
+#elif defined(AUDIO_DSP_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+
+#if defined(AUDIO_DSP_SSE2)
+static float audio_dsp_hsum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 0x55));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+
+void audio_dsp_hp_init(audio_dsp_hp_t *hp, float cutoff, int sample_rate)
+{
+    if (cutoff > 0.0f && sample_rate > 0) {
+        const float rc = 1.0f/(2.0f*M_PI*cutoff);
+        const float dt = 1.0f/sample_rate;
+
+        hp->alpha = rc/(rc + dt);
+    } else {
+        hp->alpha = 0.0f;
+    }
+
+    audio_dsp_hp_reset(hp);
+}
+
+
+void audio_dsp_hp_reset(audio_dsp_hp_t *hp)
+{
+    hp->x = 0.0f;
+    hp->y = 0.0f;
+}
+
+
+// The recursion is vectorized four samples at a time. With d[k] = x[k] - x[k-1],
+//   y[i+j] = a^(j+1)*y[i-1] + sum_{k<=j} a^(j-k+1)*d[i+k]
+// so a block is four multiply-adds of broadcast d lanes plus one with y[i-1],
+// and only that last one waits for the previous block.
+// y may be nullptr; returns the sum of squares of the output.
+static float audio_dsp_hp_run(audio_dsp_hp_t *hp, const float *x, float *y, size_t n)
+{
+    const float a = hp->alpha;
+
+    float  x0  = hp->x;
+    float  yp  = hp->y;
+    float  sum = 0.0f;
+    size_t i   = 0;
+
+#if defined(AUDIO_DSP_NEON)
+    const float32x4_t c0 = { a, a*a, a*a*a, a*a*a*a };
+    const float32x4_t c1 = { 0.0f, a, a*a, a*a*a };
+    const float32x4_t c2 = { 0.0f, 0.0f, a, a*a };
+    const float32x4_t c3 = { 0.0f, 0.0f, 0.0f, a };
+
+    float32x4_t prev = vdupq_n_f32(x0);
+    float32x4_t acc  = vdupq_n_f32(0.0f);
+
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t cur = vld1q_f32(x + i);
+        const float32x4_t d   = vsubq_f32(cur, vextq_f32(prev, cur, 3));
+        prev = cur;
+
+        float32x4_t v = vmulq_laneq_f32(c0, d, 0);
+        v = vfmaq_laneq_f32(v, c1, d, 1);
+        v = vfmaq_laneq_f32(v, c2, d, 2);
+        v = vfmaq_laneq_f32(v, c3, d, 3);
+        v = vfmaq_n_f32(v, c0, yp);
+
+        yp  = vgetq_lane_f32(v, 3);
+        acc = vfmaq_f32(acc, v, v);
+
+        if (y) {
+            vst1q_f32(y + i, v);
+        }
+    }
+
+    // the last input sample, y may overwrite x
+    x0  = vgetq_lane_f32(prev, 3);
+    sum = vaddvq_f32(acc);
+#elif defined(AUDIO_DSP_SSE2)
+    const __m128 c0 = _mm_setr_ps(a, a*a, a*a*a, a*a*a*a);
+    const __m128 c1 = _mm_setr_ps(0.0f, a, a*a, a*a*a);
+    const __m128 c2 = _mm_setr_ps(0.0f, 0.0f, a, a*a);
+    const __m128 c3 = _mm_setr_ps(0.0f, 0.0f, 0.0f, a);
+
+    __m128 prev = _mm_set1_ps(x0);
+    __m128 acc  = _mm_setzero_ps();
+
+    for (; i + 4 <= n; i += 4) {
+        const __m128 cur = _mm_loadu_ps(x + i);
+        const __m128 sh  = _mm_move_ss(_mm_shuffle_ps(cur, cur, _MM_SHUFFLE(2, 1, 0, 0)),
+                                       _mm_shuffle_ps(prev, prev, _MM_SHUFFLE(3, 3, 3, 3)));
+        const __m128 d   = _mm_sub_ps(cur, sh);
+        prev = cur;
+
+        __m128 v = _mm_mul_ps(c0, _mm_shuffle_ps(d, d, 0x00));
+        v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_shuffle_ps(d, d, 0x55)));
+        v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_shuffle_ps(d, d, 0xaa)));
+        v = _mm_add_ps(v, _mm_mul_ps(c3, _mm_shuffle_ps(d, d, 0xff)));
+        v = _mm_add_ps(v, _mm_mul_ps(c0, _mm_set1_ps(yp)));
+
+        yp  = _mm_cvtss_f32(_mm_shuffle_ps(v, v, 0xff));
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+
+        if (y) {
+            _mm_storeu_ps(y + i, v);
+        }
+    }
+
+    x0  = _mm_cvtss_f32(_mm_shuffle_ps(prev, prev, 0xff));
+    sum = audio_dsp_hsum(acc);
+#endif
+
+    for (; i < n; i++) {
+        const float xi = x[i];
+        yp  = a*(yp + xi - x0);
+        x0  = xi;
+        sum += yp*yp;
+        if (y) {
+            y[i] = yp;
+        }
+    }
+
+    hp->x = x0;
+    hp->y = yp;
+
+    return sum;
+}
+
+
+void audio_dsp_highpass(audio_dsp_hp_t *hp, const float *x, float *y, size_t n)
+{
+    if (!n) {
+        return;
+    }
+
+    if (hp->alpha <= 0.0f) {
+        if (y != x) {
+            std::copy(x, x + n, y);
+        }
+        return;
+    }
+
+    audio_dsp_hp_run(hp, x, y, n);
+}
+
+
+float audio_dsp_highpass_energy(audio_dsp_hp_t *hp, const float *x, size_t n)
+{
+    if (!n) {
+        return 0.0f;
+    }
+
+    if (hp->alpha <= 0.0f) {
+        return audio_dsp_energy(x, n);
+    }
+
+    return audio_dsp_hp_run(hp, x, nullptr, n)/n;
+}
+
+
+float audio_dsp_energy(const float *x, size_t n)
+{
+    if (!n) {
+        return 0.0f;
+    }
+
+    float  sum = 0.0f;
+    size_t i   = 0;
+
+#if defined(AUDIO_DSP_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        const float32x4_t v0 = vld1q_f32(x + i);
+        const float32x4_t v1 = vld1q_f32(x + i + 4);
+        acc0 = vfmaq_f32(acc0, v0, v0);
+        acc1 = vfmaq_f32(acc1, v1, v1);
+    }
+    sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#elif defined(AUDIO_DSP_AVX2)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+        const __m256 v0 = _mm256_loadu_ps(x + i);
+        const __m256 v1 = _mm256_loadu_ps(x + i + 8);
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(v0, v0));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(v1, v1));
+    }
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    sum = audio_dsp_hsum(_mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+#elif defined(AUDIO_DSP_SSE2)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        const __m128 v0 = _mm_loadu_ps(x + i);
+        const __m128 v1 = _mm_loadu_ps(x + i + 4);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(v0, v0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(v1, v1));
+    }
+    sum = audio_dsp_hsum(_mm_add_ps(acc0, acc1));
+#endif
+
+    for (; i < n; i++) {
+        sum += x[i]*x[i];
+    }
+
+    return sum/n;
+}
+
+
+float audio_dsp_rms(const float *x, size_t n)
+{
+    return std::sqrt(audio_dsp_energy(x, n));
+}
+
+
+float audio_dsp_peak(const float *x, size_t n)
+{
+    float  peak = 0.0f;
+    size_t i    = 0;
+
+#if defined(AUDIO_DSP_NEON)
+    float32x4_t m0 = vdupq_n_f32(0.0f);
+    float32x4_t m1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= n; i += 8) {
+        m0 = vmaxq_f32(m0, vabsq_f32(vld1q_f32(x + i)));
+        m1 = vmaxq_f32(m1, vabsq_f32(vld1q_f32(x + i + 4)));
+    }
+    peak = vmaxvq_f32(vmaxq_f32(m0, m1));
+#elif defined(AUDIO_DSP_AVX2)
+    const __m256 mask = _mm256_set1_ps(-0.0f);
+    __m256 m = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        m = _mm256_max_ps(m, _mm256_andnot_ps(mask, _mm256_loadu_ps(x + i)));
+    }
+    __m128 m4 = _mm_max_ps(_mm256_castps256_ps128(m), _mm256_extractf128_ps(m, 1));
+    m4   = _mm_max_ps(m4, _mm_movehl_ps(m4, m4));
+    m4   = _mm_max_ss(m4, _mm_shuffle_ps(m4, m4, 0x55));
+    peak = _mm_cvtss_f32(m4);
+#elif defined(AUDIO_DSP_SSE2)
+    const __m128 mask = _mm_set1_ps(-0.0f);
+    __m128 m = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        m = _mm_max_ps(m, _mm_andnot_ps(mask, _mm_loadu_ps(x + i)));
+    }
+    m    = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m    = _mm_max_ss(m, _mm_shuffle_ps(m, m, 0x55));
+    peak = _mm_cvtss_f32(m);
+#endif
+
+    for (; i < n; i++) {
+        peak = std::max(peak, std::fabs(x[i]));
+    }
+
+    return peak;
+}
+
+
+int audio_dsp_peak_s16(const int16_t *x, size_t n)
+{
+    // max and min separately, |INT16_MIN| does not fit in an int16
+    int    hi = 0;
+    int    lo = 0;
+    size_t i  = 0;
+
+#if defined(AUDIO_DSP_NEON)
+    int16x8_t vhi = vdupq_n_s16(0);
+    int16x8_t vlo = vdupq_n_s16(0);
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vld1q_s16(x + i);
+        vhi = vmaxq_s16(vhi, v);
+        vlo = vminq_s16(vlo, v);
+    }
+    hi = vmaxvq_s16(vhi);
+    lo = vminvq_s16(vlo);
+#elif defined(AUDIO_DSP_SSE2)
+#if defined(AUDIO_DSP_AVX2)
+    __m256i whi = _mm256_setzero_si256();
+    __m256i wlo = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) (x + i));
+        whi = _mm256_max_epi16(whi, v);
+        wlo = _mm256_min_epi16(wlo, v);
+    }
+    __m128i vhi = _mm_max_epi16(_mm256_castsi256_si128(whi), _mm256_extracti128_si256(whi, 1));
+    __m128i vlo = _mm_min_epi16(_mm256_castsi256_si128(wlo), _mm256_extracti128_si256(wlo, 1));
+#else
+    __m128i vhi = _mm_setzero_si128();
+    __m128i vlo = _mm_setzero_si128();
+#endif
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (x + i));
+        vhi = _mm_max_epi16(vhi, v);
+        vlo = _mm_min_epi16(vlo, v);
+    }
+
+    int16_t bhi[8];
+    int16_t blo[8];
+    _mm_storeu_si128((__m128i *) bhi, vhi);
+    _mm_storeu_si128((__m128i *) blo, vlo);
+    for (int k = 0; k < 8; k++) {
+        hi = std::max<int>(hi, bhi[k]);
+        lo = std::min<int>(lo, blo[k]);
+    }
+#endif
+
+    for (; i < n; i++) {
+        hi = std::max<int>(hi, x[i]);
+        lo = std::min<int>(lo, x[i]);
+    }
+
+    return std::max(hi, -lo);
+}
+
+
+void audio_dsp_s16_to_f32(const int16_t *x, float *y, size_t n)
+{
+    const float scale = 1.0f/32768.0f;
+
+    size_t i = 0;
+
+#if defined(AUDIO_DSP_NEON)
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vld1q_s16(x + i);
+        vst1q_f32(y + i,     vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), scale));
+        vst1q_f32(y + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(v)), scale));
+    }
+#elif defined(AUDIO_DSP_AVX2)
+    const __m256 s = _mm256_set1_ps(scale);
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v0 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (x + i)));
+        const __m256i v1 = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (x + i + 8)));
+        _mm256_storeu_ps(y + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(v0), s));
+        _mm256_storeu_ps(y + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(v1), s));
+    }
+#elif defined(AUDIO_DSP_SSE2)
+    const __m128 s = _mm_set1_ps(scale);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v  = _mm_loadu_si128((const __m128i *) (x + i));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(y + i,     _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+        _mm_storeu_ps(y + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+    }
+#endif
+
+    for (; i < n; i++) {
+        y[i] = x[i]*scale;
+    }
+}
+
+
+// F > 0 fixes the factor at compile time so the loop can be vectorized
+template <int F>
+static void audio_dsp_decimate_tail(const float *x, float *y, size_t i, size_t n, float scale, int factor = F)
+{
+    for (; i < n; i++) {
+        const float *p = x + i*(F ? F : factor);
+
+        float sum = 0.0f;
+        for (int k = 0; k < (F ? F : factor); k++) {
+            sum += p[k];
+        }
+        y[i] = sum*scale;
+    }
+}
+
+
+void audio_dsp_decimate(const float *x, float *y, size_t n, int factor)
+{
+    if (factor <= 1) {
+        if (y != x) {
+            std::copy(x, x + n, y);
+        }
+        return;
+    }
+
+    const float scale = 1.0f/factor;
+
+    size_t i = 0;
+
+#if defined(AUDIO_DSP_NEON)
+    if (factor == 2) {
+        for (; i + 4 <= n; i += 4) {
+            const float32x4x2_t v = vld2q_f32(x + 2*i);
+            vst1q_f32(y + i, vmulq_n_f32(vaddq_f32(v.val[0], v.val[1]), scale));
+        }
+    } else if (factor == 3) {
+        for (; i + 4 <= n; i += 4) {
+            const float32x4x3_t v = vld3q_f32(x + 3*i);
+            vst1q_f32(y + i, vmulq_n_f32(vaddq_f32(vaddq_f32(v.val[0], v.val[1]), v.val[2]), scale));
+        }
+    }
+#elif defined(AUDIO_DSP_SSE2)
+    const __m128 s = _mm_set1_ps(scale);
+    if (factor == 2) {
+        for (; i + 4 <= n; i += 4) {
+            const __m128 a = _mm_loadu_ps(x + 2*i);
+            const __m128 b = _mm_loadu_ps(x + 2*i + 4);
+            const __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 odd  = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(y + i, _mm_mul_ps(_mm_add_ps(even, odd), s));
+        }
+    }
+#endif
+
+    switch (factor) {
+        case 2:  audio_dsp_decimate_tail<2>(x, y, i, n, scale); break;
+        case 3:  audio_dsp_decimate_tail<3>(x, y, i, n, scale); break;
+        default: audio_dsp_decimate_tail<0>(x, y, i, n, scale, factor); break;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef __AUDIO_DSP_H__
+#define __AUDIO_DSP_H__
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Front-end kernels for the VAD, the replay and level metering. Each one has
+// a NEON, AVX2 or SSE2 body picked at compile time and a scalar fallback;
+// audio_dsp_backend() names the one that was built. Results match the scalar
+// loops up to float rounding (sums are accumulated in a different order).
+
+
+// first-order high-pass, y[i] = alpha*(y[i-1] + x[i] - x[i-1])
+struct audio_dsp_hp_t {
+    float alpha = 0.0f;     // 0 - disabled, the input passes through
+    float x     = 0.0f;     // last input sample
+    float y     = 0.0f;     // last output sample
+};
+
+
+const char *audio_dsp_backend();
+
+// cutoff <= 0 disables the filter
+void audio_dsp_hp_init(audio_dsp_hp_t *hp, float cutoff, int sample_rate);
+
+void audio_dsp_hp_reset(audio_dsp_hp_t *hp);
+
+// in place is fine (y == x)
+void audio_dsp_highpass(audio_dsp_hp_t *hp, const float *x, float *y, size_t n);
+
+// mean square of the high-passed x, without writing it out
+float audio_dsp_highpass_energy(audio_dsp_hp_t *hp, const float *x, size_t n);
+
+// mean square
+float audio_dsp_energy(const float *x, size_t n);
+
+float audio_dsp_rms(const float *x, size_t n);
+
+// largest |x[i]|
+float audio_dsp_peak(const float *x, size_t n);
+
+// largest |x[i]|, 32768 for INT16_MIN
+int audio_dsp_peak_s16(const int16_t *x, size_t n);
+
+// x/32768
+void audio_dsp_s16_to_f32(const int16_t *x, float *y, size_t n);
+
+// y[i] = mean of x[i*factor .. i*factor + factor), i.e. a box filter then every factor-th sample;
+// x holds n*factor samples
+void audio_dsp_decimate(const float *x, float *y, size_t n, int factor);
+
+#endif //__AUDIO_DSP_H__
@@ -0,0 +1,380 @@
+#include "audio_replay.h"
+#include "audio_dsp.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+
+// samples per write, the same period as the SDL capture callback
+static const int k_chunk = 512;
+
+
+struct audio_replay_wav_t {
+    int      format   = 0;     // 1 - PCM, 3 - IEEE float
+    int      channels = 0;
+    int      rate     = 0;
+    int      bits     = 0;
+    long     offset   = 0;     // first byte of the data chunk
+    uint64_t n_frames = 0;
+};
+
+
+static uint32_t audio_replay_le(const uint8_t *p, int n)
+{
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+
+// parse the RIFF header up to the data chunk, fp is left at the first sample
+static int audio_replay_open_wav(const std::string &path, FILE **fp, audio_replay_wav_t *wav)
+{
+    *fp = fopen(path.c_str(), "rb");
+    if (!*fp) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return -1;
+    }
+
+    uint8_t hdr[12];
+    if (fread(hdr, 1, 12, *fp) != 12 || memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        LOG_ERR("%s: not a RIFF/WAVE file", path.c_str());
+        goto _err;
+    }
+
+    for (;;) {
+        uint8_t chunk[8];
+        if (fread(chunk, 1, 8, *fp) != 8) {
+            LOG_ERR("%s: no data chunk", path.c_str());
+            goto _err;
+        }
+
+        const uint32_t size = audio_replay_le(chunk + 4, 4);
+
+        if (!memcmp(chunk, "fmt ", 4)) {
+            uint8_t fmt[40] = { 0 };
+            const uint32_t n = std::min<uint32_t>(size, sizeof(fmt));
+            if (size < 16 || fread(fmt, 1, n, *fp) != n) {
+                LOG_ERR("%s: bad fmt chunk", path.c_str());
+                goto _err;
+            }
+            wav->format   = audio_replay_le(fmt + 0, 2);
+            wav->channels = audio_replay_le(fmt + 2, 2);
+            wav->rate     = audio_replay_le(fmt + 4, 4);
+            wav->bits     = audio_replay_le(fmt + 14, 2);
+
+            // WAVE_FORMAT_EXTENSIBLE, the sub format GUID starts with the format tag
+            if (wav->format == 0xFFFE && size >= 26) {
+                wav->format = audio_replay_le(fmt + 24, 2);
+            }
+
+            if (fseek(*fp, size - n + (size & 1), SEEK_CUR) < 0) {
+                goto _err;
+            }
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!wav->channels || !wav->bits) {
+                LOG_ERR("%s: data chunk before fmt chunk", path.c_str());
+                goto _err;
+            }
+            wav->offset   = ftell(*fp);
+            wav->n_frames = size/(wav->channels*(wav->bits/8));
+            break;
+        } else if (fseek(*fp, size + (size & 1), SEEK_CUR) < 0) {
+            goto _err;
+        }
+    }
+
+    if (!((wav->format == 1 && wav->bits == 16) || (wav->format == 3 && wav->bits == 32))) {
+        LOG_ERR("%s: only 16-bit PCM and 32-bit float are supported (format %d, %d bits)",
+            path.c_str(), wav->format, wav->bits);
+        goto _err;
+    }
+
+    return 0;
+
+_err:
+    fclose(*fp);
+    *fp = nullptr;
+    return -1;
+}
+
+
+// read up to n samples as mono float, decimated by factor from the file rate, returns the samples read
+static size_t audio_replay_read(FILE *fp, const audio_replay_wav_t *wav, int factor, float *out, size_t n,
+    std::vector<uint8_t> &raw, std::vector<float> &mono)
+{
+    const size_t frame_size = wav->channels*(wav->bits/8);
+
+    raw.resize(n*factor*frame_size);
+    n = fread(raw.data(), frame_size, n*factor, fp)/factor;
+
+    float *dst = out;
+    if (factor > 1) {
+        mono.resize(n*factor);
+        dst = mono.data();
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (wav->format == 1 && wav->channels == 1) {
+        audio_dsp_s16_to_f32((const int16_t *) raw.data(), dst, n*factor);
+    } else
+#endif
+    for (size_t i = 0; i < n*factor; i++) {
+        float sum = 0.0f;
+        for (int c = 0; c < wav->channels; c++) {
+            const uint8_t *p = &raw[i*frame_size + c*(wav->bits/8)];
+            if (wav->format == 1) {
+                sum += (int16_t) audio_replay_le(p, 2)/32768.0f;
+            } else {
+                const uint32_t bits = audio_replay_le(p, 4);
+                float v;
+                memcpy(&v, &bits, sizeof(v));
+                sum += v;
+            }
+        }
+        dst[i] = sum/wav->channels;
+    }
+
+    if (factor > 1) {
+        audio_dsp_decimate(dst, out, n, factor);
+    }
+
+    return n;
+}
+
+
+static bool audio_replay_is_wav(const char *name)
+{
+    const size_t len = strlen(name);
+    return len > 4 && !strcasecmp(name + len - 4, ".wav");
+}
+
+
+static int audio_replay_add(audio_replay_t *r, const std::string &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+        LOG_ERR("fail to stat %s", path.c_str());
+        return -1;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path.c_str());
+        if (!dir) {
+            LOG_ERR("fail to open directory %s", path.c_str());
+            return -1;
+        }
+
+        std::vector<std::string> names;
+        while (struct dirent *ent = readdir(dir)) {
+            if (audio_replay_is_wav(ent->d_name)) {
+                names.push_back(path + "/" + ent->d_name);
+            }
+        }
+        closedir(dir);
+
+        std::sort(names.begin(), names.end());
+
+        for (const auto &name : names) {
+            if (audio_replay_add(r, name) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    FILE *fp = nullptr;
+    audio_replay_wav_t wav;
+
+    if (audio_replay_open_wav(path, &fp, &wav) < 0) {
+        return -1;
+    }
+    fclose(fp);
+
+    // 32 and 48 kHz recordings are decimated on the fly
+    if (wav.rate < r->sample_rate || wav.rate % r->sample_rate) {
+        LOG_ERR("%s: sample rate %d, expected %d or a multiple of it", path.c_str(), wav.rate, r->sample_rate);
+        return -1;
+    }
+
+    audio_replay_file_t file;
+    file.path = path;
+    file.pos  = r->files.empty() ? 0 : r->files.back().pos + r->files.back().n + r->n_gap;
+    file.n    = wav.n_frames/(wav.rate/r->sample_rate);
+
+    r->files.push_back(file);
+
+    return 0;
+}
+
+
+int audio_replay_init(audio_replay_t *r, audio_ring_t *ring, const std::string &paths,
+    int sample_rate, bool realtime, int gap_ms)
+{
+    if (!r || !ring || paths.empty() || sample_rate <= 0) {
+        LOG_ERR("args fail! r(%p), ring(%p), paths(%s)", r, ring, paths.c_str());
+        return -1;
+    }
+
+    r->ring        = ring;
+    r->sample_rate = sample_rate;
+    r->realtime    = realtime;
+    r->n_gap       = sample_rate/1000*std::max(0, gap_ms);
+
+    r->files.clear();
+
+    size_t i = 0;
+    while (i < paths.size()) {
+        size_t j = paths.find(',', i);
+        if (j == std::string::npos) {
+            j = paths.size();
+        }
+        if (j > i && audio_replay_add(r, paths.substr(i, j - i)) < 0) {
+            return -1;
+        }
+        i = j + 1;
+    }
+
+    if (r->files.empty()) {
+        LOG_ERR("no WAV file in %s", paths.c_str());
+        return -1;
+    }
+
+    const audio_replay_file_t &last = r->files.back();
+
+    LOG_INFO("replaying %zu files, %.1f s of audio, %s", r->files.size(),
+        (double) (last.pos + last.n + r->n_gap)/sample_rate, realtime ? "real time" : "as fast as possible");
+
+    return 0;
+}
+
+
+static void audio_replay_thread(audio_replay_t *r)
+{
+    std::vector<float>   pcm(k_chunk);
+    std::vector<float>   mono;
+    std::vector<uint8_t> raw;
+
+    if (r->on_thread) {
+        r->on_thread(r->on_thread_userdata);
+    }
+
+    auto t_next = std::chrono::steady_clock::now();
+
+    // write one chunk, paced by the clock in real-time mode or by the consumer otherwise
+    auto write = [&](size_t n) {
+        if (r->realtime) {
+            t_next += std::chrono::microseconds(1000000LL*n/r->sample_rate);
+            std::this_thread::sleep_until(t_next);
+        } else {
+            while (r->running && audio_ring_space(r->ring) < n) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        audio_ring_write(r->ring, pcm.data(), n);
+    };
+
+    for (const auto &file : r->files) {
+        FILE *fp = nullptr;
+        audio_replay_wav_t wav;
+
+        if (audio_replay_open_wav(file.path, &fp, &wav) < 0) {
+            LOG_ERR("%s: replaced by silence", file.path.c_str());
+        }
+
+        // positions were fixed in audio_replay_init(), a short file is padded with silence
+        for (uint64_t done = 0; done < file.n + r->n_gap && r->running; ) {
+            const size_t n = (size_t) std::min<uint64_t>(k_chunk, file.n + r->n_gap - done);
+
+            size_t n_read = 0;
+            if (fp && done < file.n) {
+                n_read = audio_replay_read(fp, &wav, std::max(1, wav.rate/r->sample_rate), pcm.data(),
+                    std::min<uint64_t>(n, file.n - done), raw, mono);
+            }
+            std::fill(pcm.begin() + n_read, pcm.begin() + n, 0.0f);
+
+            write(n);
+            done += n;
+        }
+
+        if (fp) {
+            fclose(fp);
+        }
+    }
+
+    r->done = true;
+}
+
+
+int audio_replay_resume(audio_replay_t *r)
+{
+    if (!r || r->files.empty()) {
+        LOG_ERR("nothing to replay!");
+        return -1;
+    }
+
+    if (r->thread.joinable()) {
+        return 0;
+    }
+
+    r->running = true;
+    r->done    = false;
+    r->thread  = std::thread(audio_replay_thread, r);
+
+    return 0;
+}
+
+
+int audio_replay_pause(audio_replay_t *r)
+{
+    if (!r) {
+        LOG_ERR("args fail! r(%p)", r);
+        return -1;
+    }
+
+    r->running = false;
+    if (r->thread.joinable()) {
+        r->thread.join();
+    }
+
+    return 0;
+}
+
+
+void audio_replay_free(audio_replay_t *r)
+{
+    if (!r)
+        return;
+
+    audio_replay_pause(r);
+    r->files.clear();
+}
+
+
+bool audio_replay_done(const audio_replay_t *r)
+{
+    return r->done.load();
+}
+
+
+const audio_replay_file_t *audio_replay_file_at(const audio_replay_t *r, uint64_t pos)
+{
+    auto it = std::upper_bound(r->files.begin(), r->files.end(), pos,
+        [](uint64_t p, const audio_replay_file_t &f) { return p < f.pos; });
+
+    if (it == r->files.begin()) {
+        return nullptr;
+    }
+    --it;
+
+    return pos < it->pos + it->n ? &*it : nullptr;
+}
@@ -0,0 +1,58 @@
+#ifndef __AUDIO_REPLAY_H__
+#define __AUDIO_REPLAY_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_ring.h"
+
+
+struct audio_replay_file_t {
+    std::string path;
+    uint64_t    pos = 0;    // ring position of the first sample
+    uint64_t    n   = 0;    // samples
+};
+
+
+// Replays WAV files into an audio_ring_t in place of the microphone, one after
+// the other with gap_ms of silence in between. In real-time mode samples are
+// written at the capture rate; otherwise as fast as the ring drains, blocking
+// while it is full instead of dropping samples.
+struct audio_replay_t {
+    audio_ring_t *ring        = nullptr;
+    int           sample_rate = 0;
+    bool          realtime    = false;
+    int           n_gap       = 0;      // silence after every file, samples
+
+    std::vector<audio_replay_file_t> files;   // fixed after audio_replay_init()
+
+    // called once from the replay thread, e.g. to set its affinity
+    void            (*on_thread)(void *userdata) = nullptr;
+    void             *on_thread_userdata         = nullptr;
+
+    std::thread       thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> done{false};          // every sample has been written
+};
+
+
+// paths: comma separated WAV files or directories (their *.wav files, sorted)
+int audio_replay_init(audio_replay_t *r, audio_ring_t *ring, const std::string &paths,
+    int sample_rate, bool realtime, int gap_ms);
+
+int audio_replay_resume(audio_replay_t *r);
+
+int audio_replay_pause(audio_replay_t *r);
+
+void audio_replay_free(audio_replay_t *r);
+
+// set once the last sample is in the ring
+bool audio_replay_done(const audio_replay_t *r);
+
+// file that ring position pos belongs to, nullptr for the gaps
+const audio_replay_file_t *audio_replay_file_at(const audio_replay_t *r, uint64_t pos);
+
+#endif //__AUDIO_REPLAY_H__
@@ -0,0 +1,226 @@
+#include "audio_ring.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+
+int audio_ring_init(audio_ring_t *r, size_t min_capacity, size_t max_view)
+{
+    if (!r || !min_capacity || max_view > min_capacity) {
+        LOG_ERR("args fail! r(%p), capacity(%zu), max_view(%zu)", r, min_capacity, max_view);
+        return -1;
+    }
+
+    size_t capacity = 1;
+    while (capacity < min_capacity) {
+        capacity <<= 1;
+    }
+
+    if (r->efd < 0) {
+        r->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (r->efd < 0) {
+            LOG_ERR("fail to create eventfd: %s", strerror(errno));
+            return -1;
+        }
+    }
+
+    r->buf.assign(capacity + max_view, 0.0f);
+    r->capacity = capacity;
+    r->mask     = capacity - 1;
+    r->mirror   = max_view;
+
+    r->head.store(0);
+    r->tail.store(0);
+    r->n_overruns.store(0);
+    r->n_dropped.store(0);
+    r->wake_pos.store(0);
+
+    return 0;
+}
+
+
+void audio_ring_free(audio_ring_t *r)
+{
+    if (!r)
+        return;
+
+    if (r->efd >= 0) {
+        close(r->efd);
+        r->efd = -1;
+    }
+
+    std::vector<float>().swap(r->buf);
+    r->capacity = 0;
+    r->mask     = 0;
+    r->mirror   = 0;
+}
+
+
+size_t audio_ring_write(audio_ring_t *r, const float *data, size_t n)
+{
+    const uint64_t head = r->head.load(std::memory_order_relaxed);
+    const uint64_t tail = r->tail.load(std::memory_order_acquire);
+
+    const size_t n_free = r->capacity - (size_t)(head - tail);
+    if (n > n_free) {
+        r->n_overruns.fetch_add(1, std::memory_order_relaxed);
+        r->n_dropped.fetch_add(n - n_free, std::memory_order_relaxed);
+        n = n_free;
+    }
+
+    size_t done = 0;
+    while (done < n) {
+        const size_t pos = (size_t)((head + done) & r->mask);
+        const size_t len = std::min(n - done, r->capacity - pos);
+
+        memcpy(&r->buf[pos], data + done, len*sizeof(float));
+
+        if (pos < r->mirror) {
+            memcpy(&r->buf[r->capacity + pos], data + done, std::min(len, r->mirror - pos)*sizeof(float));
+        }
+        done += len;
+    }
+
+    r->t_head.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count(), std::memory_order_relaxed);
+    r->head.store(head + n, std::memory_order_release);
+
+    // pairs with the fence in audio_ring_wait(), one of the two sides sees the other
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    const uint64_t wake_pos = r->wake_pos.load(std::memory_order_relaxed);
+    if (wake_pos && head + n >= wake_pos && r->wake_pos.exchange(0) == wake_pos) {
+        const uint64_t one = 1;
+        if (write(r->efd, &one, sizeof(one)) < 0) {
+            // the counter can only overflow if nobody ever reads it, nothing to do
+        }
+    }
+
+    return n;
+}
+
+
+size_t audio_ring_space(const audio_ring_t *r)
+{
+    const uint64_t head = r->head.load(std::memory_order_relaxed);
+    const uint64_t tail = r->tail.load(std::memory_order_acquire);
+
+    return r->capacity - (size_t)(head - tail);
+}
+
+
+uint64_t audio_ring_head(const audio_ring_t *r)
+{
+    return r->head.load(std::memory_order_acquire);
+}
+
+
+uint64_t audio_ring_tail(const audio_ring_t *r)
+{
+    return r->tail.load(std::memory_order_relaxed);
+}
+
+
+int audio_ring_view(const audio_ring_t *r, uint64_t pos, size_t n, audio_view_t *view)
+{
+    const uint64_t head = r->head.load(std::memory_order_acquire);
+    const uint64_t tail = r->tail.load(std::memory_order_relaxed);
+
+    if (pos < tail || pos + n > head || n > r->mirror) {
+        LOG_ERR("view [%llu, %llu) out of [%llu, %llu) or above %zu samples",
+            (unsigned long long) pos, (unsigned long long) (pos + n),
+            (unsigned long long) tail, (unsigned long long) head, r->mirror);
+        return -1;
+    }
+
+    view->data = &r->buf[pos & r->mask];
+    view->n    = n;
+    view->pos  = pos;
+
+    return 0;
+}
+
+
+int audio_ring_view_last(const audio_ring_t *r, size_t n, audio_view_t *view)
+{
+    const uint64_t head = r->head.load(std::memory_order_acquire);
+    const uint64_t tail = r->tail.load(std::memory_order_relaxed);
+
+    n = std::min(n, (size_t)(head - tail));
+
+    return audio_ring_view(r, head - n, n, view);
+}
+
+
+void audio_ring_release(audio_ring_t *r, uint64_t pos)
+{
+    const uint64_t head = r->head.load(std::memory_order_acquire);
+    const uint64_t tail = r->tail.load(std::memory_order_relaxed);
+
+    pos = std::min(pos, head);
+    if (pos > tail) {
+        r->tail.store(pos, std::memory_order_release);
+    }
+}
+
+
+int64_t audio_ring_time(const audio_ring_t *r, uint64_t pos, int sample_rate)
+{
+    const uint64_t head   = r->head.load(std::memory_order_acquire);
+    const int64_t  t_head = r->t_head.load(std::memory_order_relaxed);
+
+    // the last written sample was captured at t_head, earlier ones one period apart
+    return t_head - ((int64_t) head - (int64_t) pos)*1000000000/sample_rate;
+}
+
+
+int audio_ring_wait(audio_ring_t *r, uint64_t pos, int timeout_ms)
+{
+    uint64_t value = 0;
+
+    // drop a signal left over from a wait that was satisfied without blocking
+    if (read(r->efd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        LOG_ERR("fail to read eventfd: %s", strerror(errno));
+        return -1;
+    }
+
+    r->wake_pos.store(std::max<uint64_t>(pos, 1), std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (r->head.load(std::memory_order_acquire) >= pos) {
+        r->wake_pos.store(0, std::memory_order_relaxed);
+        return 1;
+    }
+
+    struct pollfd pfd = { r->efd, POLLIN, 0 };
+
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0 && errno != EINTR) {
+        LOG_ERR("fail to poll eventfd: %s", strerror(errno));
+        r->wake_pos.store(0, std::memory_order_relaxed);
+        return -1;
+    }
+
+    r->wake_pos.store(0, std::memory_order_relaxed);
+
+    return r->head.load(std::memory_order_acquire) >= pos ? 1 : 0;
+}
+
+
+void audio_ring_wakeup(audio_ring_t *r)
+{
+    const uint64_t one = 1;
+    if (write(r->efd, &one, sizeof(one)) < 0) {
+        LOG_ERR("fail to write eventfd: %s", strerror(errno));
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef __AUDIO_RING_H__
+#define __AUDIO_RING_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Single-producer / single-consumer lock-free ring of mono float samples.
+//
+// Positions are absolute sample indices since the ring was created, so the
+// consumer can keep window boundaries across wrap-arounds. The first `mirror`
+// samples of every lap are also written past the end of the buffer, which makes
+// any view of up to `mirror` samples contiguous and directly usable by whisper_full.
+//
+// The producer never overwrites samples the consumer has not released: when the
+// ring is full the newest samples are dropped and counted as an overrun.
+//
+// The consumer can block in audio_ring_wait() until a given position has been
+// written; the producer signals it through an eventfd only once per wait.
+struct audio_ring_t {
+    std::vector<float> buf;
+    size_t capacity = 0;
+    size_t mask     = 0;
+    size_t mirror   = 0;
+
+    alignas(64) std::atomic<uint64_t> head{0};  // written by the producer
+    alignas(64) std::atomic<uint64_t> tail{0};  // released by the consumer
+
+    std::atomic<int64_t>  t_head{0};            // steady clock ns of the last write
+
+    std::atomic<uint64_t> n_overruns{0};        // writes that did not fit
+    std::atomic<uint64_t> n_dropped{0};         // samples lost to overruns
+
+    int                   efd = -1;             // wakes the consumer
+    std::atomic<uint64_t> wake_pos{0};          // 0 - nobody is waiting
+};
+
+
+struct audio_view_t {
+    const float *data = nullptr;
+    size_t       n    = 0;
+    uint64_t     pos  = 0;  // absolute index of data[0]
+};
+
+
+int audio_ring_init(audio_ring_t *r, size_t min_capacity, size_t max_view);
+
+void audio_ring_free(audio_ring_t *r);
+
+// producer side
+size_t audio_ring_write(audio_ring_t *r, const float *data, size_t n);
+
+// samples that can be written without an overrun
+size_t audio_ring_space(const audio_ring_t *r);
+
+// consumer side
+uint64_t audio_ring_head(const audio_ring_t *r);
+
+uint64_t audio_ring_tail(const audio_ring_t *r);
+
+int audio_ring_view(const audio_ring_t *r, uint64_t pos, size_t n, audio_view_t *view);
+
+int audio_ring_view_last(const audio_ring_t *r, size_t n, audio_view_t *view);
+
+void audio_ring_release(audio_ring_t *r, uint64_t pos);
+
+// estimated steady clock time (ns) at which the sample at pos was captured
+int64_t audio_ring_time(const audio_ring_t *r, uint64_t pos, int sample_rate);
+
+// block until the head reaches pos, 1 - ready, 0 - timeout, -1 - error
+int audio_ring_wait(audio_ring_t *r, uint64_t pos, int timeout_ms);
+
+// wake a blocked audio_ring_wait() early, e.g. on shutdown
+void audio_ring_wakeup(audio_ring_t *r);
+
+#endif //__AUDIO_RING_H__
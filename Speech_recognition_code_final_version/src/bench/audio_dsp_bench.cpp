@@ -0,0 +1,288 @@
+// Microbenchmark of the audio_dsp kernels against the scalar loops they replaced
+//
+// Every kernel runs over the same buffer of synthetic speech-like audio; the
+// table shows ns per sample for the old loop and the kernel, the speedup and
+// the largest relative difference between their results.
+//
+#include "audio_dsp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+
+
+// the loops as they were: stream_vad_process(), V1 get_max_loudness(), audio_replay_read()
+
+static float ref_highpass_energy(float alpha, float &hp_x, float &hp_y, const float *frame, int n)
+{
+    float energy = 0.0f;
+
+    float x0 = hp_x;
+    float y  = hp_y;
+    for (int i = 0; i < n; i++) {
+        y  = alpha*(y + frame[i] - x0);
+        x0 = frame[i];
+        energy += y*y;
+    }
+    hp_x = x0;
+    hp_y = y;
+
+    return energy/n;
+}
+
+
+static float ref_energy(const float *frame, int n)
+{
+    float energy = 0.0f;
+    for (int i = 0; i < n; i++) {
+        energy += frame[i]*frame[i];
+    }
+    return energy/n;
+}
+
+
+static int ref_peak_s16(const int16_t *samples, size_t n)
+{
+    int16_t maxSample = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (std::abs(samples[i]) > std::abs(maxSample)) {
+            maxSample = samples[i];
+        }
+    }
+    return std::abs(maxSample);
+}
+
+
+static float ref_peak(const float *x, size_t n)
+{
+    float peak = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        peak = std::max(peak, std::fabs(x[i]));
+    }
+    return peak;
+}
+
+
+static uint32_t ref_le(const uint8_t *p, int n)
+{
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+
+// mono 16-bit PCM bytes as read from the WAV file
+static void ref_s16_to_f32(const uint8_t *raw, float *y, size_t n, int channels)
+{
+    const size_t frame_size = channels*2;
+
+    for (size_t i = 0; i < n; i++) {
+        float sum = 0.0f;
+        for (int c = 0; c < channels; c++) {
+            sum += (int16_t) ref_le(&raw[i*frame_size + c*2], 2)/32768.0f;
+        }
+        y[i] = sum/channels;
+    }
+}
+
+
+static void ref_decimate(const float *x, float *y, size_t n, int factor)
+{
+    for (size_t i = 0; i < n; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < factor; k++) {
+            sum += x[i*factor + k];
+        }
+        y[i] = sum/factor;
+    }
+}
+
+
+// keeps the compiler from dropping the loops
+static volatile float g_sink;
+
+
+template <typename F>
+static double bench_ns(F &&f, int n_iter)
+{
+    f();
+
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < n_iter; i++) {
+        f();
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()/n_iter;
+}
+
+
+static double rel_diff(double a, double b)
+{
+    const double m = std::max(std::fabs(a), std::fabs(b));
+    return m > 0.0 ? std::fabs(a - b)/m : 0.0;
+}
+
+
+static double rel_diff(const std::vector<float> &a, const std::vector<float> &b, size_t n)
+{
+    double scale = 0.0;
+    double diff  = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        scale = std::max(scale, (double) std::fabs(a[i]));
+        diff  = std::max(diff, (double) std::fabs(a[i] - b[i]));
+    }
+    return scale > 0.0 ? diff/scale : diff;
+}
+
+
+static void print_row(const char *name, size_t n, double t_ref, double t_dsp, double diff)
+{
+    printf("%-24s %10.3f %10.3f %8.2fx %12.2e\n", name, t_ref/n, t_dsp/n, t_ref/t_dsp, diff);
+}
+
+
+int main(int argc, char const *argv[])
+{
+    const int n_iter = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+
+    // 2 s at 16 kHz, the window vad_simple looked at; the VAD itself works on 20 ms frames
+    const int    sample_rate = 16000;
+    const size_t n           = 2*sample_rate;
+    const int    n_frame     = sample_rate*20/1000;
+
+    std::mt19937 rng(42);
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+
+    std::vector<float>   pcmf(3*n);
+    std::vector<int16_t> pcm16(n);
+    for (size_t i = 0; i < pcmf.size(); i++) {
+        const double t = (double) i/(3*sample_rate);
+        pcmf[i] = 0.3f*std::sin(2.0*M_PI*220.0*t)*std::sin(2.0*M_PI*3.0*t) + 0.05f*std::sin(2.0*M_PI*50.0*t) + noise(rng);
+    }
+    for (size_t i = 0; i < n; i++) {
+        pcm16[i] = (int16_t) std::max(-32768.0f, std::min(32767.0f, pcmf[i]*32768.0f));
+    }
+    pcm16[n/3] = -32768;
+
+    std::vector<float> out_ref(n);
+    std::vector<float> out_dsp(n);
+
+    printf("audio_dsp backend: %s, %zu samples, %d iterations\n\n", audio_dsp_backend(), n, n_iter);
+    printf("%-24s %10s %10s %9s %12s\n", "kernel", "ref ns/smp", "dsp ns/smp", "speedup", "rel diff");
+
+    // high-pass + energy, per 20 ms frame like the VAD
+    {
+        audio_dsp_hp_t hp;
+        audio_dsp_hp_init(&hp, 100.0f, sample_rate);
+
+        float hp_x = 0.0f;
+        float hp_y = 0.0f;
+
+        double e_ref = 0.0;
+        double e_dsp = 0.0;
+
+        const double t_ref = bench_ns([&] {
+            hp_x = hp_y = 0.0f;
+            e_ref = 0.0;
+            for (size_t i = 0; i + n_frame <= n; i += n_frame) {
+                e_ref += ref_highpass_energy(hp.alpha, hp_x, hp_y, pcmf.data() + i, n_frame);
+            }
+            g_sink = e_ref;
+        }, n_iter);
+
+        const double t_dsp = bench_ns([&] {
+            audio_dsp_hp_reset(&hp);
+            e_dsp = 0.0;
+            for (size_t i = 0; i + n_frame <= n; i += n_frame) {
+                e_dsp += audio_dsp_highpass_energy(&hp, pcmf.data() + i, n_frame);
+            }
+            g_sink = e_dsp;
+        }, n_iter);
+
+        print_row("highpass_energy 20ms", n, t_ref, t_dsp, rel_diff(e_ref, e_dsp));
+    }
+
+    // high-pass over the whole window, output written out
+    {
+        audio_dsp_hp_t hp;
+        audio_dsp_hp_init(&hp, 100.0f, sample_rate);
+
+        const double t_ref = bench_ns([&] {
+            float y  = 0.0f;
+            float x0 = 0.0f;
+            for (size_t i = 0; i < n; i++) {
+                y  = hp.alpha*(y + pcmf[i] - x0);
+                x0 = pcmf[i];
+                out_ref[i] = y;
+            }
+        }, n_iter);
+
+        const double t_dsp = bench_ns([&] {
+            audio_dsp_hp_reset(&hp);
+            audio_dsp_highpass(&hp, pcmf.data(), out_dsp.data(), n);
+        }, n_iter);
+
+        print_row("highpass 2s", n, t_ref, t_dsp, rel_diff(out_ref, out_dsp, n));
+    }
+
+    {
+        float e_ref = 0.0f;
+        float e_dsp = 0.0f;
+
+        const double t_ref = bench_ns([&] { g_sink = e_ref = ref_energy(pcmf.data(), n); }, n_iter);
+        const double t_dsp = bench_ns([&] { g_sink = e_dsp = audio_dsp_energy(pcmf.data(), n); }, n_iter);
+
+        print_row("energy", n, t_ref, t_dsp, rel_diff(e_ref, e_dsp));
+    }
+
+    {
+        float p_ref = 0.0f;
+        float p_dsp = 0.0f;
+
+        const double t_ref = bench_ns([&] { g_sink = p_ref = ref_peak(pcmf.data(), n); }, n_iter);
+        const double t_dsp = bench_ns([&] { g_sink = p_dsp = audio_dsp_peak(pcmf.data(), n); }, n_iter);
+
+        print_row("peak", n, t_ref, t_dsp, rel_diff(p_ref, p_dsp));
+    }
+
+    {
+        int p_ref = 0;
+        int p_dsp = 0;
+
+        const double t_ref = bench_ns([&] { g_sink = p_ref = ref_peak_s16(pcm16.data(), n); }, n_iter);
+        const double t_dsp = bench_ns([&] { g_sink = p_dsp = audio_dsp_peak_s16(pcm16.data(), n); }, n_iter);
+
+        print_row("peak_s16", n, t_ref, t_dsp, rel_diff(p_ref, p_dsp));
+    }
+
+    {
+        const uint8_t *raw = (const uint8_t *) pcm16.data();
+
+        const double t_ref = bench_ns([&] { ref_s16_to_f32(raw, out_ref.data(), n, 1); g_sink = out_ref[n/2]; }, n_iter);
+        const double t_dsp = bench_ns([&] { audio_dsp_s16_to_f32(pcm16.data(), out_dsp.data(), n); g_sink = out_dsp[n/2]; }, n_iter);
+
+        print_row("s16_to_f32", n, t_ref, t_dsp, rel_diff(out_ref, out_dsp, n));
+    }
+
+    for (int factor : { 2, 3 }) {
+        const double t_ref = bench_ns([&] { ref_decimate(pcmf.data(), out_ref.data(), n, factor); g_sink = out_ref[n/2]; }, n_iter);
+        const double t_dsp = bench_ns([&] { audio_dsp_decimate(pcmf.data(), out_dsp.data(), n, factor); g_sink = out_dsp[n/2]; }, n_iter);
+
+        const std::string name = "decimate /" + std::to_string(factor);
+        print_row(name.c_str(), n, t_ref, t_dsp, rel_diff(out_ref, out_dsp, n));
+    }
+
+    printf("\n");
+
+    return 0;
+}
@@ -0,0 +1,538 @@
+// Benchmark matrix for whisper-fuzzy
+//
+// Replays a labelled WAV corpus through the recognizer once for every
+// combination of model, thread count, audio context, step and length, and
+// prints real-time factor, latency percentiles, peak RSS and command accuracy
+// per configuration. Every run is a forked child calling whisper_fuzzy() with
+// -r and -jo, so each one starts cold and its peak RSS is its own.
+//
+#include "audio_replay.h"
+#include "corpus_labels.h"
+#include "debug.h"
+#include "json.hpp"
+#include "whisper_fuzzy.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+
+struct bench_params_t {
+    std::string user;
+    std::string corpus;
+    std::string labels;             // "" - labels.tsv in the first corpus directory
+    std::string work_dir = "bench";
+    std::string csv;
+
+    std::vector<std::string> models     = { "models/ggml-base.en.bin" };
+    std::vector<std::string> threads    = { "4" };
+    std::vector<std::string> audio_ctx  = { "0" };
+    std::vector<std::string> step_ms    = { "0" };
+    std::vector<std::string> length_ms  = { "3000" };
+
+    bool realtime = false;
+
+    std::vector<std::string> extra;  // after --, passed to every run
+
+    const char *program_name = nullptr;
+};
+
+
+struct bench_config_t {
+    std::string model;
+    std::string threads;
+    std::string audio_ctx;
+    std::string step_ms;
+    std::string length_ms;
+};
+
+
+struct bench_result_t {
+    bench_config_t cfg;
+    std::string    quant;
+
+    int      status  = -1;          // exit status of the run, -1 - it did not exit normally
+    double   t_wall  = 0.0;         // s, including the model load
+    double   rss_mb  = 0.0;
+
+    uint64_t n_utterances = 0;
+    double   rtf          = 0.0;    // inference time over corpus audio
+    double   p50_ms       = 0.0;
+    double   p99_ms       = 0.0;
+
+    int      n_labelled = 0;
+    int      n_correct  = 0;
+    int      n_false    = 0;        // a command fired on a file labelled none
+
+    bool     pareto = false;
+};
+
+
+static void bench_print_usage(const bench_params_t &params)
+{
+    printf("\n");
+    printf("usage: %s [options] [-- whisper-fuzzy options for every run]\n", params.program_name);
+    printf("\n");
+    printf("options:\n");
+    printf("  -h,       --help           show this help message and exit\n");
+    printf("  -u FNAME, --user FNAME     user config.json path\n");
+    printf("  -r PATHS, --corpus PATHS   WAV files or directories (comma separated)\n");
+    printf("  -lb FNAME, --labels FNAME  expected code per file, 'name code' lines, code 'none' for no command\n");
+    printf("                             (default: labels.tsv in the first corpus directory)\n");
+    printf("  -m LIST,  --model LIST     model files, e.g. ggml-base.en.bin,ggml-base.en-q5_1.bin\n");
+    printf("  -t LIST,  --threads LIST   thread counts\n");
+    printf("  -ac LIST, --audio-ctx LIST audio context sizes (0 - all)\n");
+    printf("            --step LIST      step sizes in ms (0 - VAD)\n");
+    printf("            --length LIST    lengths in ms\n");
+    printf("  -rrt,     --realtime       replay at the capture rate, latency is end of speech to result\n");
+    printf("  -w DIR,   --work-dir DIR   per-run logs and JSON lines [%s]\n", params.work_dir.c_str());
+    printf("  -o FNAME, --csv FNAME      also write the table as CSV\n");
+    printf("\n");
+}
+
+
+static std::vector<std::string> bench_split(const std::string &list)
+{
+    std::vector<std::string> items;
+
+    size_t i = 0;
+    while (i <= list.size()) {
+        size_t j = list.find(',', i);
+        if (j == std::string::npos) {
+            j = list.size();
+        }
+        if (j > i) {
+            items.push_back(list.substr(i, j - i));
+        }
+        i = j + 1;
+    }
+
+    return items;
+}
+
+
+static bool bench_params_parse(int argc, char const *argv[], bench_params_t &params)
+{
+    params.program_name = argv[0];
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--") {
+            params.extra.assign(argv + i + 1, argv + argc);
+            break;
+        }
+
+        if (arg == "-h" || arg == "--help") {
+            bench_print_usage(params);
+            exit(0);
+        }
+
+        if (i + 1 >= argc && arg != "-rrt" && arg != "--realtime") {
+            fprintf(stderr, "error: %s needs a value\n", arg.c_str());
+            return false;
+        }
+
+        if      (arg == "-u"   || arg == "--user")      { params.user      = argv[++i]; }
+        else if (arg == "-r"   || arg == "--corpus")    { params.corpus    = argv[++i]; }
+        else if (arg == "-lb"  || arg == "--labels")    { params.labels    = argv[++i]; }
+        else if (arg == "-m"   || arg == "--model")     { params.models    = bench_split(argv[++i]); }
+        else if (arg == "-t"   || arg == "--threads")   { params.threads   = bench_split(argv[++i]); }
+        else if (arg == "-ac"  || arg == "--audio-ctx") { params.audio_ctx = bench_split(argv[++i]); }
+        else if (                 arg == "--step")      { params.step_ms   = bench_split(argv[++i]); }
+        else if (                 arg == "--length")    { params.length_ms = bench_split(argv[++i]); }
+        else if (arg == "-rrt" || arg == "--realtime")  { params.realtime  = true; }
+        else if (arg == "-w"   || arg == "--work-dir")  { params.work_dir  = argv[++i]; }
+        else if (arg == "-o"   || arg == "--csv")       { params.csv       = argv[++i]; }
+        else {
+            fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    if (params.user.empty() || params.corpus.empty()) {
+        fprintf(stderr, "error: -u and -r are required\n");
+        return false;
+    }
+
+    if (params.models.empty() || params.threads.empty() || params.audio_ctx.empty() ||
+        params.step_ms.empty() || params.length_ms.empty()) {
+        fprintf(stderr, "error: empty sweep list\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+// ftype from the ggml header, "?" if it cannot be read
+static std::string bench_model_quant(const std::string &path)
+{
+    static const char *const names[] = {
+        "f32", "f16", "q4_0", "q4_1", "q4_1_f16", "?", "?", "q8_0", "q5_0", "q5_1",
+        "q2_k", "q3_k", "q4_k", "q5_k", "q6_k",
+    };
+
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) {
+        return "?";
+    }
+
+    // magic, then n_vocab, n_audio_ctx, n_audio_state, n_audio_head, n_audio_layer,
+    // n_text_ctx, n_text_state, n_text_head, n_text_layer, n_mels, ftype
+    int32_t hdr[12];
+    const bool ok = fread(hdr, sizeof(hdr), 1, fp) == 1 && (uint32_t) hdr[0] == 0x67676d6c;
+    fclose(fp);
+
+    if (!ok) {
+        return "?";
+    }
+
+    // GGML_QNT_VERSION_FACTOR
+    const int ftype = hdr[11] % 1000;
+
+    return ftype >= 0 && ftype < (int) (sizeof(names)/sizeof(names[0])) ? names[ftype] : "?";
+}
+
+
+// the commands are read back from the JSON lines
+static int bench_callback(size_t /*leat_count*/, const char * /*text*/, const char * /*code*/, void * /*userdata*/)
+{
+    return 0;
+}
+
+
+// the child: whisper_fuzzy() on the corpus with this configuration, output into log
+static void bench_child(const std::vector<std::string> &args, const std::string &log)
+{
+    const int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    std::vector<const char *> argv;
+    for (const auto &arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    whisper_fuzzy_t *w = whisper_fuzzy_init(argv.size() - 1, argv.data());
+    if (!w) {
+        _exit(100);
+    }
+
+    const int ret = whisper_fuzzy(w, bench_callback, nullptr);
+
+    whisper_fuzzy_exit(w);
+
+    fflush(stdout);
+    fflush(stderr);
+    _exit(ret < 0 ? 101 : ret);
+}
+
+
+static double bench_percentile(std::vector<double> &values, double p)
+{
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    const size_t i = (size_t) std::ceil(p/100.0*values.size());
+
+    return values[std::min(values.size() - 1, i ? i - 1 : 0)];
+}
+
+
+// per-utterance lines of one run: latency, inference time, and the first command of every file
+static void bench_score(const std::string &jsonl, bool realtime, double t_audio_ms,
+    const std::map<std::string, std::string> &labels, bench_result_t &r)
+{
+    std::ifstream file(jsonl);
+
+    std::vector<double>                latencies;
+    std::map<std::string, std::string> fired;     // file -> first code
+
+    double t_infer = 0.0;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        const nlohmann::json j = nlohmann::json::parse(line, nullptr, false);
+        if (j.is_discarded()) {
+            continue;
+        }
+
+        r.n_utterances++;
+        t_infer += j.value("infer_ms", 0.0);
+
+        if (realtime && j["endpoint_ms"].is_number()) {
+            latencies.push_back(j["endpoint_ms"].get<double>());
+        } else {
+            latencies.push_back(j.value("infer_ms", 0.0) + j.value("dispatch_ms", 0.0));
+        }
+
+        if (!j["file"].is_string() || !j["code"].is_string() || j.value("duplicate", false)) {
+            continue;
+        }
+
+        const std::string name = corpus_labels_basename(j["file"].get<std::string>());
+        if (!fired.count(name)) {
+            fired[name] = j["code"].get<std::string>();
+        }
+    }
+
+    r.rtf    = t_audio_ms > 0 ? t_infer/t_audio_ms : 0.0;
+    r.p50_ms = bench_percentile(latencies, 50.0);
+    r.p99_ms = bench_percentile(latencies, 99.0);
+
+    for (const auto &label : labels) {
+        auto it = fired.find(label.first);
+
+        const bool none = label.second == "none";
+
+        r.n_labelled++;
+        if (none) {
+            r.n_correct += it == fired.end();
+            r.n_false   += it != fired.end();
+        } else {
+            r.n_correct += it != fired.end() && it->second == label.second;
+        }
+    }
+}
+
+
+static int bench_run(const bench_params_t &params, const bench_config_t &cfg, int index, double t_audio_ms,
+    const std::map<std::string, std::string> &labels, bench_result_t &r)
+{
+    const std::string prefix = params.work_dir + "/run-" + std::to_string(index);
+    const std::string jsonl  = prefix + ".jsonl";
+
+    std::vector<std::string> args = {
+        "whisper-fuzzy",
+        "-u", params.user,
+        "-m", cfg.model,
+        "-t", cfg.threads,
+        "-ac", cfg.audio_ctx,
+        "--step", cfg.step_ms,
+        "--length", cfg.length_ms,
+        "-r", params.corpus,
+        "-jo", jsonl,
+    };
+    if (params.realtime) {
+        args.push_back("-rrt");
+    }
+    args.insert(args.end(), params.extra.begin(), params.extra.end());
+
+    r.cfg   = cfg;
+    r.quant = bench_model_quant(cfg.model);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    const auto t_start = std::chrono::steady_clock::now();
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        LOG_ERR("fork failed: %s", strerror(errno));
+        return -1;
+    }
+    if (pid == 0) {
+        bench_child(args, prefix + ".log");
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        LOG_ERR("wait4 failed: %s", strerror(errno));
+        return -1;
+    }
+
+    r.t_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    r.rss_mb = usage.ru_maxrss/1024.0;
+    r.status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+    if (r.status != 0) {
+        LOG_ERR("run %d exited with %d, see %s.log", index, r.status, prefix.c_str());
+    }
+
+    bench_score(jsonl, params.realtime, t_audio_ms, labels, r);
+
+    return 0;
+}
+
+
+static double bench_accuracy(const bench_result_t &r)
+{
+    return r.n_labelled ? (double) r.n_correct/r.n_labelled : 0.0;
+}
+
+
+// a run is on the front unless another one is at least as good in RTF, p99, RSS and accuracy, and better in one
+static void bench_pareto(std::vector<bench_result_t> &results)
+{
+    for (auto &a : results) {
+        a.pareto = a.status == 0;
+
+        for (const auto &b : results) {
+            if (&a == &b || b.status != 0 || !a.pareto) {
+                continue;
+            }
+
+            const bool no_worse = b.rtf <= a.rtf && b.p99_ms <= a.p99_ms && b.rss_mb <= a.rss_mb &&
+                bench_accuracy(b) >= bench_accuracy(a);
+            const bool better   = b.rtf < a.rtf || b.p99_ms < a.p99_ms || b.rss_mb < a.rss_mb ||
+                bench_accuracy(b) > bench_accuracy(a);
+
+            if (no_worse && better) {
+                a.pareto = false;
+            }
+        }
+    }
+}
+
+
+static void bench_print_table(const std::vector<bench_result_t> &results, bool realtime)
+{
+    printf("\n");
+    printf("%-28s %-6s %3s %5s %6s %6s | %6s %9s %9s %8s %9s %5s %6s | %s\n",
+        "model", "quant", "t", "ac", "step", "length",
+        "rtf", realtime ? "p50 e2e" : "p50 ms", realtime ? "p99 e2e" : "p99 ms", "rss MB", "accuracy", "false", "utts", "");
+
+    for (const auto &r : results) {
+        char accuracy[32];
+        snprintf(accuracy, sizeof(accuracy), "%d/%d", r.n_correct, r.n_labelled);
+
+        printf("%-28.28s %-6s %3s %5s %6s %6s | %6.3f %9.1f %9.1f %8.1f %9s %5d %6llu | %s\n",
+            corpus_labels_basename(r.cfg.model).c_str(), r.quant.c_str(), r.cfg.threads.c_str(), r.cfg.audio_ctx.c_str(),
+            r.cfg.step_ms.c_str(), r.cfg.length_ms.c_str(),
+            r.rtf, r.p50_ms, r.p99_ms, r.rss_mb, accuracy, r.n_false, (unsigned long long) r.n_utterances,
+            r.status != 0 ? "failed" : r.pareto ? "pareto" : "");
+    }
+
+    printf("\n");
+}
+
+
+static int bench_write_csv(const std::string &path, const std::vector<bench_result_t> &results)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return -1;
+    }
+
+    fprintf(fp, "model,quant,threads,audio_ctx,step_ms,length_ms,status,wall_s,rtf,p50_ms,p99_ms,rss_mb,"
+        "utterances,labelled,correct,false_fires,accuracy,pareto\n");
+
+    for (const auto &r : results) {
+        fprintf(fp, "%s,%s,%s,%s,%s,%s,%d,%.2f,%.4f,%.2f,%.2f,%.1f,%llu,%d,%d,%d,%.4f,%d\n",
+            r.cfg.model.c_str(), r.quant.c_str(), r.cfg.threads.c_str(), r.cfg.audio_ctx.c_str(),
+            r.cfg.step_ms.c_str(), r.cfg.length_ms.c_str(), r.status, r.t_wall, r.rtf, r.p50_ms, r.p99_ms,
+            r.rss_mb, (unsigned long long) r.n_utterances, r.n_labelled, r.n_correct, r.n_false,
+            bench_accuracy(r), r.pareto ? 1 : 0);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+
+int main(int argc, char const *argv[])
+{
+    bench_params_t params;
+
+    if (!bench_params_parse(argc, argv, params)) {
+        bench_print_usage(params);
+        return 1;
+    }
+
+    // the corpus as the replay will see it, for its length and the default labels
+    audio_ring_t   ring;
+    audio_replay_t replay;
+
+    if (audio_replay_init(&replay, &ring, params.corpus, 16000, false, 0) < 0) {
+        return 1;
+    }
+
+    double t_audio_ms = 0.0;
+    std::vector<std::string> names;
+    for (const auto &file : replay.files) {
+        t_audio_ms += file.n*1000.0/replay.sample_rate;
+        names.push_back(corpus_labels_basename(file.path));
+    }
+
+    // the children inherit what the parent holds, keep it out of their RSS
+    audio_replay_free(&replay);
+
+    if (params.labels.empty()) {
+        params.labels = corpus_labels_default(params.corpus);
+    }
+
+    std::map<std::string, std::string> labels;
+    if (corpus_labels_read(params.labels, labels) < 0) {
+        return 1;
+    }
+
+    // only the files that are replayed count
+    for (auto it = labels.begin(); it != labels.end();) {
+        const bool replayed = std::find(names.begin(), names.end(), it->first) != names.end();
+        it = replayed ? std::next(it) : labels.erase(it);
+    }
+
+    mkdir(params.work_dir.c_str(), 0755);
+
+    std::vector<bench_config_t> configs;
+    for (const auto &model : params.models)
+    for (const auto &threads : params.threads)
+    for (const auto &audio_ctx : params.audio_ctx)
+    for (const auto &step_ms : params.step_ms)
+    for (const auto &length_ms : params.length_ms) {
+        configs.push_back({ model, threads, audio_ctx, step_ms, length_ms });
+    }
+
+    LOG_INFO("%zu configurations over %zu files (%.1f s of audio, %zu labelled)",
+        configs.size(), names.size(), t_audio_ms*1e-3, labels.size());
+
+    std::vector<bench_result_t> results;
+
+    for (size_t i = 0; i < configs.size(); i++) {
+        const bench_config_t &cfg = configs[i];
+
+        LOG_INFO("[%zu/%zu] %s -t %s -ac %s --step %s --length %s", i + 1, configs.size(),
+            cfg.model.c_str(), cfg.threads.c_str(), cfg.audio_ctx.c_str(), cfg.step_ms.c_str(), cfg.length_ms.c_str());
+
+        bench_result_t r;
+        if (bench_run(params, cfg, (int) i, t_audio_ms, labels, r) < 0) {
+            return 1;
+        }
+        results.push_back(r);
+    }
+
+    bench_pareto(results);
+    bench_print_table(results, params.realtime);
+
+    if (!params.csv.empty() && bench_write_csv(params.csv, results) < 0) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "command_trie.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cstdio>
+
+
+
+void command_trie_init(command_trie_t *trie)
+{
+    trie->nodes.assign(1, command_trie_node_t());
+    trie->n_commands = 0;
+    trie->max_depth  = 0;
+}
+
+
+int command_trie_next(const command_trie_t *trie, int node, int32_t token)
+{
+    const auto &next = trie->nodes[node].next;
+
+    auto it = std::lower_bound(next.begin(), next.end(), std::make_pair(token, 0));
+    if (it == next.end() || it->first != token) {
+        return -1;
+    }
+
+    return it->second;
+}
+
+
+int command_trie_insert(command_trie_t *trie, const int32_t *tokens, int n_tokens)
+{
+    if (!trie || trie->nodes.empty() || !tokens || n_tokens <= 0) {
+        LOG_ERR("args fail! trie(%p), tokens(%p), n_tokens(%d)", trie, tokens, n_tokens);
+        return -1;
+    }
+
+    int node = 0;
+
+    for (int i = 0; i < n_tokens; i++) {
+        int child = command_trie_next(trie, node, tokens[i]);
+        if (child < 0) {
+            child = (int) trie->nodes.size();
+            trie->nodes.emplace_back();
+
+            auto &next = trie->nodes[node].next;
+            next.insert(std::lower_bound(next.begin(), next.end(), std::make_pair(tokens[i], 0)),
+                std::make_pair(tokens[i], child));
+        }
+        node = child;
+    }
+
+    trie->nodes[node].terminal = true;
+    trie->n_commands++;
+    trie->max_depth = std::max(trie->max_depth, n_tokens);
+
+    return node;
+}
+
+
+int command_trie_find(const command_trie_t *trie, const int32_t *tokens, int n_tokens)
+{
+    int node = 0;
+
+    for (int i = 0; i < n_tokens && node >= 0; i++) {
+        node = command_trie_next(trie, node, tokens[i]);
+    }
+
+    return node;
+}
@@ -0,0 +1,33 @@
+#ifndef __COMMAND_TRIE_H__
+#define __COMMAND_TRIE_H__
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+struct command_trie_node_t {
+    std::vector<std::pair<int32_t, int>> next;   // token -> child node, sorted by token
+    bool terminal = false;                       // the path from the root is a whole command
+};
+
+
+// Prefix tree over the token sequences of every command alias, node 0 is the root.
+struct command_trie_t {
+    std::vector<command_trie_node_t> nodes;
+    int n_commands = 0;     // inserted sequences, duplicates included
+    int max_depth  = 0;     // tokens of the longest sequence
+};
+
+
+void command_trie_init(command_trie_t *trie);
+
+int command_trie_insert(command_trie_t *trie, const int32_t *tokens, int n_tokens);
+
+// node reached by following tokens from the root, -1 if they leave the trie
+int command_trie_find(const command_trie_t *trie, const int32_t *tokens, int n_tokens);
+
+// child of node for token, -1 if none
+int command_trie_next(const command_trie_t *trie, int node, int32_t token);
+
+#endif //__COMMAND_TRIE_H__
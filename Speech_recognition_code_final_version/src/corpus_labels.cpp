@@ -0,0 +1,62 @@
+#include "corpus_labels.h"
+#include "debug.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+
+
+int corpus_labels_read(const std::string &path, std::map<std::string, std::string> &labels)
+{
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return -1;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos) {
+            line.erase(hash);
+        }
+
+        char name[512];
+        char code[64];
+        if (sscanf(line.c_str(), "%511s %63s", name, code) != 2) {
+            continue;
+        }
+
+        labels[corpus_labels_basename(name)] = !strcmp(code, "-") ? "none" : code;
+    }
+
+    if (labels.empty()) {
+        LOG_ERR("no label in %s", path.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+std::string corpus_labels_basename(const std::string &path)
+{
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+
+std::string corpus_labels_default(const std::string &corpus)
+{
+    const std::string first = corpus.substr(0, corpus.find(','));
+
+    struct stat st;
+    if (stat(first.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        return first + (first.back() == '/' ? "" : "/") + "labels.tsv";
+    }
+
+    return first.substr(0, first.rfind('/') + 1) + "labels.tsv";
+}
@@ -0,0 +1,19 @@
+#ifndef __CORPUS_LABELS_H__
+#define __CORPUS_LABELS_H__
+
+#include <map>
+#include <string>
+
+
+// Expected command of every recording in a replay corpus, keyed by file name.
+// One "name code" pair per line, '#' starts a comment; code "none" or "-"
+// marks a recording that should not fire anything and is stored as "none".
+int corpus_labels_read(const std::string &path, std::map<std::string, std::string> &labels);
+
+// file name without its directory
+std::string corpus_labels_basename(const std::string &path);
+
+// labels.tsv next to the first of the comma separated -r paths
+std::string corpus_labels_default(const std::string &corpus);
+
+#endif //__CORPUS_LABELS_H__
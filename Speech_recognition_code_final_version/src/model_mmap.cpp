@@ -0,0 +1,164 @@
+#include "model_mmap.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+static int64_t model_mmap_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static uint64_t model_mmap_major_faults()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return 0;
+    }
+
+    return usage.ru_majflt;
+}
+
+
+// one read per page, in order, so the kernel readahead keeps the disk busy
+static void model_mmap_prefetch(model_mmap_t *m)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+
+    volatile uint8_t sink = 0;
+    for (size_t i = 0; i < m->size && !m->stop.load(std::memory_order_relaxed); i += page) {
+        sink += m->data[i];
+    }
+    (void) sink;
+}
+
+
+static size_t model_mmap_read(void *ctx, void *output, size_t read_size)
+{
+    model_mmap_t *m = (model_mmap_t *)ctx;
+
+    const size_t n = std::min(read_size, m->size - m->pos);
+
+    memcpy(output, m->data + m->pos, n);
+    m->pos += n;
+
+    return n;
+}
+
+
+static bool model_mmap_eof(void *ctx)
+{
+    model_mmap_t *m = (model_mmap_t *)ctx;
+
+    return m->pos >= m->size;
+}
+
+
+static void model_mmap_loader_close(void *ctx)
+{
+    model_mmap_t *m = (model_mmap_t *)ctx;
+
+    m->t_close = model_mmap_now();
+}
+
+
+int model_mmap_open(model_mmap_t *m, const char *path, bool prefetch)
+{
+    if (!m || !path) {
+        LOG_ERR("args fail! m(%p), path(%p)", m, path);
+        return -1;
+    }
+
+    m->fd = open(path, O_RDONLY);
+    if (m->fd < 0) {
+        LOG_ERR("fail to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(m->fd, &st) < 0 || st.st_size <= 0) {
+        LOG_ERR("fail to stat %s", path);
+        model_mmap_close(m);
+        return -1;
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, m->fd, 0);
+    if (data == MAP_FAILED) {
+        LOG_ERR("fail to map %s: %s", path, strerror(errno));
+        model_mmap_close(m);
+        return -1;
+    }
+
+    m->data   = (uint8_t *)data;
+    m->size   = st.st_size;
+    m->pos    = 0;
+    m->t_open = model_mmap_now();
+
+    // the loader reads front to back, exactly once
+    madvise(m->data, m->size, MADV_SEQUENTIAL);
+
+    if (prefetch) {
+        madvise(m->data, m->size, MADV_WILLNEED);
+
+        m->stop     = false;
+        m->prefetch = std::thread(model_mmap_prefetch, m);
+    }
+
+    return 0;
+}
+
+
+struct whisper_context *model_mmap_init(model_mmap_t *m, struct whisper_context_params cparams)
+{
+    whisper_model_loader loader;
+
+    loader.context = m;
+    loader.read    = model_mmap_read;
+    loader.eof     = model_mmap_eof;
+    loader.close   = model_mmap_loader_close;
+
+    m->pos = 0;
+
+    const uint64_t n_faults = model_mmap_major_faults();
+
+    struct whisper_context *ctx = whisper_init_with_params_no_state(&loader, cparams);
+
+    m->n_major_faults = model_mmap_major_faults() - n_faults;
+
+    return ctx;
+}
+
+
+void model_mmap_close(model_mmap_t *m)
+{
+    if (!m)
+        return;
+
+    m->stop = true;
+    if (m->prefetch.joinable()) {
+        m->prefetch.join();
+    }
+
+    if (m->data) {
+        munmap(m->data, m->size);
+        m->data = nullptr;
+    }
+
+    if (m->fd >= 0) {
+        close(m->fd);
+        m->fd = -1;
+    }
+}
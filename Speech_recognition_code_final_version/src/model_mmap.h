@@ -0,0 +1,45 @@
+#ifndef __MODEL_MMAP_H__
+#define __MODEL_MMAP_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+#include "whisper.h"
+
+
+// A model file mapped read-only and fed to whisper through a
+// whisper_model_loader, instead of whisper.cpp reading it with std::ifstream.
+// The pages come from the page cache, shared with every other process that
+// loads the same file, and with prefetch a background thread faults them in
+// while the rest of the startup runs. whisper.cpp still copies the tensors
+// into its own buffers, the mapping is only needed until the load is done.
+struct model_mmap_t {
+    int      fd   = -1;
+    uint8_t *data = nullptr;
+    size_t   size = 0;
+    size_t   pos  = 0;              // read position of the loader
+
+    std::thread       prefetch;
+    std::atomic<bool> stop{false};
+
+    // steady clock ns: mapped, last byte handed out (the loader was closed)
+    int64_t t_open  = 0;
+    int64_t t_close = 0;
+
+    uint64_t n_major_faults = 0;    // of the whole process during the load, pages read from disk
+};
+
+
+// map path, with prefetch start reading every page in the background
+int model_mmap_open(model_mmap_t *m, const char *path, bool prefetch);
+
+// whisper_init_with_params_no_state() from the mapping, nullptr on failure;
+// every user of the model adds its own whisper_state
+struct whisper_context *model_mmap_init(model_mmap_t *m, struct whisper_context_params cparams);
+
+// wait for the prefetch and unmap, the pages stay cached
+void model_mmap_close(model_mmap_t *m);
+
+#endif //__MODEL_MMAP_H__
@@ -0,0 +1,90 @@
+#include "stream_arena.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+
+
+int stream_arena_init(stream_arena_t *a, size_t size)
+{
+    if (!a || !size) {
+        LOG_ERR("args fail! a(%p), size(%zu)", a, size);
+        return -1;
+    }
+
+    a->buf.assign(size, 0);
+    a->used        = 0;
+    a->used_max    = 0;
+    a->n_overflows = 0;
+
+    return 0;
+}
+
+
+void stream_arena_reset(stream_arena_t *a)
+{
+    a->used = 0;
+}
+
+
+const char *stream_arena_strndup(stream_arena_t *a, const char *text, size_t n)
+{
+    const size_t room = a->buf.size() - a->used;
+    if (room <= 1) {
+        a->n_overflows++;
+        return "";
+    }
+
+    if (n >= room) {
+        n = room - 1;
+        a->n_overflows++;
+    }
+
+    char *p = a->buf.data() + a->used;
+    memcpy(p, text, n);
+    p[n] = '\0';
+
+    a->used    += n + 1;
+    a->used_max = std::max(a->used_max, a->used);
+
+    return p;
+}
+
+
+const char *stream_arena_strdup(stream_arena_t *a, const char *text)
+{
+    return stream_arena_strndup(a, text ? text : "", text ? strlen(text) : 0);
+}
+
+
+const char *stream_arena_printf(stream_arena_t *a, const char *fmt, ...)
+{
+    const size_t room = a->buf.size() - a->used;
+    if (room <= 1) {
+        a->n_overflows++;
+        return "";
+    }
+
+    char *p = a->buf.data() + a->used;
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(p, room, fmt, args);
+    va_end(args);
+
+    if (n < 0) {
+        p[0] = '\0';
+        n    = 0;
+    } else if ((size_t) n >= room) {
+        n = room - 1;
+        a->n_overflows++;
+    }
+
+    a->used    += n + 1;
+    a->used_max = std::max(a->used_max, a->used);
+
+    return p;
+}
@@ -0,0 +1,33 @@
+#ifndef __STREAM_ARENA_H__
+#define __STREAM_ARENA_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Bump allocator for the strings of one utterance: carved out of a buffer
+// allocated once at startup and handed back all at once by
+// stream_arena_reset(), so the steady state never touches the heap. What does
+// not fit is truncated and counted, never allocated.
+struct stream_arena_t {
+    std::vector<char> buf;
+    size_t   used        = 0;
+    size_t   used_max    = 0;       // high water mark over every reset
+    uint64_t n_overflows = 0;       // strings truncated for lack of room
+};
+
+
+int stream_arena_init(stream_arena_t *a, size_t size);
+
+void stream_arena_reset(stream_arena_t *a);
+
+// copy of the first n chars of text, "" if the arena is full
+const char *stream_arena_strndup(stream_arena_t *a, const char *text, size_t n);
+
+const char *stream_arena_strdup(stream_arena_t *a, const char *text);
+
+// formatted string, truncated to the room left
+const char *stream_arena_printf(stream_arena_t *a, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif //__STREAM_ARENA_H__
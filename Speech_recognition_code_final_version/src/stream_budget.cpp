@@ -0,0 +1,76 @@
+#include "stream_budget.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+
+
+int stream_budget_size(int max_depth, int margin, bool constrained)
+{
+    if (!max_depth) {
+        LOG_INFO("token budget: no command was tokenized, decodes are not limited");
+        return 0;
+    }
+
+    const int n_timestamps = constrained ? 0 : 2;
+    const int max_tokens   = max_depth + std::max(0, margin) + n_timestamps;
+
+    LOG_INFO("token budget: %d per decode, longest command %d tokens + margin %d + %d timestamps",
+        max_tokens, max_depth, std::max(0, margin), n_timestamps);
+
+    return max_tokens;
+}
+
+
+void stream_budget_init(stream_budget_t *b, int max_tokens)
+{
+    b->max_tokens = std::max(0, max_tokens);
+    b->n_sampled  = 0;
+    b->n_hit      = 0;
+}
+
+
+int stream_budget_whisper_max_tokens(const stream_budget_t *b)
+{
+    return b->max_tokens > 0 ? b->max_tokens + 1 : 0;
+}
+
+
+void stream_budget_begin(stream_budget_t *b)
+{
+    b->n_sampled = 0;
+}
+
+
+bool stream_budget_filter(stream_budget_t *b, int n_tokens, float *logits, int n_vocab, int32_t token_eot)
+{
+    if (b->max_tokens <= 0 || n_tokens <= b->max_tokens) {
+        return false;
+    }
+
+    b->n_sampled = n_tokens;
+
+    std::fill(logits, logits + n_vocab, -INFINITY);
+    logits[token_eot] = 0.0f;
+
+    return true;
+}
+
+
+bool stream_budget_cut(const stream_budget_t *b)
+{
+    return b->n_sampled > 0;
+}
+
+
+void stream_budget_print_stats(const stream_budget_t *b, uint64_t n_completed)
+{
+    if (b->max_tokens <= 0 || !n_completed) {
+        return;
+    }
+
+    LOG_INFO("inference: %llu of %llu completed runs were cut off by the budget of %d tokens",
+        (unsigned long long) b->n_hit, (unsigned long long) n_completed, b->max_tokens);
+}
@@ -0,0 +1,41 @@
+#ifndef __STREAM_BUDGET_H__
+#define __STREAM_BUDGET_H__
+
+#include <cstdint>
+
+
+// Token budget of every decode (-mt). whisper_full is run with one step past
+// the budget: that step is only reached when the token sampled at step
+// max_tokens was no EOT, so it tells a cut-off decode from one that ended
+// right at the budget. The logits filter ends it with EOT, which keeps the
+// same text as whisper's own cut would have kept.
+struct stream_budget_t {
+    int max_tokens = 0;            // 0 - no limit
+
+    int n_sampled = 0;             // tokens sampled when the running decode was cut, 0 - not cut
+
+    uint64_t n_hit = 0;            // completed runs that were cut off
+};
+
+
+// -mt -1: the longest tokenized command, the margin for punctuation, and unless
+// decoding is constrained the timestamps opening and closing the segment
+int stream_budget_size(int max_depth, int margin, bool constrained);
+
+void stream_budget_init(stream_budget_t *b, int max_tokens);
+
+// max_tokens for whisper_full_params, one step past the budget
+int stream_budget_whisper_max_tokens(const stream_budget_t *b);
+
+// before every whisper_full
+void stream_budget_begin(stream_budget_t *b);
+
+// from the logits filter, true if the decode is cut off here and the logits only allow EOT
+bool stream_budget_filter(stream_budget_t *b, int n_tokens, float *logits, int n_vocab, int32_t token_eot);
+
+// the last whisper_full was cut off by the budget
+bool stream_budget_cut(const stream_budget_t *b);
+
+void stream_budget_print_stats(const stream_budget_t *b, uint64_t n_completed);
+
+#endif //__STREAM_BUDGET_H__
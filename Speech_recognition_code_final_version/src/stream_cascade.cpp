@@ -0,0 +1,50 @@
+#include "stream_cascade.h"
+#include "debug.h"
+
+#include <cstdio>
+
+
+
+void stream_cascade_init(stream_cascade_t *c, float thold)
+{
+    c->thold = thold;
+
+    for (auto &tier : c->tiers) {
+        tier = stream_cascade_tier_t();
+    }
+}
+
+
+bool stream_cascade_done(stream_cascade_t *c, int tier, bool matched, float p_min, int64_t t_latency)
+{
+    stream_cascade_tier_t &t = c->tiers[tier];
+
+    t.n_runs++;
+    t.n_hits    += matched;
+    t.t_latency += t_latency;
+
+    if (tier == 1 || (matched && p_min >= c->thold)) {
+        return true;
+    }
+
+    t.n_escalated++;
+
+    return false;
+}
+
+
+void stream_cascade_print_stats(const stream_cascade_t *c)
+{
+    static const char *tier_names[2] = { "fast", "main" };
+
+    for (int i = 0; i < 2; i++) {
+        const stream_cascade_tier_t &tier = c->tiers[i];
+        if (!tier.n_runs) {
+            continue;
+        }
+
+        LOG_INFO("inference: %s model %llu runs, %.0f%% matched a command, %llu escalated, latency avg %.1f ms",
+            tier_names[i], (unsigned long long) tier.n_runs, 100.0*tier.n_hits/tier.n_runs,
+            (unsigned long long) tier.n_escalated, tier.t_latency*1e-6/tier.n_runs);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef __STREAM_CASCADE_H__
+#define __STREAM_CASCADE_H__
+
+#include <cstdint>
+
+
+struct stream_cascade_tier_t {
+    uint64_t n_runs      = 0;
+    uint64_t n_hits      = 0;      // the transcript matched a command
+    uint64_t n_escalated = 0;      // handed on to the main model
+    int64_t  t_latency   = 0;      // whisper_full wall time, ns
+};
+
+
+// Fast-model-first cascade (-mf): every utterance is decoded by the fast model,
+// and handed on to the main model unless the transcript matched a command
+// with no text token less likely than thold. Both tiers are one inference.
+struct stream_cascade_t {
+    float thold = 0.5f;
+
+    stream_cascade_tier_t tiers[2];  // [0] fast model, [1] main model
+};
+
+
+void stream_cascade_init(stream_cascade_t *c, float thold);
+
+// accounts one run of a tier (0 - fast, 1 - main), true if its result stands, false to escalate
+bool stream_cascade_done(stream_cascade_t *c, int tier, bool matched, float p_min, int64_t t_latency);
+
+void stream_cascade_print_stats(const stream_cascade_t *c);
+
+#endif //__STREAM_CASCADE_H__
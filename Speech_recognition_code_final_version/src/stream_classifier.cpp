@@ -0,0 +1,281 @@
+#include "stream_classifier.h"
+#include "debug.h"
+#include "json.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+
+// tokens the model rules out are clamped here so they do not dominate the distance
+static const float k_logp_floor = -30.0f;
+
+// the margin never gets tighter than this, however well the enrollment separates
+static const float k_margin_min = 0.02f;
+
+
+
+int stream_classifier_init(stream_classifier_t *c, const std::vector<int32_t> &tokens, const std::string &model)
+{
+    if (!c || tokens.empty()) {
+        LOG_ERR("args fail! c(%p), %zu tokens", c, tokens.size());
+        return -1;
+    }
+
+    c->tokens = tokens;
+    std::sort(c->tokens.begin(), c->tokens.end());
+    c->tokens.erase(std::unique(c->tokens.begin(), c->tokens.end()), c->tokens.end());
+
+    c->classes.clear();
+    c->model = model;
+
+    return 0;
+}
+
+
+int stream_classifier_load(stream_classifier_t *c, const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return -1;
+    }
+
+    const nlohmann::json j = nlohmann::json::parse(file, nullptr, false);
+    if (j.is_discarded() || !j["tokens"].is_array() || !j["classes"].is_array()) {
+        LOG_ERR("%s: not a classifier file", path.c_str());
+        return -1;
+    }
+
+    c->tokens  = j["tokens"].get<std::vector<int32_t>>();
+    c->margin  = j.value("margin", 0.1f);
+    c->model   = j.value("model", "");
+    c->classes.clear();
+
+    for (const auto &jc : j["classes"]) {
+        stream_classifier_class_t cls;
+
+        cls.code     = jc.value("code", "");
+        cls.n        = jc.value("n", 0);
+        cls.centroid = jc.value("centroid", std::vector<float>());
+
+        if (cls.code.empty() || cls.centroid.size() != c->tokens.size()) {
+            LOG_ERR("%s: class '%s' has %zu dimensions, expected %zu",
+                path.c_str(), cls.code.c_str(), cls.centroid.size(), c->tokens.size());
+            return -1;
+        }
+
+        c->classes.push_back(cls);
+    }
+
+    if (c->classes.size() < 2) {
+        LOG_ERR("%s: at least two classes are needed", path.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int stream_classifier_save(const stream_classifier_t *c, const std::string &path)
+{
+    nlohmann::json j;
+
+    j["model"]   = c->model;
+    j["margin"]  = c->margin;
+    j["tokens"]  = c->tokens;
+    j["classes"] = nlohmann::json::array();
+
+    for (const auto &cls : c->classes) {
+        j["classes"].push_back({ { "code", cls.code }, { "n", cls.n }, { "centroid", cls.centroid } });
+    }
+
+    std::ofstream file(path);
+    if (!file) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return -1;
+    }
+
+    file << j.dump() << std::endl;
+
+    return file ? 0 : -1;
+}
+
+
+static void stream_classifier_normalize(float *v, size_t n)
+{
+    float norm = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        norm += v[i]*v[i];
+    }
+
+    if (norm > 0.0f) {
+        norm = 1.0f/std::sqrt(norm);
+        for (size_t i = 0; i < n; i++) {
+            v[i] *= norm;
+        }
+    }
+}
+
+
+static float stream_classifier_dot(const float *a, const float *b, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        sum += a[i]*b[i];
+    }
+    return sum;
+}
+
+
+void stream_classifier_features(const stream_classifier_t *c, const float *logits, int n_vocab, float *out)
+{
+    // log-softmax over the whole vocabulary, whisper has already masked some tokens to -inf
+    float max = -INFINITY;
+    for (int i = 0; i < n_vocab; i++) {
+        max = std::max(max, logits[i]);
+    }
+
+    double sum = 0.0;
+    for (int i = 0; i < n_vocab; i++) {
+        if (logits[i] > -INFINITY) {
+            sum += std::exp(logits[i] - max);
+        }
+    }
+
+    const float lse = max + (float) std::log(sum);
+
+    const size_t n = c->tokens.size();
+
+    float mean = 0.0f;
+    for (size_t i = 0; i < n; i++) {
+        const int32_t token = c->tokens[i];
+
+        out[i] = token < n_vocab && logits[token] > -INFINITY ? std::max(k_logp_floor, logits[token] - lse) : k_logp_floor;
+        mean  += out[i];
+    }
+    mean /= n;
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] -= mean;
+    }
+
+    stream_classifier_normalize(out, n);
+}
+
+
+int stream_classifier_classify(const stream_classifier_t *c, const float *features, float *sim, float *margin)
+{
+    int   best     = -1;
+    float sim_best = -INFINITY;
+    float sim_next = -INFINITY;
+
+    for (size_t i = 0; i < c->classes.size(); i++) {
+        const float s = stream_classifier_dot(features, c->classes[i].centroid.data(), c->tokens.size());
+
+        if (s > sim_best) {
+            sim_next = sim_best;
+            sim_best = s;
+            best     = (int) i;
+        } else if (s > sim_next) {
+            sim_next = s;
+        }
+    }
+
+    *sim    = sim_best;
+    *margin = best >= 0 && sim_next > -INFINITY ? sim_best - sim_next : 0.0f;
+
+    return best;
+}
+
+
+int stream_classifier_enroll(stream_classifier_t *c, const std::string &code, const float *features)
+{
+    auto it = std::find_if(c->classes.begin(), c->classes.end(),
+        [&](const stream_classifier_class_t &cls) { return cls.code == code; });
+
+    if (it == c->classes.end()) {
+        c->classes.emplace_back();
+        it = c->classes.end() - 1;
+        it->code = code;
+    }
+
+    it->samples.emplace_back(features, features + c->tokens.size());
+    it->n++;
+
+    return 0;
+}
+
+
+int stream_classifier_finish(stream_classifier_t *c)
+{
+    const size_t n = c->tokens.size();
+
+    if (c->classes.size() < 2) {
+        LOG_ERR("at least two classes are needed, %zu enrolled", c->classes.size());
+        return -1;
+    }
+
+    std::sort(c->classes.begin(), c->classes.end(),
+        [](const stream_classifier_class_t &a, const stream_classifier_class_t &b) { return a.code < b.code; });
+
+    for (auto &cls : c->classes) {
+        cls.centroid.assign(n, 0.0f);
+        for (const auto &v : cls.samples) {
+            for (size_t i = 0; i < n; i++) {
+                cls.centroid[i] += v[i];
+            }
+        }
+        stream_classifier_normalize(cls.centroid.data(), n);
+    }
+
+    // how far every enrolled utterance leads the closest other class
+    float lead_min = INFINITY;
+    int   n_wrong  = 0;
+
+    for (size_t k = 0; k < c->classes.size(); k++) {
+        const stream_classifier_class_t &cls = c->classes[k];
+
+        float sim_sum  = 0.0f;
+        float lead_cls = INFINITY;
+
+        for (const auto &v : cls.samples) {
+            const float own = stream_classifier_dot(v.data(), cls.centroid.data(), n);
+
+            float other = -INFINITY;
+            for (size_t o = 0; o < c->classes.size(); o++) {
+                if (o != k) {
+                    other = std::max(other, stream_classifier_dot(v.data(), c->classes[o].centroid.data(), n));
+                }
+            }
+
+            sim_sum += own;
+            lead_cls = std::min(lead_cls, own - other);
+
+            if (own - other > 0.0f) {
+                lead_min = std::min(lead_min, own - other);
+            } else {
+                n_wrong++;
+            }
+        }
+
+        LOG_INFO("classifier: %-8s %3d utterances, similarity to centroid avg %.3f, smallest lead %+.3f",
+            cls.code.c_str(), cls.n, sim_sum/cls.n, lead_cls);
+    }
+
+    // half the tightest correct lead: enrolled speech is decided, anything less clear is decoded
+    c->margin = std::max(k_margin_min, std::isfinite(lead_min) ? 0.5f*lead_min : k_margin_min);
+
+    if (n_wrong) {
+        LOG_INFO("classifier: %d enrolled utterances are closer to another class, those commands need the decoder", n_wrong);
+    }
+
+    LOG_INFO("classifier: %zu classes over %zu tokens, margin %.3f", c->classes.size(), n, c->margin);
+
+    for (auto &cls : c->classes) {
+        cls.samples.clear();
+        cls.samples.shrink_to_fit();
+    }
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef __STREAM_CLASSIFIER_H__
+#define __STREAM_CLASSIFIER_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+struct stream_classifier_class_t {
+    std::string        code;           // "none" - speech or noise that is no command
+    std::vector<float> centroid;       // unit length
+    int                n = 0;          // enrolled utterances
+
+    std::vector<std::vector<float>> samples;   // enrollment only
+};
+
+
+// Nearest-centroid command classifier over what the encoder heard. Whisper's
+// public API does not expose the encoder output, so the utterance is
+// represented by the first decoder step instead: the log-probabilities of the
+// command tokens right after the prompt, a fixed readout of the
+// cross-attended encoder states. The vector is centered and normalized and
+// compared by cosine similarity; a class wins when it beats the runner-up by
+// at least margin.
+struct stream_classifier_t {
+    std::vector<int32_t>                   tokens;    // feature vocabulary, ascending
+    std::vector<stream_classifier_class_t> classes;
+    float                                  margin = 0.1f;
+    std::string                            model;     // enrolled with, informational
+};
+
+
+// start an enrollment over these tokens
+int stream_classifier_init(stream_classifier_t *c, const std::vector<int32_t> &tokens, const std::string &model);
+
+int stream_classifier_load(stream_classifier_t *c, const std::string &path);
+
+int stream_classifier_save(const stream_classifier_t *c, const std::string &path);
+
+// features of the first-step logits into out (c->tokens.size() floats), no allocation
+void stream_classifier_features(const stream_classifier_t *c, const float *logits, int n_vocab, float *out);
+
+// best class, -1 if there is none; its similarity and lead over the runner-up
+int stream_classifier_classify(const stream_classifier_t *c, const float *features, float *sim, float *margin);
+
+int stream_classifier_enroll(stream_classifier_t *c, const std::string &code, const float *features);
+
+// centroids from the enrolled samples, margin from how well they separate; prints a report
+int stream_classifier_finish(stream_classifier_t *c);
+
+#endif //__STREAM_CLASSIFIER_H__
@@ -0,0 +1,155 @@
+#include "stream_dedup.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+
+
+// recent commands kept without growing the list, more only overlap in very long windows
+static const size_t k_n_recent = 32;
+
+
+// lowercase letters and digits, any run of other characters becomes one space
+static void stream_dedup_normalize(const char *text, char *out, size_t size)
+{
+    size_t n = 0;
+
+    for (const char *p = text; *p && n + 1 < size; p++) {
+        const unsigned char c = *p;
+        if (isalnum(c)) {
+            out[n++] = tolower(c);
+        } else if (n && out[n - 1] != ' ') {
+            out[n++] = ' ';
+        }
+    }
+
+    if (n && out[n - 1] == ' ') {
+        n--;
+    }
+
+    out[n] = '\0';
+}
+
+
+// row holds strlen(b) + 1 entries
+static size_t stream_dedup_distance(const char *a, size_t na, const char *b, size_t nb, size_t *row)
+{
+    for (size_t j = 0; j <= nb; j++) {
+        row[j] = j;
+    }
+
+    for (size_t i = 1; i <= na; i++) {
+        size_t diag = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= nb; j++) {
+            const size_t up = row[j];
+            row[j] = std::min({ row[j] + 1, row[j - 1] + 1, diag + (a[i - 1] != b[j - 1]) });
+            diag = up;
+        }
+    }
+
+    return row[nb];
+}
+
+
+int stream_dedup_init(stream_dedup_t *d, const stream_dedup_params_t *params)
+{
+    if (!d || !params || params->sample_rate <= 0 || params->sim_thold < 0.0f || params->sim_thold > 1.0f) {
+        LOG_ERR("args fail! d(%p), params(%p)", d, params);
+        return -1;
+    }
+
+    d->params  = *params;
+    d->n_slack = params->sample_rate/1000*std::max(0, params->slack_ms);
+
+    d->recent.clear();
+    d->recent.reserve(k_n_recent);
+    d->row.assign(sizeof(stream_dedup_entry_t::text) + 1, 0);
+    d->n_checked    = 0;
+    d->n_suppressed = 0;
+
+    return 0;
+}
+
+
+float stream_dedup_similarity(const char *a, const char *b)
+{
+    const size_t na = strlen(a);
+    const size_t nb = strlen(b);
+
+    const size_t n = std::max(na, nb);
+    if (!n) {
+        return 1.0f;
+    }
+
+    std::vector<size_t> row(nb + 1);
+
+    return 1.0f - (float) stream_dedup_distance(a, na, b, nb, row.data())/n;
+}
+
+
+bool stream_dedup_check(stream_dedup_t *d, uint64_t pos0, uint64_t pos1, const char *code, const char *text)
+{
+    stream_dedup_entry_t entry;
+    entry.pos0 = pos0;
+    entry.pos1 = std::max(pos0, pos1);
+    snprintf(entry.code, sizeof(entry.code), "%s", code ? code : "");
+    stream_dedup_normalize(text ? text : "", entry.text, sizeof(entry.text));
+
+    const size_t n_text = strlen(entry.text);
+
+    d->n_checked++;
+
+    for (auto &prev : d->recent) {
+        const bool overlap = entry.pos0 < prev.pos1 + d->n_slack && prev.pos0 < entry.pos1 + d->n_slack;
+        if (!overlap) {
+            continue;
+        }
+
+        // both texts fit the row, it is sized for the longest entry
+        const size_t n_prev = strlen(prev.text);
+        const size_t n      = std::max(n_text, n_prev);
+        const float  sim    = n ? 1.0f - (float) stream_dedup_distance(entry.text, n_text, prev.text, n_prev, d->row.data())/n : 1.0f;
+
+        if (strcmp(entry.code, prev.code) && sim < d->params.sim_thold) {
+            continue;
+        }
+
+        LOG_DBG("duplicate '%s' (%s) at %.2f - %.2f s, dispatched as '%s' at %.2f - %.2f s, similarity %.2f",
+            entry.text, entry.code,
+            (double) entry.pos0/d->params.sample_rate, (double) entry.pos1/d->params.sample_rate,
+            prev.text, (double) prev.pos0/d->params.sample_rate, (double) prev.pos1/d->params.sample_rate, sim);
+
+        // the same words keep moving with the window, follow them
+        prev.pos0 = std::min(prev.pos0, entry.pos0);
+        prev.pos1 = std::max(prev.pos1, entry.pos1);
+
+        d->n_suppressed++;
+        return true;
+    }
+
+    d->recent.push_back(entry);
+
+    return false;
+}
+
+
+bool stream_dedup_seen(const stream_dedup_t *d, uint64_t pos0, uint64_t pos1, const char *code)
+{
+    for (const auto &prev : d->recent) {
+        if (pos0 < prev.pos1 + d->n_slack && prev.pos0 < pos1 + d->n_slack && !strcmp(prev.code, code ? code : "")) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void stream_dedup_release(stream_dedup_t *d, uint64_t pos)
+{
+    d->recent.erase(std::remove_if(d->recent.begin(), d->recent.end(),
+        [&](const stream_dedup_entry_t &e) { return e.pos1 + d->n_slack <= pos; }), d->recent.end());
+}
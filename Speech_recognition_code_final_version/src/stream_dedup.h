@@ -0,0 +1,54 @@
+#ifndef __STREAM_DEDUP_H__
+#define __STREAM_DEDUP_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+struct stream_dedup_params_t {
+    int   sample_rate = 16000;
+    int   slack_ms    = 300;       // spans this close still overlap, token timestamps are coarse
+    float sim_thold   = 0.6f;      // transcripts at least this similar are the same words
+};
+
+
+struct stream_dedup_entry_t {
+    uint64_t    pos0 = 0;          // absolute sample span of the spoken command
+    uint64_t    pos1 = 0;
+    char        code[16];
+    char        text[128];         // normalized and truncated, see stream_dedup_check()
+};
+
+
+// Identity of spoken commands across overlapping sliding windows: a command
+// whose sample span overlaps one that was already dispatched, and that has
+// the same code or a similar transcript, is the same utterance heard again.
+struct stream_dedup_t {
+    stream_dedup_params_t params;
+
+    int n_slack = 0;               // samples
+
+    std::vector<stream_dedup_entry_t> recent;   // dispatched commands that may still overlap
+    std::vector<size_t>               row;      // edit distance scratch, sized once
+
+    uint64_t n_checked    = 0;
+    uint64_t n_suppressed = 0;
+};
+
+
+int stream_dedup_init(stream_dedup_t *d, const stream_dedup_params_t *params);
+
+// true if the command heard in [pos0, pos1) was already dispatched, otherwise it is remembered
+bool stream_dedup_check(stream_dedup_t *d, uint64_t pos0, uint64_t pos1, const char *code, const char *text);
+
+// true if a command with this code overlapping [pos0, pos1) was dispatched, remembers nothing
+bool stream_dedup_seen(const stream_dedup_t *d, uint64_t pos0, uint64_t pos1, const char *code);
+
+// forget commands that cannot overlap audio from pos on
+void stream_dedup_release(stream_dedup_t *d, uint64_t pos);
+
+// normalized edit distance similarity of two transcripts, 1 - identical
+float stream_dedup_similarity(const char *a, const char *b);
+
+#endif //__STREAM_DEDUP_H__
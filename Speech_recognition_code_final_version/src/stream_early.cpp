@@ -0,0 +1,88 @@
+#include "stream_early.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+
+// longest partial transcript without growing the scratch
+static const size_t k_partial_size = 256;
+
+
+
+static int stream_early_alias_add(const char *text, const char *code, void *userdata)
+{
+    auto *aliases = (std::vector<std::pair<std::string, std::string>> *)userdata;
+
+    aliases->emplace_back(text, code);
+
+    return 0;
+}
+
+
+int stream_early_init(stream_early_t *e, whisper_fuzzy_t *fuzzy, bool abort)
+{
+    if (!e || !fuzzy) {
+        LOG_ERR("args fail! e(%p), fuzzy(%p)", e, fuzzy);
+        return -1;
+    }
+
+    e->aliases.clear();
+    if (whisper_fuzzy_foreach_alias(fuzzy, stream_early_alias_add, &e->aliases) < 0) {
+        return -1;
+    }
+    std::sort(e->aliases.begin(), e->aliases.end());
+
+    e->abort = abort;
+
+    e->partial.reserve(k_partial_size);
+    e->key.reserve(k_partial_size);
+
+    return 0;
+}
+
+
+const char *stream_early_code(stream_early_t *e, whisper_fuzzy_t *fuzzy, const std::string &text)
+{
+    const char *code = whisper_fuzzy_lookup(fuzzy, text.c_str());
+    if (!code) {
+        return nullptr;
+    }
+
+    // the aliases are keyed like whisper_fuzzy_lookup() does: trimmed and lowercased
+    const size_t first = text.find_first_not_of(" \t\n\r\f\v");
+    const size_t last  = text.find_last_not_of(" \t\n\r\f\v");
+    if (first == std::string::npos) {
+        return nullptr;
+    }
+
+    std::string &key = e->key;
+    key.assign(text, first, last - first + 1);
+    for (char &c : key) {
+        c = tolower((unsigned char) c);
+    }
+
+    auto it = std::lower_bound(e->aliases.begin(), e->aliases.end(), key,
+        [](const std::pair<std::string, std::string> &alias, const std::string &k) { return alias.first < k; });
+    for (; it != e->aliases.end() && !it->first.compare(0, key.size(), key); ++it) {
+        if (it->second != code) {
+            return nullptr;
+        }
+    }
+
+    return code;
+}
+
+
+void stream_early_print_stats(const stream_early_t *e)
+{
+    LOG_INFO("dispatch:  %llu commands fired early, %llu confirmed, avg %.1f ms before the decode finished",
+        (unsigned long long) e->n_fired, (unsigned long long) e->n_confirmed,
+        e->n_confirmed ? e->t_saved*1e-6/e->n_confirmed : 0.0);
+
+    if (e->abort) {
+        LOG_INFO("dispatch:  %llu decodes aborted once their command fired",
+            (unsigned long long) e->n_aborted);
+    }
+}
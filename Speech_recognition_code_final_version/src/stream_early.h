@@ -0,0 +1,41 @@
+#ifndef __STREAM_EARLY_H__
+#define __STREAM_EARLY_H__
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "whisper_fuzzy.h"
+
+
+// Early firing (-ef): a command is dispatched from the partial transcript of
+// a running decode once the text is an alias and no longer alias of another
+// code starts with it ("stand" vs "stand up"). The final transcript then only
+// confirms it. With abort set nothing reads the rest of the decode, so it is
+// aborted as soon as the command fired.
+struct stream_early_t {
+    std::vector<std::pair<std::string, std::string>> aliases;   // every alias with its code, sorted
+
+    bool abort = false;
+
+    // scratch of the running decode, sized once
+    std::string partial;
+    std::string key;
+
+    // stats
+    uint64_t n_fired     = 0;
+    uint64_t n_confirmed = 0;     // the final transcript is the same command
+    uint64_t n_aborted   = 0;     // decodes aborted after their command fired
+    int64_t  t_saved     = 0;     // ns, early dispatch to the end of the decode, confirmed ones
+};
+
+
+int stream_early_init(stream_early_t *e, whisper_fuzzy_t *fuzzy, bool abort);
+
+// the code of text when it can fire now, nullptr otherwise; no allocation
+const char *stream_early_code(stream_early_t *e, whisper_fuzzy_t *fuzzy, const std::string &text);
+
+void stream_early_print_stats(const stream_early_t *e);
+
+#endif //__STREAM_EARLY_H__
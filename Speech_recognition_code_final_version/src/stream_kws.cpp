@@ -0,0 +1,383 @@
+#include "stream_kws.h"
+#include "debug.h"
+#include "json.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+
+// the enrolled threshold stays this far below the closest confusion seen
+static const float k_thold_scale = 0.9f;
+
+// utterances whose lengths differ more than this cannot be aligned in the band
+static const int k_len_ratio = 2;
+
+
+
+int stream_kws_load(stream_kws_t *k, const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return -1;
+    }
+
+    const nlohmann::json j = nlohmann::json::parse(file, nullptr, false);
+    if (j.is_discarded() || !j["classes"].is_array()) {
+        LOG_ERR("%s: not a keyword template file", path.c_str());
+        return -1;
+    }
+
+    k->n_ceps = j.value("n_ceps", 13);
+    k->hop_ms = j.value("hop_ms", 10);
+    k->thold  = j.value("thold", 0.0f);
+    k->ratio  = j.value("ratio", 1.2f);
+    k->classes.clear();
+
+    for (const auto &jc : j["classes"]) {
+        stream_kws_class_t cls;
+        cls.code = jc.value("code", "");
+
+        for (const auto &jt : jc.value("templates", nlohmann::json::array())) {
+            stream_kws_template_t t;
+
+            t.file   = jt.value("file", "");
+            t.n      = jt.value("n", 0);
+            t.frames = jt.value("frames", std::vector<float>());
+
+            if (t.n <= 0 || t.frames.size() != (size_t) t.n*k->n_ceps) {
+                LOG_ERR("%s: template of '%s' has %zu values for %d frames", path.c_str(), cls.code.c_str(), t.frames.size(), t.n);
+                return -1;
+            }
+
+            cls.templates.push_back(std::move(t));
+        }
+
+        if (cls.code.empty() || cls.templates.empty()) {
+            LOG_ERR("%s: class '%s' has no templates", path.c_str(), cls.code.c_str());
+            return -1;
+        }
+
+        k->classes.push_back(std::move(cls));
+    }
+
+    if (k->classes.size() < 2 || k->thold <= 0.0f) {
+        LOG_ERR("%s: at least two classes and a threshold are needed", path.c_str());
+        return -1;
+    }
+
+    stream_kws_prepare(k);
+
+    return 0;
+}
+
+
+int stream_kws_save(const stream_kws_t *k, const std::string &path)
+{
+    nlohmann::json j;
+
+    j["n_ceps"]  = k->n_ceps;
+    j["hop_ms"]  = k->hop_ms;
+    j["thold"]   = k->thold;
+    j["ratio"]   = k->ratio;
+    j["classes"] = nlohmann::json::array();
+
+    for (const auto &cls : k->classes) {
+        nlohmann::json jt = nlohmann::json::array();
+        for (const auto &t : cls.templates) {
+            jt.push_back({ { "file", t.file }, { "n", t.n }, { "frames", t.frames } });
+        }
+        j["classes"].push_back({ { "code", cls.code }, { "templates", jt } });
+    }
+
+    std::ofstream file(path);
+    if (!file) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return -1;
+    }
+
+    file << j.dump() << std::endl;
+
+    return file ? 0 : -1;
+}
+
+
+void stream_kws_prepare(stream_kws_t *k)
+{
+    int n_max = 0;
+    for (const auto &cls : k->classes) {
+        for (const auto &t : cls.templates) {
+            n_max = std::max(n_max, t.n);
+        }
+    }
+
+    k->row_prev.resize(n_max + 1);
+    k->row_cur.resize(n_max + 1);
+    k->dist.resize(k->classes.size());
+}
+
+
+void stream_kws_normalize(float *frames, int n, int n_ceps)
+{
+    if (n <= 0) {
+        return;
+    }
+
+    for (int c = 0; c < n_ceps; c++) {
+        float mean = 0.0f;
+        for (int i = 0; i < n; i++) {
+            mean += frames[i*n_ceps + c];
+        }
+        mean /= n;
+
+        for (int i = 0; i < n; i++) {
+            frames[i*n_ceps + c] -= mean;
+        }
+    }
+}
+
+
+static float stream_kws_cost(const float *a, const float *b, int n_ceps)
+{
+    float sum = 0.0f;
+    for (int c = 0; c < n_ceps; c++) {
+        const float d = a[c] - b[c];
+        sum += d*d;
+    }
+    return std::sqrt(sum);
+}
+
+
+// distance over n + m, INFINITY as soon as a whole row is at or past limit
+static float stream_kws_dtw(stream_kws_t *k, const float *a, int n, const float *b, int m, float limit, uint64_t *n_cells)
+{
+    const int n_ceps = k->n_ceps;
+    const int band   = std::max(2, std::max(n, m)/4);
+
+    const float limit_sum = limit*(n + m);
+
+    float *prev = k->row_prev.data();
+    float *cur  = k->row_cur.data();
+
+    std::fill(prev, prev + m + 1, INFINITY);
+    prev[0] = 0.0f;
+
+    for (int i = 1; i <= n; i++) {
+        const int center = (int) ((int64_t) i*m/n);
+        const int j0     = std::max(1, center - band);
+        const int j1     = std::min(m, center + band);
+
+        std::fill(cur, cur + m + 1, INFINITY);
+
+        const float *ai = a + (size_t) (i - 1)*n_ceps;
+
+        float row_min = INFINITY;
+        for (int j = j0; j <= j1; j++) {
+            const float cost = stream_kws_cost(ai, b + (size_t) (j - 1)*n_ceps, n_ceps);
+
+            const float v = std::min(std::min(prev[j] + cost, cur[j - 1] + cost), prev[j - 1] + 2.0f*cost);
+
+            cur[j]  = v;
+            row_min = std::min(row_min, v);
+        }
+
+        *n_cells += j1 - j0 + 1;
+
+        // every path to the end goes through this row, and no step costs less than nothing
+        if (row_min >= limit_sum) {
+            return INFINITY;
+        }
+
+        std::swap(prev, cur);
+    }
+
+    return prev[m]/(n + m);
+}
+
+
+static bool stream_kws_alignable(int n, int m)
+{
+    return k_len_ratio*std::min(n, m) >= std::max(n, m);
+}
+
+
+// closest and next closest class in k->dist
+static void stream_kws_rank(const stream_kws_t *k, int *best, float *next)
+{
+    *best = -1;
+    *next = INFINITY;
+
+    float d_best = INFINITY;
+    for (size_t c = 0; c < k->dist.size(); c++) {
+        if (k->dist[c] < d_best) {
+            *next  = d_best;
+            d_best = k->dist[c];
+            *best  = (int) c;
+        } else if (k->dist[c] < *next) {
+            *next = k->dist[c];
+        }
+    }
+}
+
+
+void stream_kws_match(stream_kws_t *k, const float *frames, int n, stream_kws_result_t *r)
+{
+    *r = stream_kws_result_t();
+
+    std::fill(k->dist.begin(), k->dist.end(), INFINITY);
+
+    // past this nothing is decided, however far the others are
+    const float cap = k->thold*k->ratio;
+
+    int   best = -1;
+    float next = INFINITY;
+
+    for (size_t c = 0; c < k->classes.size(); c++) {
+        for (const auto &t : k->classes[c].templates) {
+            if (!stream_kws_alignable(n, t.n)) {
+                continue;
+            }
+
+            r->n_templates++;
+
+            // the closest class only gets closer; any other one must at least take second place
+            float limit = (int) c == best ? k->dist[c] : std::min(k->dist[c], next);
+            limit = std::min(limit, cap);
+
+            const float d = stream_kws_dtw(k, frames, n, t.frames.data(), t.n, limit, &r->n_cells);
+            if (!std::isfinite(d)) {
+                r->n_abandoned++;
+                continue;
+            }
+
+            if (d < k->dist[c]) {
+                k->dist[c] = d;
+                stream_kws_rank(k, &best, &next);
+            }
+        }
+    }
+
+    if (best < 0) {
+        return;
+    }
+
+    r->cls   = best;
+    r->dist  = k->dist[best];
+    r->ratio = r->dist > 0.0f ? std::min(next, cap)/r->dist : INFINITY;
+    r->hit   = r->dist <= k->thold && r->ratio >= k->ratio;
+}
+
+
+int stream_kws_enroll(stream_kws_t *k, const std::string &code, const std::string &file, const float *frames, int n)
+{
+    if (n <= 0) {
+        return -1;
+    }
+
+    auto it = std::find_if(k->classes.begin(), k->classes.end(),
+        [&](const stream_kws_class_t &cls) { return cls.code == code; });
+
+    if (it == k->classes.end()) {
+        k->classes.emplace_back();
+        it = k->classes.end() - 1;
+        it->code = code;
+    }
+
+    stream_kws_template_t t;
+    t.file = file;
+    t.n    = n;
+    t.frames.assign(frames, frames + (size_t) n*k->n_ceps);
+
+    it->templates.push_back(std::move(t));
+
+    return 0;
+}
+
+
+int stream_kws_finish(stream_kws_t *k)
+{
+    if (k->classes.size() < 2) {
+        LOG_ERR("at least two classes are needed, %zu enrolled", k->classes.size());
+        return -1;
+    }
+
+    std::sort(k->classes.begin(), k->classes.end(),
+        [](const stream_kws_class_t &a, const stream_kws_class_t &b) { return a.code < b.code; });
+
+    stream_kws_prepare(k);
+
+    // every template against all the others, exact distances
+    struct loo_t { float own; float other; };
+    std::vector<std::vector<loo_t>> loo(k->classes.size());
+
+    float other_min = INFINITY;
+
+    for (size_t c = 0; c < k->classes.size(); c++) {
+        const auto &templates = k->classes[c].templates;
+
+        for (size_t t = 0; t < templates.size(); t++) {
+            loo_t l = { INFINITY, INFINITY };
+            uint64_t n_cells = 0;
+
+            for (size_t o = 0; o < k->classes.size(); o++) {
+                for (size_t u = 0; u < k->classes[o].templates.size(); u++) {
+                    const stream_kws_template_t &a = templates[t];
+                    const stream_kws_template_t &b = k->classes[o].templates[u];
+
+                    if ((o == c && u == t) || !stream_kws_alignable(a.n, b.n)) {
+                        continue;
+                    }
+
+                    const float d = stream_kws_dtw(k, a.frames.data(), a.n, b.frames.data(), b.n, INFINITY, &n_cells);
+                    if (o == c) {
+                        l.own = std::min(l.own, d);
+                    } else {
+                        l.other = std::min(l.other, d);
+                    }
+                }
+            }
+
+            other_min = std::min(other_min, l.other);
+            loo[c].push_back(l);
+        }
+    }
+
+    if (!std::isfinite(other_min)) {
+        LOG_ERR("no two classes could be aligned, the recordings are too different in length");
+        return -1;
+    }
+
+    k->thold = k_thold_scale*other_min;
+
+    int n_total   = 0;
+    int n_decided = 0;
+
+    for (size_t c = 0; c < k->classes.size(); c++) {
+        int   n_hit   = 0;
+        int   n_own   = 0;
+        float own_sum = 0.0f;
+        float other   = INFINITY;
+
+        for (const loo_t &l : loo[c]) {
+            if (std::isfinite(l.own)) {
+                own_sum += l.own;
+                n_own++;
+            }
+            other  = std::min(other, l.other);
+            n_hit += l.own <= k->thold && l.other >= k->ratio*l.own;
+        }
+
+        LOG_INFO("kws: %-8s %3zu templates, closest own avg %.3f, closest other %.3f, %d decided",
+            k->classes[c].code.c_str(), loo[c].size(), n_own ? own_sum/n_own : 0.0f, other, n_hit);
+
+        n_total   += (int) loo[c].size();
+        n_decided += n_hit;
+    }
+
+    LOG_INFO("kws: %zu classes, %d templates, thold %.3f, ratio %.2f; left out in turn, %d of them are decided without the decoder",
+        k->classes.size(), n_total, k->thold, k->ratio, n_decided);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef __STREAM_KWS_H__
+#define __STREAM_KWS_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+struct stream_kws_template_t {
+    std::string        file;           // enrolled from, informational
+    int                n = 0;          // frames
+    std::vector<float> frames;         // n x n_ceps, mean removed
+};
+
+
+struct stream_kws_class_t {
+    std::string                        code;       // "none" - speech or noise that is no command
+    std::vector<stream_kws_template_t> templates;
+};
+
+
+// Keyword spotting by template matching: the MFCC frames of an utterance's
+// speech are compared with every enrolled template by DTW (symmetric steps,
+// a band around the diagonal, distance over n + m). A template is abandoned
+// as soon as a row shows it cannot change the outcome any more. A class is a
+// hit when its closest template is under thold and the next class is at
+// least ratio times as far.
+struct stream_kws_t {
+    int   n_ceps = 13;
+    int   hop_ms = 10;
+    float thold  = 0.0f;
+    float ratio  = 1.2f;
+
+    std::vector<stream_kws_class_t> classes;
+
+    // scratch, sized for the longest template by stream_kws_prepare()
+    std::vector<float> row_prev;
+    std::vector<float> row_cur;
+    std::vector<float> dist;           // per class
+};
+
+
+struct stream_kws_result_t {
+    int      cls     = -1;             // closest class, -1 - none within reach
+    float    dist    = 0.0f;           // its distance
+    float    ratio   = 0.0f;           // next class distance over dist, capped
+    bool     hit     = false;
+    uint64_t n_cells = 0;              // DTW cells computed
+    int      n_templates = 0;          // templates compared, the others differ too much in length
+    int      n_abandoned = 0;          // of those, given up early
+};
+
+
+int stream_kws_load(stream_kws_t *k, const std::string &path);
+
+int stream_kws_save(const stream_kws_t *k, const std::string &path);
+
+// scratch for matching, call once the templates are in place
+void stream_kws_prepare(stream_kws_t *k);
+
+// subtract the mean of every coefficient over the n frames
+void stream_kws_normalize(float *frames, int n, int n_ceps);
+
+// the n mean-removed frames against every template, no allocation
+void stream_kws_match(stream_kws_t *k, const float *frames, int n, stream_kws_result_t *r);
+
+int stream_kws_enroll(stream_kws_t *k, const std::string &code, const std::string &file, const float *frames, int n);
+
+// leave-one-out over the enrolled templates: thold from the closest confusion, prints a report
+int stream_kws_finish(stream_kws_t *k);
+
+#endif //__STREAM_KWS_H__
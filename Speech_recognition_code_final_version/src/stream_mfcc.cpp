@@ -0,0 +1,272 @@
+#include "stream_mfcc.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+
+// log of the mel energies never goes below this
+static const float k_mel_floor = 1e-10f;
+
+
+
+static float stream_mfcc_hz_to_mel(float hz)
+{
+    return 2595.0f*std::log10(1.0f + hz/700.0f);
+}
+
+
+static float stream_mfcc_mel_to_hz(float mel)
+{
+    return 700.0f*(std::pow(10.0f, mel/2595.0f) - 1.0f);
+}
+
+
+int stream_mfcc_init(stream_mfcc_t *m, const stream_mfcc_params_t *params)
+{
+    if (!m || !params) {
+        LOG_ERR("args fail! m(%p), params(%p)", m, params);
+        return -1;
+    }
+
+    if (params->sample_rate <= 0 || params->hop_ms <= 0 || params->win_ms < params->hop_ms ||
+        params->n_ceps <= 0 || params->n_mels < params->n_ceps || params->f_max <= params->f_min) {
+        LOG_ERR("bad mfcc params: window %d ms, hop %d ms, %d mels, %d ceps",
+            params->win_ms, params->hop_ms, params->n_mels, params->n_ceps);
+        return -1;
+    }
+
+    m->params = *params;
+
+    m->n_win = params->sample_rate*params->win_ms/1000;
+    m->n_hop = params->sample_rate*params->hop_ms/1000;
+
+    m->n_fft = 1;
+    while (m->n_fft < m->n_win) {
+        m->n_fft *= 2;
+    }
+    m->n_bins = m->n_fft/2 + 1;
+
+    m->window.resize(m->n_win);
+    for (int i = 0; i < m->n_win; i++) {
+        m->window[i] = 0.54f - 0.46f*std::cos(2.0f*(float) M_PI*i/(m->n_win - 1));
+    }
+
+    // triangles evenly spaced on the mel scale, clamped to Nyquist
+    const float f_max   = std::min(params->f_max, 0.5f*params->sample_rate);
+    const float mel_min = stream_mfcc_hz_to_mel(params->f_min);
+    const float mel_max = stream_mfcc_hz_to_mel(f_max);
+
+    std::vector<float> bin_hz(params->n_mels + 2);
+    for (int i = 0; i < params->n_mels + 2; i++) {
+        bin_hz[i] = stream_mfcc_mel_to_hz(mel_min + (mel_max - mel_min)*i/(params->n_mels + 1));
+    }
+
+    const float hz_per_bin = (float) params->sample_rate/m->n_fft;
+
+    m->mel_lo.resize(params->n_mels);
+    m->mel_hi.resize(params->n_mels);
+    m->mel_w.assign((size_t) params->n_mels*m->n_bins, 0.0f);
+
+    for (int j = 0; j < params->n_mels; j++) {
+        const float lo = bin_hz[j];
+        const float mid = bin_hz[j + 1];
+        const float hi = bin_hz[j + 2];
+
+        m->mel_lo[j] = std::min(m->n_bins, (int) std::ceil(lo/hz_per_bin));
+        m->mel_hi[j] = std::max(m->mel_lo[j], std::min(m->n_bins, (int) std::floor(hi/hz_per_bin) + 1));
+
+        for (int b = m->mel_lo[j]; b < m->mel_hi[j]; b++) {
+            const float f = b*hz_per_bin;
+            const float w = f <= mid ? (f - lo)/(mid - lo) : (hi - f)/(hi - mid);
+
+            m->mel_w[(size_t) j*m->n_bins + (b - m->mel_lo[j])] = std::max(0.0f, w);
+        }
+    }
+
+    m->dct.resize((size_t) params->n_ceps*params->n_mels);
+    for (int i = 0; i < params->n_ceps; i++) {
+        const float scale = std::sqrt((i == 0 ? 1.0f : 2.0f)/params->n_mels);
+        for (int j = 0; j < params->n_mels; j++) {
+            m->dct[(size_t) i*params->n_mels + j] = scale*std::cos((float) M_PI*i*(j + 0.5f)/params->n_mels);
+        }
+    }
+
+    m->fft_cos.resize(m->n_fft/2);
+    m->fft_sin.resize(m->n_fft/2);
+    for (int i = 0; i < m->n_fft/2; i++) {
+        m->fft_cos[i] = std::cos(2.0f*(float) M_PI*i/m->n_fft);
+        m->fft_sin[i] = -std::sin(2.0f*(float) M_PI*i/m->n_fft);
+    }
+
+    int n_bits = 0;
+    while ((1 << n_bits) < m->n_fft) {
+        n_bits++;
+    }
+
+    m->fft_rev.resize(m->n_fft);
+    for (int i = 0; i < m->n_fft; i++) {
+        int r = 0;
+        for (int b = 0; b < n_bits; b++) {
+            r |= ((i >> b) & 1) << (n_bits - 1 - b);
+        }
+        m->fft_rev[i] = r;
+    }
+
+    m->re.resize(m->n_fft);
+    m->im.resize(m->n_fft);
+    m->power.resize(m->n_bins);
+    m->logmel.resize(params->n_mels);
+    m->history.resize(m->n_win);
+
+    m->n_cap = std::max(1, params->max_ms/params->hop_ms);
+    m->frames.assign((size_t) m->n_cap*params->n_ceps, 0.0f);
+
+    stream_mfcc_reset(m);
+
+    return 0;
+}
+
+
+void stream_mfcc_reset(stream_mfcc_t *m)
+{
+    m->n_history = 0;
+    m->n_until   = m->n_win;
+    m->x_prev    = 0.0f;
+    m->n_samples = 0;
+    m->n_frames  = 0;
+}
+
+
+// in place radix-2 FFT of re + i*im
+static void stream_mfcc_fft(stream_mfcc_t *m)
+{
+    float *re = m->re.data();
+    float *im = m->im.data();
+
+    const int n = m->n_fft;
+
+    for (int i = 0; i < n; i++) {
+        const int j = m->fft_rev[i];
+        if (j > i) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (int len = 2; len <= n; len *= 2) {
+        const int half   = len/2;
+        const int stride = n/len;
+
+        for (int i = 0; i < n; i += len) {
+            for (int k = 0; k < half; k++) {
+                const float wr = m->fft_cos[k*stride];
+                const float wi = m->fft_sin[k*stride];
+
+                const float xr = re[i + k + half]*wr - im[i + k + half]*wi;
+                const float xi = re[i + k + half]*wi + im[i + k + half]*wr;
+
+                re[i + k + half] = re[i + k] - xr;
+                im[i + k + half] = im[i + k] - xi;
+                re[i + k]       += xr;
+                im[i + k]       += xi;
+            }
+        }
+    }
+}
+
+
+// the frame in history, into the next slot of the ring
+static void stream_mfcc_frame(stream_mfcc_t *m)
+{
+    const int n_mels = m->params.n_mels;
+    const int n_ceps = m->params.n_ceps;
+
+    for (int i = 0; i < m->n_win; i++) {
+        m->re[i] = m->history[i]*m->window[i];
+    }
+    std::fill(m->re.begin() + m->n_win, m->re.end(), 0.0f);
+    std::fill(m->im.begin(), m->im.end(), 0.0f);
+
+    stream_mfcc_fft(m);
+
+    for (int b = 0; b < m->n_bins; b++) {
+        m->power[b] = m->re[b]*m->re[b] + m->im[b]*m->im[b];
+    }
+
+    for (int j = 0; j < n_mels; j++) {
+        const float *w = &m->mel_w[(size_t) j*m->n_bins];
+
+        float sum = 0.0f;
+        for (int b = m->mel_lo[j]; b < m->mel_hi[j]; b++) {
+            sum += w[b - m->mel_lo[j]]*m->power[b];
+        }
+        m->logmel[j] = std::log(std::max(sum, k_mel_floor));
+    }
+
+    float *out = &m->frames[(size_t) (m->n_frames % m->n_cap)*n_ceps];
+
+    for (int i = 0; i < n_ceps; i++) {
+        const float *d = &m->dct[(size_t) i*n_mels];
+
+        float sum = 0.0f;
+        for (int j = 0; j < n_mels; j++) {
+            sum += d[j]*m->logmel[j];
+        }
+        out[i] = sum;
+    }
+
+    m->n_frames++;
+}
+
+
+void stream_mfcc_feed(stream_mfcc_t *m, const float *x, size_t n)
+{
+    const float preemph = m->params.preemph;
+
+    for (size_t i = 0; i < n; i++) {
+        m->history[m->n_history++] = x[i] - preemph*m->x_prev;
+        m->x_prev = x[i];
+
+        if (--m->n_until > 0) {
+            continue;
+        }
+
+        stream_mfcc_frame(m);
+
+        // the next frame starts one hop later
+        std::memmove(m->history.data(), m->history.data() + m->n_hop, (m->n_win - m->n_hop)*sizeof(float));
+        m->n_history = m->n_win - m->n_hop;
+        m->n_until   = m->n_hop;
+    }
+
+    m->n_samples += n;
+}
+
+
+void stream_mfcc_span(const stream_mfcc_t *m, uint64_t pos0, uint64_t pos1, uint64_t *k0, uint64_t *k1)
+{
+    const uint64_t k_oldest = m->n_frames > (uint64_t) m->n_cap ? m->n_frames - m->n_cap : 0;
+
+    uint64_t first = (pos0 + m->n_hop - 1)/m->n_hop;
+    uint64_t last  = pos1 >= (uint64_t) m->n_win ? (pos1 - m->n_win)/m->n_hop + 1 : 0;
+
+    first = std::max(first, k_oldest);
+    last  = std::min(last, m->n_frames);
+
+    *k0 = first;
+    *k1 = std::max(first, last);
+}
+
+
+void stream_mfcc_copy(const stream_mfcc_t *m, uint64_t k0, uint64_t k1, float *out)
+{
+    const int n_ceps = m->params.n_ceps;
+
+    for (uint64_t k = k0; k < k1; k++) {
+        memcpy(out, &m->frames[(size_t) (k % m->n_cap)*n_ceps], n_ceps*sizeof(float));
+        out += n_ceps;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef __STREAM_MFCC_H__
+#define __STREAM_MFCC_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+struct stream_mfcc_params_t {
+    int   sample_rate = 16000;
+    int   win_ms      = 25;
+    int   hop_ms      = 10;
+    int   n_mels      = 26;
+    int   n_ceps      = 13;        // c0 included
+    float f_min       = 60.0f;
+    float f_max       = 7600.0f;
+    float preemph     = 0.97f;
+    int   max_ms      = 5000;      // audio the frame history covers
+};
+
+
+// Incremental MFCC over a continuous stream: samples go in as they arrive,
+// frame k covers samples [k*n_hop, k*n_hop + n_win) counted from the first
+// one fed, and the last max_ms of frames are kept. Pre-emphasis, Hamming
+// window, 512-point FFT power spectrum, triangular mel filters, log, DCT-II.
+// Everything is allocated by stream_mfcc_init().
+struct stream_mfcc_t {
+    stream_mfcc_params_t params;
+
+    int n_win  = 0;                // samples per frame
+    int n_hop  = 0;
+    int n_fft  = 0;
+    int n_bins = 0;                // n_fft/2 + 1
+
+    std::vector<float> window;
+    std::vector<int>   mel_lo;     // per filter first bin
+    std::vector<int>   mel_hi;     // per filter one past the last bin
+    std::vector<float> mel_w;      // per filter weights from mel_lo, n_bins apart
+    std::vector<float> dct;        // n_ceps x n_mels
+    std::vector<float> fft_cos;
+    std::vector<float> fft_sin;
+    std::vector<int>   fft_rev;
+
+    // scratch
+    std::vector<float> re;
+    std::vector<float> im;
+    std::vector<float> power;
+    std::vector<float> logmel;
+
+    std::vector<float> history;    // the last n_win samples, pre-emphasized
+    int      n_history = 0;        // samples in history, up to n_win
+    int      n_until   = 0;        // samples until the next frame is complete
+    float    x_prev    = 0.0f;     // last raw sample, for the pre-emphasis
+    uint64_t n_samples = 0;        // fed so far
+
+    std::vector<float> frames;     // ring of n_cap frames x n_ceps
+    int      n_cap    = 0;
+    uint64_t n_frames = 0;         // produced so far
+};
+
+
+int stream_mfcc_init(stream_mfcc_t *m, const stream_mfcc_params_t *params);
+
+void stream_mfcc_reset(stream_mfcc_t *m);
+
+// append samples; complete frames are computed right away, no allocation
+void stream_mfcc_feed(stream_mfcc_t *m, const float *x, size_t n);
+
+// frames lying entirely inside the samples [pos0, pos1) that are still kept: [*k0, *k1)
+void stream_mfcc_span(const stream_mfcc_t *m, uint64_t pos0, uint64_t pos1, uint64_t *k0, uint64_t *k1);
+
+// copy frames [k0, k1) into out, (k1 - k0)*n_ceps floats; the frames must still be kept
+void stream_mfcc_copy(const stream_mfcc_t *m, uint64_t k0, uint64_t k1, float *out);
+
+#endif //__STREAM_MFCC_H__
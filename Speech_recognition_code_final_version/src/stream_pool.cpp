@@ -0,0 +1,158 @@
+#include "stream_pool.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <chrono>
+
+
+
+static int64_t stream_pool_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+int stream_pool_init(stream_pool_t *p, int n_streams, int n_threads, int n_parallel)
+{
+    if (!p || n_streams <= 0 || n_threads <= 0) {
+        LOG_ERR("args fail! p(%p), n_streams(%d), n_threads(%d)", p, n_streams, n_threads);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(p->mutex);
+
+    p->n_threads  = n_threads;
+    p->n_parallel = std::min(n_parallel > 0 ? n_parallel : n_streams, n_threads);
+
+    p->n_running      = 0;
+    p->n_threads_used = 0;
+    p->n_running_max  = 0;
+    p->t_busy_any     = 0;
+    p->t_start        = stream_pool_now();
+
+    p->members.assign(n_streams, stream_pool_member_t());
+
+    return 0;
+}
+
+
+// oldest waiting utterance first, the stream index breaks ties
+static bool stream_pool_first(const stream_pool_t *p, int stream)
+{
+    const stream_pool_member_t &m = p->members[stream];
+
+    for (size_t i = 0; i < p->members.size(); i++) {
+        const stream_pool_member_t &o = p->members[i];
+        if ((int) i == stream || o.t_ready < 0) {
+            continue;
+        }
+        if (o.t_ready < m.t_ready || (o.t_ready == m.t_ready && (int) i < stream)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int stream_pool_acquire(stream_pool_t *p, int stream, int64_t t_ready)
+{
+    const int64_t t_start = stream_pool_now();
+
+    int n_granted = 0;
+
+    {
+        std::unique_lock<std::mutex> lock(p->mutex);
+
+        stream_pool_member_t &m = p->members[stream];
+
+        m.t_ready = std::max<int64_t>(0, t_ready);
+
+        p->cv.wait(lock, [p, stream] {
+            return p->n_running < p->n_parallel && p->n_threads_used < p->n_threads && stream_pool_first(p, stream);
+        });
+
+        m.t_ready = -1;
+
+        int n_waiting = 0;
+        for (const auto &o : p->members) {
+            n_waiting += o.t_ready >= 0;
+        }
+
+        // the free threads are shared with the streams that can start next
+        const int n_slots = std::min(p->n_parallel - p->n_running, 1 + n_waiting);
+
+        n_granted = std::max(1, (p->n_threads - p->n_threads_used)/n_slots);
+
+        const int64_t t_now = stream_pool_now();
+
+        if (!p->n_running) {
+            p->t_busy_since = t_now;
+        }
+
+        p->n_running++;
+        p->n_threads_used += n_granted;
+        p->n_running_max   = std::max(p->n_running_max, p->n_running);
+
+        m.n_granted = n_granted;
+        m.t_grant   = t_now;
+
+        m.n_runs++;
+        m.n_threads_sum += n_granted;
+        m.t_wait        += t_now - t_start;
+        m.t_wait_max     = std::max(m.t_wait_max, t_now - t_start);
+    }
+
+    // the next stream in line may fit into what is left
+    p->cv.notify_all();
+
+    return n_granted;
+}
+
+
+void stream_pool_release(stream_pool_t *p, int stream)
+{
+    {
+        std::lock_guard<std::mutex> lock(p->mutex);
+
+        stream_pool_member_t &m = p->members[stream];
+
+        const int64_t t_now = stream_pool_now();
+
+        p->n_running--;
+        p->n_threads_used -= m.n_granted;
+
+        if (!p->n_running) {
+            p->t_busy_any += t_now - p->t_busy_since;
+        }
+
+        m.t_busy   += t_now - m.t_grant;
+        m.n_granted = 0;
+    }
+
+    p->cv.notify_all();
+}
+
+
+void stream_pool_print_stats(stream_pool_t *p)
+{
+    std::lock_guard<std::mutex> lock(p->mutex);
+
+    const double t_sec = (stream_pool_now() - p->t_start)*1e-9;
+
+    for (size_t i = 0; i < p->members.size(); i++) {
+        const stream_pool_member_t &m = p->members[i];
+        if (!m.n_runs) {
+            continue;
+        }
+
+        LOG_INFO("pool:      stream %zu: %llu runs, avg %.1f threads, wait avg %.1f ms max %.1f ms, busy %.0f%%",
+            i, (unsigned long long) m.n_runs, (double) m.n_threads_sum/m.n_runs, m.t_wait*1e-6/m.n_runs,
+            m.t_wait_max*1e-6, t_sec > 0 ? 100.0*m.t_busy*1e-9/t_sec : 0.0);
+    }
+
+    LOG_INFO("pool:      %zu streams, %d threads, up to %d in parallel (%d seen), inference running %.0f%% of %.1f s",
+        p->members.size(), p->n_threads, p->n_parallel, p->n_running_max,
+        t_sec > 0 ? 100.0*p->t_busy_any*1e-9/t_sec : 0.0, t_sec);
+}
@@ -0,0 +1,61 @@
+#ifndef __STREAM_POOL_H__
+#define __STREAM_POOL_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+struct stream_pool_member_t {
+    int64_t t_ready = -1;           // steady clock ns the waiting utterance was captured, -1 - not waiting
+    int     n_granted = 0;          // threads of the running inference, 0 - none
+
+    // stats
+    uint64_t n_runs        = 0;
+    uint64_t n_threads_sum = 0;
+    int64_t  t_wait        = 0;     // ns, acquire to grant
+    int64_t  t_wait_max    = 0;
+    int64_t  t_busy        = 0;     // ns, grant to release
+    int64_t  t_grant       = 0;
+};
+
+
+// Shares the whisper_full worker threads between the inference stages of
+// several streams. At most n_parallel inferences run at a time and together
+// they use no more than n_threads threads. A free slot goes to the stream
+// whose utterance was captured first, so a busy stream cannot starve a quiet
+// one. A stream running alone gets every thread; when others are waiting the
+// free threads are split evenly between them.
+struct stream_pool_t {
+    std::mutex              mutex;
+    std::condition_variable cv;
+
+    int n_threads  = 1;
+    int n_parallel = 1;
+
+    int n_running      = 0;
+    int n_threads_used = 0;
+
+    std::vector<stream_pool_member_t> members;     // one per stream, fixed after init
+
+    // stats
+    int     n_running_max = 0;
+    int64_t t_start       = 0;
+    int64_t t_busy_any    = 0;      // ns at least one inference ran
+    int64_t t_busy_since  = 0;
+};
+
+
+// n_parallel <= 0 - one per stream; both are capped by n_threads
+int stream_pool_init(stream_pool_t *p, int n_streams, int n_threads, int n_parallel);
+
+// blocks until stream may run whisper_full, returns the number of threads to give it
+int stream_pool_acquire(stream_pool_t *p, int stream, int64_t t_ready);
+
+void stream_pool_release(stream_pool_t *p, int stream);
+
+// per stream runs, threads and waits, then the overall concurrency, through LOG_INFO
+void stream_pool_print_stats(stream_pool_t *p);
+
+#endif //__STREAM_POOL_H__
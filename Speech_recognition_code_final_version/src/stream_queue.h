@@ -0,0 +1,171 @@
+#ifndef __STREAM_QUEUE_H__
+#define __STREAM_QUEUE_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+// Bounded blocking FIFO connecting two pipeline stages. Storage is allocated
+// once in stream_queue_init(), pushes and pops never allocate.
+template <typename T>
+struct stream_queue_t {
+    std::mutex              mutex;
+    std::condition_variable cv_push;    // signalled when an item was pushed
+    std::condition_variable cv_pop;     // signalled when an item was popped
+
+    std::vector<T> items;
+    size_t head   = 0;
+    size_t n      = 0;
+    bool   closed = false;
+
+    // depth metrics
+    uint64_t n_push    = 0;
+    uint64_t n_pop     = 0;
+    uint64_t depth_sum = 0;   // depth seen by every push, for the average
+    size_t   depth_max = 0;
+};
+
+
+struct stream_queue_stats_t {
+    uint64_t n_push    = 0;
+    uint64_t n_pop     = 0;
+    size_t   depth     = 0;
+    size_t   depth_max = 0;
+    double   depth_avg = 0.0;
+};
+
+
+template <typename T>
+int stream_queue_init(stream_queue_t<T> *q, size_t capacity)
+{
+    if (!q || !capacity) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(q->mutex);
+
+    q->items.assign(capacity, T());
+    q->head   = 0;
+    q->n      = 0;
+    q->closed = false;
+
+    return 0;
+}
+
+
+template <typename T>
+void stream_queue_put_locked(stream_queue_t<T> *q, const T &item)
+{
+    q->items[(q->head + q->n) % q->items.size()] = item;
+    q->n++;
+
+    q->n_push++;
+    q->depth_sum += q->n;
+    if (q->n > q->depth_max) {
+        q->depth_max = q->n;
+    }
+}
+
+
+// non-blocking, 0 - pushed, -1 - full or closed
+template <typename T>
+int stream_queue_push(stream_queue_t<T> *q, const T &item)
+{
+    {
+        std::lock_guard<std::mutex> lock(q->mutex);
+        if (q->closed || q->n == q->items.size()) {
+            return -1;
+        }
+        stream_queue_put_locked(q, item);
+    }
+    q->cv_push.notify_one();
+
+    return 0;
+}
+
+
+// blocks while the queue is full, 0 - pushed, -1 - closed
+template <typename T>
+int stream_queue_push_wait(stream_queue_t<T> *q, const T &item)
+{
+    {
+        std::unique_lock<std::mutex> lock(q->mutex);
+        q->cv_pop.wait(lock, [q] { return q->closed || q->n < q->items.size(); });
+        if (q->closed) {
+            return -1;
+        }
+        stream_queue_put_locked(q, item);
+    }
+    q->cv_push.notify_one();
+
+    return 0;
+}
+
+
+// 1 - popped, 0 - timeout or empty, -1 - closed and drained;
+// timeout_ms < 0 waits forever, 0 does not wait
+template <typename T>
+int stream_queue_pop(stream_queue_t<T> *q, T *item, int timeout_ms)
+{
+    {
+        std::unique_lock<std::mutex> lock(q->mutex);
+
+        auto ready = [q] { return q->closed || q->n > 0; };
+        if (timeout_ms < 0) {
+            q->cv_push.wait(lock, ready);
+        } else if (!q->cv_push.wait_for(lock, std::chrono::milliseconds(timeout_ms), ready)) {
+            return 0;
+        }
+
+        if (q->n == 0) {
+            return -1;
+        }
+
+        *item = q->items[q->head];
+        q->head = (q->head + 1) % q->items.size();
+        q->n--;
+        q->n_pop++;
+    }
+    q->cv_pop.notify_one();
+
+    return 1;
+}
+
+
+template <typename T>
+void stream_queue_close(stream_queue_t<T> *q)
+{
+    {
+        std::lock_guard<std::mutex> lock(q->mutex);
+        q->closed = true;
+    }
+    q->cv_push.notify_all();
+    q->cv_pop.notify_all();
+}
+
+
+template <typename T>
+size_t stream_queue_depth(stream_queue_t<T> *q)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    return q->n;
+}
+
+
+template <typename T>
+void stream_queue_stats(stream_queue_t<T> *q, stream_queue_stats_t *stats)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+
+    stats->n_push    = q->n_push;
+    stats->n_pop     = q->n_pop;
+    stats->depth     = q->n;
+    stats->depth_max = q->depth_max;
+    stats->depth_avg = q->n_push ? (double) q->depth_sum/q->n_push : 0.0;
+}
+
+#endif //__STREAM_QUEUE_H__
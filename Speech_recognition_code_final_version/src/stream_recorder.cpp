@@ -0,0 +1,346 @@
+#include "stream_recorder.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+
+// transcript slots, a power of two
+static const size_t k_n_lines = 256;
+
+// stdio buffer of every file, the SD card sees writes of this size
+static const size_t k_io_buffer = 256*1024;
+
+
+
+static int64_t stream_recorder_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+static void stream_recorder_put_le(uint8_t *p, uint32_t v, int n)
+{
+    for (int i = 0; i < n; i++) {
+        p[i] = (v >> (8*i)) & 0xff;
+    }
+}
+
+
+// 16-bit mono PCM header, the sizes are patched when the file is closed
+static void stream_recorder_wav_header(uint8_t *hdr, int sample_rate, uint32_t data_bytes)
+{
+    memcpy(hdr + 0,  "RIFF", 4);
+    stream_recorder_put_le(hdr + 4, 36 + data_bytes, 4);
+    memcpy(hdr + 8,  "WAVEfmt ", 8);
+    stream_recorder_put_le(hdr + 16, 16, 4);
+    stream_recorder_put_le(hdr + 20, 1, 2);                // PCM
+    stream_recorder_put_le(hdr + 22, 1, 2);                // mono
+    stream_recorder_put_le(hdr + 24, sample_rate, 4);
+    stream_recorder_put_le(hdr + 28, sample_rate*2, 4);    // byte rate
+    stream_recorder_put_le(hdr + 32, 2, 2);                // block align
+    stream_recorder_put_le(hdr + 34, 16, 2);               // bits
+    memcpy(hdr + 36, "data", 4);
+    stream_recorder_put_le(hdr + 40, data_bytes, 4);
+}
+
+
+static FILE *stream_recorder_fopen(const std::string &path)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        LOG_ERR("fail to open %s", path.c_str());
+        return nullptr;
+    }
+
+    setvbuf(fp, nullptr, _IOFBF, k_io_buffer);
+
+    return fp;
+}
+
+
+static void stream_recorder_close(stream_recorder_t *rec)
+{
+    if (rec->fwav) {
+        uint8_t hdr[44];
+        stream_recorder_wav_header(hdr, rec->params.sample_rate, (uint32_t) std::min<uint64_t>(rec->wav_bytes, UINT32_MAX - 36));
+
+        fflush(rec->fwav);
+        if (fseek(rec->fwav, 0, SEEK_SET) < 0 || fwrite(hdr, 1, sizeof(hdr), rec->fwav) != sizeof(hdr)) {
+            rec->n_write_errors++;
+        }
+        fclose(rec->fwav);
+        rec->fwav = nullptr;
+    }
+
+    if (rec->ftext) {
+        fclose(rec->ftext);
+        rec->ftext = nullptr;
+    }
+}
+
+
+// part 0 keeps the configured names and the tag, later parts get -N appended
+static int stream_recorder_open(stream_recorder_t *rec)
+{
+    const std::string suffix = rec->params.tag + (rec->n_part ? "-" + std::to_string(rec->n_part) : "");
+
+    if (rec->params.save_audio) {
+        char date[32];
+        time_t now = time(0);
+        strftime(date, sizeof(date), "%Y%m%d%H%M%S", localtime(&now));
+
+        rec->fwav = stream_recorder_fopen(date + suffix + ".wav");
+        if (!rec->fwav) {
+            return -1;
+        }
+
+        uint8_t hdr[44];
+        stream_recorder_wav_header(hdr, rec->params.sample_rate, 0);
+        fwrite(hdr, 1, sizeof(hdr), rec->fwav);
+        rec->wav_bytes = 0;
+    }
+
+    if (!rec->params.text_path.empty()) {
+        std::string path = rec->params.text_path;
+
+        const size_t dot   = path.rfind('.');
+        const size_t slash = path.rfind('/');
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+            path.insert(dot, suffix);
+        } else {
+            path += suffix;
+        }
+
+        rec->ftext = stream_recorder_fopen(path);
+        if (!rec->ftext) {
+            return -1;
+        }
+        rec->text_bytes = 0;
+    }
+
+    rec->t_open = stream_recorder_ms();
+
+    return 0;
+}
+
+
+static void stream_recorder_write(stream_recorder_t *rec, FILE *fp, const void *data, size_t n)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+
+    if (fwrite(data, 1, n, fp) != n) {
+        if (!rec->n_write_errors) {
+            LOG_ERR("recorder: write failed, later errors are only counted");
+        }
+        rec->n_write_errors++;
+    }
+
+    const int64_t t_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+
+    rec->t_write_max = std::max(rec->t_write_max, t_us);
+}
+
+
+static void stream_recorder_drain(stream_recorder_t *rec)
+{
+    const uint64_t head = audio_ring_head(&rec->ring);
+    uint64_t       pos  = audio_ring_tail(&rec->ring);
+
+    while (pos < head) {
+        audio_view_t view;
+        if (audio_ring_view(&rec->ring, pos, std::min<uint64_t>(head - pos, rec->ring.mirror), &view) < 0) {
+            break;
+        }
+
+        for (size_t i = 0; i < view.n; i++) {
+            const float v = std::min(1.0f, std::max(-1.0f, view.data[i]));
+            rec->pcm16[i] = (int16_t) (v*32767.0f);
+        }
+
+        if (rec->fwav) {
+            stream_recorder_write(rec, rec->fwav, rec->pcm16.data(), view.n*sizeof(int16_t));
+            rec->wav_bytes += view.n*sizeof(int16_t);
+        }
+
+        rec->n_samples += view.n;
+        pos += view.n;
+        audio_ring_release(&rec->ring, pos);
+    }
+
+    const uint64_t line_head = rec->line_head.load(std::memory_order_acquire);
+    uint64_t       line_tail = rec->line_tail.load(std::memory_order_relaxed);
+
+    if (line_tail == line_head) {
+        return;
+    }
+
+    for (; line_tail < line_head; line_tail++) {
+        const stream_recorder_line_t &line = rec->lines[line_tail & (k_n_lines - 1)];
+
+        const time_t t_sec = line.t_wall/1000;
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&t_sec));
+
+        char buf[320];
+        const int n = snprintf(buf, sizeof(buf), "%s.%03d [%8.2f - %8.2f] %s\n", date, (int) (line.t_wall%1000),
+            (double) line.pos0/rec->params.sample_rate, (double) line.pos1/rec->params.sample_rate, line.text);
+
+        if (rec->ftext && n > 0) {
+            const size_t len = std::min<size_t>(n, sizeof(buf) - 1);
+            stream_recorder_write(rec, rec->ftext, buf, len);
+            rec->text_bytes += len;
+        }
+        rec->n_lines++;
+    }
+
+    rec->line_tail.store(line_tail, std::memory_order_release);
+
+    // transcript lines are small and read while the program runs
+    if (rec->ftext) {
+        fflush(rec->ftext);
+    }
+}
+
+
+static void stream_recorder_thread(stream_recorder_t *rec)
+{
+    const uint64_t rotate_bytes = (uint64_t) std::max(0, rec->params.rotate_mb)*1024*1024;
+
+    if (rec->on_thread) {
+        rec->on_thread(rec->on_thread_userdata);
+    }
+
+    for (;;) {
+        // read before draining, so whatever was queued before the stop is written
+        const bool stop = !rec->running.load();
+
+        stream_recorder_drain(rec);
+
+        if (stop) {
+            break;
+        }
+
+        const bool rotate =
+            (rotate_bytes && std::max(rec->wav_bytes, rec->text_bytes) >= rotate_bytes) ||
+            (rec->params.rotate_s > 0 && stream_recorder_ms() - rec->t_open >= rec->params.rotate_s*1000LL);
+
+        if (rotate) {
+            stream_recorder_close(rec);
+            rec->n_part++;
+            if (stream_recorder_open(rec) < 0) {
+                LOG_ERR("recorder: fail to rotate, recording stopped");
+                stream_recorder_close(rec);
+            }
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(rec->params.flush_ms));
+    }
+}
+
+
+int stream_recorder_init(stream_recorder_t *rec, const stream_recorder_params_t *params)
+{
+    if (!rec || !params || params->sample_rate <= 0 || params->flush_ms <= 0 ||
+        params->buffer_ms < 2*params->flush_ms) {
+        LOG_ERR("args fail! rec(%p), params(%p)", rec, params);
+        return -1;
+    }
+
+    rec->params = *params;
+
+    // one second per write, the buffer must hold a few flush periods of audio
+    const size_t n_block  = params->sample_rate;
+    const size_t n_buffer = std::max<size_t>(2*n_block, (size_t) params->sample_rate/1000*params->buffer_ms);
+
+    if (audio_ring_init(&rec->ring, n_buffer, n_block) < 0) {
+        return -1;
+    }
+
+    rec->pcm16.assign(n_block, 0);
+    rec->lines.assign(k_n_lines, stream_recorder_line_t());
+    rec->line_head.store(0);
+    rec->line_tail.store(0);
+    rec->n_part = 0;
+
+    if (stream_recorder_open(rec) < 0) {
+        stream_recorder_close(rec);
+        audio_ring_free(&rec->ring);
+        return -1;
+    }
+
+    rec->running = true;
+    rec->thread  = std::thread(stream_recorder_thread, rec);
+
+    return 0;
+}
+
+
+size_t stream_recorder_audio(stream_recorder_t *rec, const float *data, size_t n)
+{
+    if (!rec->params.save_audio) {
+        return 0;
+    }
+
+    return audio_ring_write(&rec->ring, data, n);
+}
+
+
+int stream_recorder_text(stream_recorder_t *rec, uint64_t pos0, uint64_t pos1, const char *text)
+{
+    const uint64_t head = rec->line_head.load(std::memory_order_relaxed);
+    const uint64_t tail = rec->line_tail.load(std::memory_order_acquire);
+
+    if (head - tail >= k_n_lines) {
+        rec->n_lines_dropped.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+
+    stream_recorder_line_t &line = rec->lines[head & (k_n_lines - 1)];
+
+    line.t_wall = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    line.pos0 = pos0;
+    line.pos1 = pos1;
+
+    snprintf(line.text, sizeof(line.text), "%s", text);
+    for (char *p = line.text; *p; p++) {
+        if (*p == '\n') {
+            *p = ' ';
+        }
+    }
+
+    rec->line_head.store(head + 1, std::memory_order_release);
+
+    return 0;
+}
+
+
+void stream_recorder_free(stream_recorder_t *rec)
+{
+    if (!rec)
+        return;
+
+    rec->running = false;
+    if (rec->thread.joinable()) {
+        rec->thread.join();
+    }
+
+    stream_recorder_close(rec);
+    audio_ring_free(&rec->ring);
+}
+
+
+void stream_recorder_print_stats(const stream_recorder_t *rec)
+{
+    LOG_INFO("recorder:  %.1f s of audio written, %llu samples dropped in %llu overruns, %d rotations",
+        (double) rec->n_samples/rec->params.sample_rate, (unsigned long long) rec->ring.n_dropped.load(),
+        (unsigned long long) rec->ring.n_overruns.load(), rec->n_part);
+
+    LOG_INFO("recorder:  %llu transcript lines, %llu dropped, %llu write errors, longest write %.1f ms",
+        (unsigned long long) rec->n_lines, (unsigned long long) rec->n_lines_dropped.load(),
+        (unsigned long long) rec->n_write_errors, rec->t_write_max*1e-3);
+}
@@ -0,0 +1,87 @@
+#ifndef __STREAM_RECORDER_H__
+#define __STREAM_RECORDER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_ring.h"
+
+
+struct stream_recorder_params_t {
+    int         sample_rate = 16000;
+    bool        save_audio  = false;    // <date>.wav in the working directory
+    std::string text_path;              // transcript, "" - none
+    std::string tag;                    // appended to both names, e.g. "-s1" for the second stream
+    int         rotate_mb   = 0;        // start new files after this size, 0 - never
+    int         rotate_s    = 0;        // or after this time, 0 - never
+    int         buffer_ms   = 10000;    // audio the recorder may fall behind before dropping
+    int         flush_ms    = 200;      // the writer thread wakes up this often
+};
+
+
+struct stream_recorder_line_t {
+    int64_t  t_wall = 0;                // system clock ms
+    uint64_t pos0   = 0;                // sample span of the text
+    uint64_t pos1   = 0;
+    char     text[240];
+};
+
+
+// Writes the captured audio and the transcript from a background thread, so
+// the pipeline never waits for the SD card. Audio goes through an audio_ring_t,
+// transcript lines through a lock-free single-producer ring of fixed slots.
+// Both producers only copy and never block: what does not fit is dropped and
+// counted. The writer converts and appends in large sequential blocks, and
+// starts new files by size or age.
+struct stream_recorder_t {
+    stream_recorder_params_t params;
+
+    audio_ring_t ring;                  // capture thread -> writer
+
+    std::vector<stream_recorder_line_t> lines;      // dispatch thread -> writer
+    alignas(64) std::atomic<uint64_t> line_head{0};
+    alignas(64) std::atomic<uint64_t> line_tail{0};
+
+    // called once from the writer thread, e.g. to set its affinity
+    void            (*on_thread)(void *userdata) = nullptr;
+    void             *on_thread_userdata         = nullptr;
+
+    std::thread       thread;
+    std::atomic<bool> running{false};
+
+    // writer side
+    FILE    *fwav  = nullptr;
+    FILE    *ftext = nullptr;
+    uint64_t wav_bytes  = 0;            // data bytes of the open WAV file
+    uint64_t text_bytes = 0;
+    int64_t  t_open     = 0;            // steady clock ms the current files were opened
+    int      n_part     = 0;            // rotations so far
+    std::vector<int16_t> pcm16;
+
+    // stats, read after stream_recorder_free()
+    uint64_t n_samples       = 0;
+    uint64_t n_lines         = 0;
+    std::atomic<uint64_t> n_lines_dropped{0};
+    uint64_t n_write_errors  = 0;
+    int64_t  t_write_max     = 0;       // longest write of one block, us
+};
+
+
+int stream_recorder_init(stream_recorder_t *rec, const stream_recorder_params_t *params);
+
+// capture thread: append new samples, what the writer has no room for is dropped
+size_t stream_recorder_audio(stream_recorder_t *rec, const float *data, size_t n);
+
+// dispatch thread: queue one transcript line, -1 if the queue is full and it was dropped
+int stream_recorder_text(stream_recorder_t *rec, uint64_t pos0, uint64_t pos1, const char *text);
+
+// write what is queued, close the files and stop the thread
+void stream_recorder_free(stream_recorder_t *rec);
+
+void stream_recorder_print_stats(const stream_recorder_t *rec);
+
+#endif //__STREAM_RECORDER_H__
@@ -0,0 +1,101 @@
+#include "stream_sched.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cstdio>
+
+
+// moving average weight, step over predicted inference time,
+// growth while windows queue past the target, largest cut per window
+static const double k_sched_alpha    = 0.2;
+static const double k_sched_headroom = 1.2;
+static const double k_sched_backoff  = 1.25;
+static const double k_sched_decay    = 0.9;
+
+
+
+int stream_sched_bounds(const stream_sched_params_t *params, int *step_min_ms, int *step_max_ms)
+{
+    *step_min_ms = params->step_min_ms > 0 ? params->step_min_ms : std::max(100, params->step_ms/4);
+    *step_max_ms = std::min(params->length_ms, params->step_max_ms > 0 ? params->step_max_ms : params->length_ms);
+
+    if (*step_min_ms > *step_max_ms) {
+        LOG_ERR("--step-min %d ms is above --step-max %d ms", *step_min_ms, *step_max_ms);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void stream_sched_init(stream_sched_t *sc, const stream_sched_params_t *params, bool adapt)
+{
+    sc->params = *params;
+    sc->use    = false;
+    sc->step_ms.store(params->step_ms);
+
+    if (!adapt || stream_sched_bounds(params, &sc->params.step_min_ms, &sc->params.step_max_ms) < 0) {
+        return;
+    }
+
+    const int step_ms = std::min(sc->params.step_max_ms, std::max(sc->params.step_min_ms, params->step_ms));
+
+    sc->step_ms.store(step_ms);
+    sc->step_ms_lo = step_ms;
+    sc->step_ms_hi = step_ms;
+    sc->use        = true;
+}
+
+
+void stream_sched_update(stream_sched_t *sc, int64_t t_infer, int64_t t_queue, double t_audio_ms)
+{
+    const stream_sched_params_t &params = sc->params;
+
+    if (t_audio_ms <= 0.0) {
+        return;
+    }
+
+    const double t_infer_ms = t_infer*1e-6;
+    const double t_queue_ms = t_queue*1e-6;
+
+    double rtf      = sc->rtf.load(std::memory_order_relaxed);
+    double queue_ms = sc->queue_ms.load(std::memory_order_relaxed);
+
+    rtf      = rtf > 0.0 ? rtf + k_sched_alpha*(t_infer_ms/t_audio_ms - rtf) : t_infer_ms/t_audio_ms;
+    queue_ms = queue_ms + k_sched_alpha*(t_queue_ms - queue_ms);
+
+    sc->rtf.store(rtf, std::memory_order_relaxed);
+    sc->queue_ms.store(queue_ms, std::memory_order_relaxed);
+
+    const int step_cur = sc->step_ms.load(std::memory_order_relaxed);
+
+    double step = rtf*(params.length_ms + params.keep_ms)*k_sched_headroom;
+
+    if (queue_ms > params.queue_target_ms) {
+        step = std::max(step, step_cur*k_sched_backoff);
+    }
+
+    // a single fast run does not undo a back-off
+    step = std::max(step, step_cur*k_sched_decay);
+
+    const int step_new = std::min(params.step_max_ms, std::max(params.step_min_ms, (int) (step/10.0 + 0.5)*10));
+    if (step_new == step_cur) {
+        return;
+    }
+
+    sc->step_ms.store(step_new, std::memory_order_relaxed);
+
+    sc->n_changes++;
+    sc->step_ms_lo = std::min(sc->step_ms_lo, step_new);
+    sc->step_ms_hi = std::max(sc->step_ms_hi, step_new);
+
+    LOG_DBG("step %d -> %d ms (rtf %.2f, queue %.0f ms)", step_cur, step_new, rtf, queue_ms);
+}
+
+
+void stream_sched_print_stats(const stream_sched_t *sc)
+{
+    LOG_INFO("scheduler: step %d ms (%d - %d ms seen, %llu changes), rtf %.2f, queue wait %.0f ms, target %d ms",
+        sc->step_ms.load(), sc->step_ms_lo, sc->step_ms_hi, (unsigned long long) sc->n_changes,
+        sc->rtf.load(), sc->queue_ms.load(), sc->params.queue_target_ms);
+}
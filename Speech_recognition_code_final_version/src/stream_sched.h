@@ -0,0 +1,49 @@
+#ifndef __STREAM_SCHED_H__
+#define __STREAM_SCHED_H__
+
+#include <atomic>
+#include <cstdint>
+
+
+struct stream_sched_params_t {
+    int step_ms         = 1000;    // initial, and the fixed step without adaptation
+    int step_min_ms     = 0;       // 0 - step_ms/4, at least 100
+    int step_max_ms     = 0;       // 0 - length_ms
+    int length_ms       = 3000;
+    int keep_ms         = 100;
+    int queue_target_ms = 500;
+};
+
+
+// Sliding-window step (-as). After every window the moving averages of the
+// real-time factor and of the queue wait are updated and the step recomputed:
+// long enough for whisper_full to keep up with one window per step, growing
+// while windows wait longer than the target, and shrinking back slowly once
+// they do not. The capture stage reads step_ms before every window.
+struct stream_sched_t {
+    stream_sched_params_t params;
+
+    bool use = false;              // adapt, otherwise step_ms stays put
+
+    std::atomic<int>    step_ms{0};
+    std::atomic<double> rtf{0.0};       // whisper_full time over window length, moving average
+    std::atomic<double> queue_ms{0.0};  // submit to inference start, moving average
+
+    // stats
+    uint64_t n_changes  = 0;
+    int      step_ms_lo = 0;
+    int      step_ms_hi = 0;
+};
+
+
+// the bounds with their defaults filled in, -1 when they cross
+int stream_sched_bounds(const stream_sched_params_t *params, int *step_min_ms, int *step_max_ms);
+
+void stream_sched_init(stream_sched_t *sc, const stream_sched_params_t *params, bool adapt);
+
+// after every window: its whisper_full and queue wait in ns, its audio in ms
+void stream_sched_update(stream_sched_t *sc, int64_t t_infer, int64_t t_queue, double t_audio_ms);
+
+void stream_sched_print_stats(const stream_sched_t *sc);
+
+#endif //__STREAM_SCHED_H__
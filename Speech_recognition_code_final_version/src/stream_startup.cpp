@@ -0,0 +1,99 @@
+#include "stream_startup.h"
+#include "debug.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <unistd.h>
+
+
+
+static int64_t stream_startup_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// since boot, ns
+static int64_t stream_startup_boottime()
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_BOOTTIME, &ts) < 0) {
+        return -1;
+    }
+
+    return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+
+// process start since boot, ns: field 22 of /proc/self/stat, in clock ticks
+static int64_t stream_startup_process_start()
+{
+    FILE *fp = fopen("/proc/self/stat", "r");
+    if (!fp) {
+        return -1;
+    }
+
+    char buf[1024];
+    const size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    // the command name may contain spaces, the fields after it do not
+    const char *p = strrchr(buf, ')');
+    if (!p) {
+        return -1;
+    }
+
+    unsigned long long start = 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &start) != 1) {
+        return -1;
+    }
+
+    return (int64_t) (start*1000000000ULL/sysconf(_SC_CLK_TCK));
+}
+
+
+void stream_startup_init(stream_startup_t *st)
+{
+    st->t_init   = stream_startup_now();
+    st->n_phases = 0;
+}
+
+
+void stream_startup_add(stream_startup_t *st, const char *name, int64_t t_us, const char *note)
+{
+    if (!st || !name || st->n_phases >= k_stream_startup_phases) {
+        return;
+    }
+
+    stream_startup_phase_t &phase = st->phases[st->n_phases++];
+
+    phase.name = name;
+    phase.t_us = t_us;
+    snprintf(phase.note, sizeof(phase.note), "%s", note ? note : "");
+}
+
+
+void stream_startup_report(const stream_startup_t *st)
+{
+    for (int i = 0; i < st->n_phases; i++) {
+        const stream_startup_phase_t &phase = st->phases[i];
+
+        LOG_INFO("startup:   %-16s %9.1f ms %s", phase.name, phase.t_us*1e-3, phase.note);
+    }
+
+    const int64_t t_ready = stream_startup_now() - st->t_init;
+    const int64_t t_boot  = stream_startup_boottime();
+    const int64_t t_start = stream_startup_process_start();
+
+    if (t_boot > 0 && t_start >= 0) {
+        LOG_INFO("startup:   ready %.1f ms after init, %.1f ms after the process started, %.1f s after boot",
+            t_ready*1e-6, (t_boot - t_start)*1e-6, t_boot*1e-9);
+    } else {
+        LOG_INFO("startup:   ready %.1f ms after init", t_ready*1e-6);
+    }
+}
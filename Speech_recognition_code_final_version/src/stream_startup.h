@@ -0,0 +1,37 @@
+#ifndef __STREAM_STARTUP_H__
+#define __STREAM_STARTUP_H__
+
+#include <cstdint>
+
+
+static const int k_stream_startup_phases = 16;
+
+
+struct stream_startup_phase_t {
+    const char *name = nullptr;     // static string
+    int64_t     t_us = 0;
+    char        note[64];
+};
+
+
+// Where the time between process start and the first utterance the pipeline
+// can take goes: every phase is timed by whoever runs it and reported once,
+// in the order added, when the pipeline is ready. Not thread safe, phases are
+// added by the thread that starts the pipeline, before it does.
+struct stream_startup_t {
+    int64_t t_init = 0;             // steady clock ns, stream_startup_init()
+
+    stream_startup_phase_t phases[k_stream_startup_phases];
+    int                    n_phases = 0;
+};
+
+
+void stream_startup_init(stream_startup_t *st);
+
+// note may be nullptr; phases past k_stream_startup_phases are ignored
+void stream_startup_add(stream_startup_t *st, const char *name, int64_t t_us, const char *note);
+
+// every phase, then the time to ready since init, process start and boot, through LOG_INFO
+void stream_startup_report(const stream_startup_t *st);
+
+#endif //__STREAM_STARTUP_H__
@@ -0,0 +1,170 @@
+#include "stream_trace.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+
+
+static int stream_hist_index(int64_t v)
+{
+    if (v < 32) {
+        return v < 0 ? 0 : (int) v;
+    }
+
+    const int msb   = 63 - __builtin_clzll((uint64_t) v);
+    const int shift = msb - 4;
+
+    const int index = 16*shift + (int) (v >> shift);
+
+    return index < k_stream_hist_buckets ? index : k_stream_hist_buckets - 1;
+}
+
+
+// highest value that falls into bucket index
+static int64_t stream_hist_value(int index)
+{
+    if (index < 32) {
+        return index;
+    }
+
+    const int     shift = index/16 - 1;
+    const int64_t m     = index%16 + 16;
+
+    return ((m + 1) << shift) - 1;
+}
+
+
+void stream_hist_record(stream_hist_t *h, int64_t value_us)
+{
+    h->counts[stream_hist_index(value_us)]++;
+
+    if (!h->n || value_us < h->min) {
+        h->min = value_us;
+    }
+    if (!h->n || value_us > h->max) {
+        h->max = value_us;
+    }
+
+    h->n++;
+    h->sum += value_us;
+}
+
+
+int64_t stream_hist_percentile(const stream_hist_t *h, double p)
+{
+    if (!h->n) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t) (p/100.0*h->n + 0.5);
+    rank = rank < 1 ? 1 : (rank > h->n ? h->n : rank);
+
+    uint64_t seen = 0;
+    for (int i = 0; i < k_stream_hist_buckets; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            const int64_t v = stream_hist_value(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+
+int64_t stream_trace_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+int stream_trace_init(stream_trace_t *trace, int n_stages, const char *const *names, int n_recent)
+{
+    if (!trace || n_stages < 2 || !names || n_recent <= 0) {
+        LOG_ERR("args fail! trace(%p), n_stages(%d), names(%p), n_recent(%d)", trace, n_stages, names, n_recent);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(trace->mutex);
+
+    trace->n_stages = n_stages;
+    trace->names    = names;
+    trace->next_id  = 1;
+
+    trace->recent.assign(n_recent, stream_trace_rec_t());
+    for (auto &rec : trace->recent) {
+        rec.t.assign(n_stages, 0);
+    }
+
+    trace->hist.assign(n_stages, stream_hist_t());
+
+    return 0;
+}
+
+
+uint64_t stream_trace_begin(stream_trace_t *trace, int64_t t_ref)
+{
+    std::lock_guard<std::mutex> lock(trace->mutex);
+
+    const uint64_t id = trace->next_id++;
+
+    stream_trace_rec_t &rec = trace->recent[id % trace->recent.size()];
+
+    rec.id = id;
+    std::fill(rec.t.begin(), rec.t.end(), 0);
+    rec.t[0] = t_ref ? t_ref : stream_trace_now();
+
+    return id;
+}
+
+
+int stream_trace_mark(stream_trace_t *trace, uint64_t id, int stage, int64_t t)
+{
+    if (!t) {
+        t = stream_trace_now();
+    }
+
+    std::lock_guard<std::mutex> lock(trace->mutex);
+
+    if (!id || stage <= 0 || stage >= trace->n_stages || trace->recent.empty()) {
+        return -1;
+    }
+
+    stream_trace_rec_t &rec = trace->recent[id % trace->recent.size()];
+    if (rec.id != id) {
+        return -1;
+    }
+
+    if (rec.t[stage]) {
+        return 0;
+    }
+
+    rec.t[stage] = t;
+    stream_hist_record(&trace->hist[stage], (t - rec.t[0])/1000);
+
+    return 0;
+}
+
+
+void stream_trace_dump(stream_trace_t *trace)
+{
+    std::lock_guard<std::mutex> lock(trace->mutex);
+
+    LOG_INFO("latency from %s, ms:    count       p50       p90       p99     p99.9       max      mean",
+        trace->n_stages ? trace->names[0] : "-");
+
+    for (int i = 1; i < trace->n_stages; i++) {
+        const stream_hist_t &h = trace->hist[i];
+        if (!h.n) {
+            continue;
+        }
+
+        LOG_INFO("  %-24s %8llu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f", trace->names[i], (unsigned long long) h.n,
+            stream_hist_percentile(&h, 50.0)*1e-3, stream_hist_percentile(&h, 90.0)*1e-3,
+            stream_hist_percentile(&h, 99.0)*1e-3, stream_hist_percentile(&h, 99.9)*1e-3,
+            h.max*1e-3, h.sum*1e-3/h.n);
+    }
+}
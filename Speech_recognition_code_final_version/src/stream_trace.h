@@ -0,0 +1,63 @@
+#ifndef __STREAM_TRACE_H__
+#define __STREAM_TRACE_H__
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+// Log-linear latency histogram in microseconds, HDR style: values below 32 us
+// are exact, above that every power of two is split into 16 buckets, so any
+// recorded value is known to within 1/16 (about 6 %). Covers up to ~2^40 us.
+static const int k_stream_hist_buckets = 16*37 + 32;
+
+struct stream_hist_t {
+    uint64_t counts[k_stream_hist_buckets] = { 0 };
+    uint64_t n   = 0;
+    int64_t  min = 0;
+    int64_t  max = 0;
+    double   sum = 0.0;
+};
+
+void stream_hist_record(stream_hist_t *h, int64_t value_us);
+
+// highest value equivalent to the p-th percentile (0 - 100), 0 if empty
+int64_t stream_hist_percentile(const stream_hist_t *h, double p);
+
+
+// One record per utterance: stage 0 is the reference time, every other stage
+// is recorded once (the first mark wins) and added to that stage's histogram
+// as its latency from the reference. Records are kept in a small ring indexed
+// by trace id, so stages can still be marked for a while after dispatch.
+struct stream_trace_rec_t {
+    uint64_t             id = 0;
+    std::vector<int64_t> t;         // steady clock ns per stage, 0 - not reached
+};
+
+
+struct stream_trace_t {
+    std::mutex mutex;
+
+    int                n_stages = 0;
+    const char *const *names    = nullptr;
+
+    uint64_t                        next_id = 1;
+    std::vector<stream_trace_rec_t> recent;
+    std::vector<stream_hist_t>      hist;      // per stage, [0] unused
+};
+
+
+int stream_trace_init(stream_trace_t *trace, int n_stages, const char *const *names, int n_recent);
+
+// new trace id with the reference stage at t_ref (steady clock ns)
+uint64_t stream_trace_begin(stream_trace_t *trace, int64_t t_ref);
+
+// t == 0 - now; -1 if the trace id is unknown or already evicted
+int stream_trace_mark(stream_trace_t *trace, uint64_t id, int stage, int64_t t);
+
+// per stage count and percentiles of the latency from the reference, through LOG_INFO
+void stream_trace_dump(stream_trace_t *trace);
+
+int64_t stream_trace_now();
+
+#endif //__STREAM_TRACE_H__
@@ -0,0 +1,162 @@
+#include "stream_vad.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+
+// frames below this energy (about -80 dBFS) are never voiced
+static const float k_energy_floor = 1e-8f;
+
+// noise floor tracking per frame: follow drops quickly, rises slowly
+static const float k_noise_down = 0.2f;
+static const float k_noise_up   = 0.005f;
+
+
+
+int stream_vad_init(stream_vad_t *vad, const stream_vad_params_t *params)
+{
+    if (!vad || !params) {
+        LOG_ERR("args fail! vad(%p), params(%p)", vad, params);
+        return -1;
+    }
+
+    if (params->frame_ms < 10 || params->frame_ms > 30 || params->sample_rate <= 0 ||
+        params->hangover_ms < params->frame_ms || params->max_speech_ms <= params->hangover_ms) {
+        LOG_ERR("bad vad params: frame %d ms, hangover %d ms, max speech %d ms",
+            params->frame_ms, params->hangover_ms, params->max_speech_ms);
+        return -1;
+    }
+
+    vad->params = *params;
+
+    vad->n_frame    = params->sample_rate*params->frame_ms/1000;
+    vad->n_start    = std::max(1, params->start_ms/params->frame_ms);
+    vad->n_hangover = std::max(1, params->hangover_ms/params->frame_ms);
+    vad->n_max      = params->sample_rate/1000*params->max_speech_ms;
+    vad->n_preroll  = params->sample_rate/1000*std::max(0, params->preroll_ms);
+
+    audio_dsp_hp_init(&vad->hp, params->freq_thold, params->sample_rate);
+
+    stream_vad_reset(vad);
+
+    return 0;
+}
+
+
+void stream_vad_reset(stream_vad_t *vad)
+{
+    audio_dsp_hp_reset(&vad->hp);
+
+    vad->energy     = 0.0f;
+    vad->noise      = 0.0f;
+    vad->in_speech  = false;
+    vad->n_voiced   = 0;
+    vad->n_unvoiced = 0;
+    vad->pos_voiced = 0;
+    vad->pos_start  = 0;
+    vad->pos_begin  = 0;
+    vad->pos_end    = 0;
+
+    vad->pos_voiced_end = 0;
+    vad->pos_prev_end   = 0;
+}
+
+
+static uint64_t stream_vad_preroll_pos(const stream_vad_t *vad, uint64_t pos)
+{
+    pos = pos > (uint64_t) vad->n_preroll ? pos - vad->n_preroll : 0;
+
+    return std::max(pos, vad->pos_prev_end);
+}
+
+
+stream_vad_event_t stream_vad_process(stream_vad_t *vad, const float *frame, uint64_t pos)
+{
+    const float energy = audio_dsp_highpass_energy(&vad->hp, frame, vad->n_frame);
+
+    vad->energy = energy;
+
+    if (vad->noise <= 0.0f && energy > k_energy_floor) {
+        vad->noise = energy;
+    }
+
+    const bool voiced = energy > k_energy_floor && vad->noise < vad->params.vad_thold*vad->params.vad_thold*energy;
+
+    // the noise floor is frozen while an utterance is in progress, and digital
+    // silence (a muted device, gaps between replayed files) says nothing about it
+    if (energy > k_energy_floor) {
+        if (energy < vad->noise) {
+            vad->noise += (energy - vad->noise)*k_noise_down;
+        } else if (!vad->in_speech) {
+            vad->noise += (energy - vad->noise)*k_noise_up;
+        }
+        vad->noise = std::max(vad->noise, k_energy_floor);
+    }
+
+    const uint64_t pos_next = pos + vad->n_frame;
+
+    if (!vad->in_speech) {
+        if (!voiced) {
+            vad->n_voiced = 0;
+            return STREAM_VAD_NONE;
+        }
+
+        if (vad->n_voiced++ == 0) {
+            vad->pos_voiced = pos;
+        }
+
+        if (vad->n_voiced < vad->n_start) {
+            return STREAM_VAD_NONE;
+        }
+
+        vad->in_speech  = true;
+        vad->n_unvoiced = 0;
+        vad->pos_start  = vad->pos_voiced;
+        vad->pos_begin  = stream_vad_preroll_pos(vad, vad->pos_start);
+        vad->pos_end    = pos_next;
+
+        vad->pos_voiced_end = pos_next;
+
+        return STREAM_VAD_START;
+    }
+
+    vad->n_unvoiced = voiced ? 0 : vad->n_unvoiced + 1;
+    vad->pos_end    = pos_next;
+
+    if (voiced) {
+        vad->pos_voiced_end = pos_next;
+    }
+
+    if (vad->n_unvoiced < vad->n_hangover && pos_next - vad->pos_start < (uint64_t) vad->n_max) {
+        return STREAM_VAD_NONE;
+    }
+
+    vad->in_speech  = false;
+    vad->n_voiced   = 0;
+    vad->n_unvoiced = 0;
+
+    vad->pos_prev_end = vad->pos_end;
+
+    return STREAM_VAD_END;
+}
+
+
+void stream_vad_segment(const stream_vad_t *vad, stream_vad_segment_t *seg)
+{
+    seg->pos_begin      = vad->pos_begin;
+    seg->pos_speech     = vad->pos_start;
+    seg->pos_speech_end = vad->pos_voiced_end;
+    seg->pos_end        = vad->pos_end;
+}
+
+
+uint64_t stream_vad_keep_pos(const stream_vad_t *vad, uint64_t pos_read)
+{
+    if (vad->in_speech) {
+        return vad->pos_begin;
+    }
+
+    return stream_vad_preroll_pos(vad, vad->n_voiced ? vad->pos_voiced : pos_read);
+}
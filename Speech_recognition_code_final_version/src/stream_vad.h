@@ -0,0 +1,82 @@
+#ifndef __STREAM_VAD_H__
+#define __STREAM_VAD_H__
+
+#include <cstdint>
+
+#include "audio_dsp.h"
+
+
+typedef enum {
+    STREAM_VAD_NONE  = 0,
+    STREAM_VAD_START = 1,   // start-of-speech confirmed
+    STREAM_VAD_END   = 2,   // end-of-speech after the hangover, or max length reached
+} stream_vad_event_t;
+
+
+struct stream_vad_params_t {
+    int   sample_rate   = 16000;
+    int   frame_ms      = 20;      // analysis frame, 10 - 30 ms
+    int   start_ms      = 60;      // voiced time needed to confirm a start
+    int   hangover_ms   = 300;     // unvoiced time needed to end an utterance
+    int   max_speech_ms = 3000;    // utterances are cut at this length
+    int   preroll_ms    = 200;     // audio kept before the first voiced frame
+    float vad_thold     = 0.6f;    // voiced when noise floor < vad_thold^2 * frame energy
+    float freq_thold    = 100.0f;  // high-pass cutoff, 0 - disabled
+};
+
+
+// Exact span of one utterance:
+// [pos_begin, pos_speech) pre-roll, [pos_speech, pos_speech_end) speech,
+// [pos_speech_end, pos_end) hangover.
+struct stream_vad_segment_t {
+    uint64_t pos_begin      = 0;
+    uint64_t pos_speech     = 0;
+    uint64_t pos_speech_end = 0;
+    uint64_t pos_end        = 0;
+};
+
+
+// Incremental energy VAD: every frame is high-pass filtered, its energy is
+// compared to a running noise-floor estimate, and start/end events are
+// emitted with the absolute sample positions of the utterance.
+struct stream_vad_t {
+    stream_vad_params_t params;
+
+    int   n_frame     = 0;      // samples per frame
+    int   n_start     = 0;      // frames to confirm a start
+    int   n_hangover  = 0;      // frames to confirm an end
+    int   n_max       = 0;      // max utterance length in samples
+    int   n_preroll   = 0;      // pre-roll in samples
+
+    audio_dsp_hp_t hp;
+
+    float energy      = 0.0f;   // last frame energy
+    float noise       = 0.0f;   // noise floor, 0 - not yet estimated
+
+    bool  in_speech   = false;
+    int   n_voiced    = 0;      // consecutive voiced frames
+    int   n_unvoiced  = 0;      // consecutive unvoiced frames
+
+    uint64_t pos_voiced = 0;    // first sample of the current voiced run
+    uint64_t pos_start  = 0;    // first voiced sample of the utterance
+    uint64_t pos_begin  = 0;    // first sample of the utterance, pre-roll included
+    uint64_t pos_end    = 0;    // one past the last sample of the utterance
+    uint64_t pos_voiced_end = 0;  // one past the last voiced frame
+    uint64_t pos_prev_end   = 0;  // end of the previous utterance, pre-roll never reaches back past it
+};
+
+
+int stream_vad_init(stream_vad_t *vad, const stream_vad_params_t *params);
+
+void stream_vad_reset(stream_vad_t *vad);
+
+// feed exactly one frame (vad->n_frame samples) starting at absolute position pos
+stream_vad_event_t stream_vad_process(stream_vad_t *vad, const float *frame, uint64_t pos);
+
+// span of the last utterance, valid after STREAM_VAD_END
+void stream_vad_segment(const stream_vad_t *vad, stream_vad_segment_t *seg);
+
+// first sample that may still become part of an utterance, older audio can be released
+uint64_t stream_vad_keep_pos(const stream_vad_t *vad, uint64_t pos_read);
+
+#endif //__STREAM_VAD_H__
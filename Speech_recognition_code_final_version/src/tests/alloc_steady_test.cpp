@@ -0,0 +1,96 @@
+// Steady-state allocation check of the dispatch path, run by ctest
+//
+// Built with WHISPER_FUZZY_ALLOC_COUNT. What the dispatch stage does per
+// utterance without a model or audio: the transcript goes into the
+// utterance's arena, whisper_fuzzy_lookup() finds its code, the dedup stage
+// remembers and releases it and the printed line is formatted into the arena.
+// After the same warm-up as --alloc-check, none of it may touch the heap.
+//
+#include "alloc_count.h"
+#include "debug.h"
+#include "stream_arena.h"
+#include "stream_dedup.h"
+#include "whisper_fuzzy.h"
+
+#include <cstdint>
+#include <cstdio>
+
+
+// iterations before counting, as the pipeline's --alloc-check
+static const int k_n_warmup = 4;
+static const int k_n_iter   = 1000;
+
+// what Whisper hands the dispatch stage: commands, a shouted one, no command
+static const char *k_texts[] = { " Hi.", "okay!", " UP.", " this is not a command", "wow." };
+static const int   k_n_texts = sizeof(k_texts)/sizeof(k_texts[0]);
+
+
+
+static void alloc_test_iteration(whisper_fuzzy_t *w, stream_arena_t *arena, stream_dedup_t *dedup, int k)
+{
+    const uint64_t pos0 = (uint64_t) k*16000;
+
+    stream_arena_reset(arena);
+
+    const char *text = stream_arena_strdup(arena, k_texts[k % k_n_texts]);
+    const char *code = whisper_fuzzy_lookup(w, text);
+
+    stream_dedup_release(dedup, pos0);
+    if (code) {
+        stream_dedup_check(dedup, pos0, pos0 + 8000, code, text);
+    }
+
+    stream_arena_printf(arena, "[%llu] %s -> %s", (unsigned long long) pos0, text, code ? code : "none");
+}
+
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s config.json\n", argv[0]);
+        return 2;
+    }
+
+    if (!alloc_count_enabled()) {
+        LOG_ERR("built without WHISPER_FUZZY_ALLOC_COUNT, nothing is counted");
+        return 1;
+    }
+
+    const char *args[] = { argv[0], "-u", argv[1] };
+
+    whisper_fuzzy_t *w = whisper_fuzzy_init(3, args);
+    if (!w) {
+        return 1;
+    }
+
+    stream_arena_t arena;
+    stream_arena_init(&arena, 4096);
+
+    stream_dedup_t        dedup;
+    stream_dedup_params_t dedup_params;
+    stream_dedup_init(&dedup, &dedup_params);
+
+    int k = 0;
+    for (; k < k_n_warmup; k++) {
+        alloc_test_iteration(w, &arena, &dedup, k);
+    }
+
+    const uint64_t n_before = alloc_count_thread();
+
+    for (; k < k_n_warmup + k_n_iter; k++) {
+        alloc_test_iteration(w, &arena, &dedup, k);
+    }
+
+    const uint64_t n_alloc = alloc_count_thread() - n_before;
+
+    whisper_fuzzy_exit(w);
+
+    if (n_alloc) {
+        LOG_ERR("%llu allocations in %d steady-state iterations", (unsigned long long) n_alloc, k_n_iter);
+        return 1;
+    }
+
+    LOG_INFO("no allocation in %d steady-state iterations", k_n_iter);
+
+    return 0;
+}
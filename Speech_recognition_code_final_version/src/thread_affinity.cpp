@@ -0,0 +1,386 @@
+#include "thread_affinity.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+
+struct thread_stats_t {
+    int     cpu            = -1;    // last CPU the thread ran on
+    int64_t n_migrations   = -1;    // -1 - not available (no CONFIG_SCHED_DEBUG)
+    int64_t n_nonvoluntary = -1;
+};
+
+
+static pid_t thread_affinity_gettid()
+{
+    return (pid_t) syscall(SYS_gettid);
+}
+
+
+static int thread_affinity_parse_cpus(const std::string &list, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+
+    size_t i = 0;
+    while (i < list.size()) {
+        size_t j = list.find(',', i);
+        if (j == std::string::npos) {
+            j = list.size();
+        }
+
+        const std::string range = list.substr(i, j - i);
+        char *end = nullptr;
+
+        const long first = strtol(range.c_str(), &end, 10);
+        long last = first;
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+
+        if (range.empty() || *end || first < 0 || last < first || last >= CPU_SETSIZE) {
+            LOG_ERR("bad CPU list '%s'", list.c_str());
+            return -1;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+        i = j + 1;
+    }
+
+    return CPU_COUNT(cpus) ? 0 : -1;
+}
+
+
+static int thread_affinity_parse_policy(const std::string &name)
+{
+    if (name == "other") return SCHED_OTHER;
+    if (name == "batch") return SCHED_BATCH;
+    if (name == "idle")  return SCHED_IDLE;
+    if (name == "fifo")  return SCHED_FIFO;
+    if (name == "rr")    return SCHED_RR;
+
+    return -1;
+}
+
+
+static const char *thread_affinity_policy_name(int policy)
+{
+    switch (policy) {
+        case SCHED_OTHER: return "other";
+        case SCHED_BATCH: return "batch";
+        case SCHED_IDLE:  return "idle";
+        case SCHED_FIFO:  return "fifo";
+        case SCHED_RR:    return "rr";
+        default:          return "?";
+    }
+}
+
+
+static std::string thread_affinity_cpus_str(const cpu_set_t *cpus)
+{
+    std::string s;
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, cpus)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) {
+            last++;
+        }
+
+        char buf[32];
+        snprintf(buf, sizeof(buf), last > cpu ? "%d-%d" : "%d", cpu, last);
+        s += (s.empty() ? "" : ",") + std::string(buf);
+        cpu = last;
+    }
+
+    return s.empty() ? "-" : s;
+}
+
+
+static thread_role_t *thread_affinity_find(thread_affinity_t *ta, const std::string &name)
+{
+    for (auto &role : ta->roles) {
+        if (role.name == name) {
+            return &role;
+        }
+    }
+    return nullptr;
+}
+
+
+// reads /proc/self/task/<tid>/{stat,status,sched}
+static void thread_affinity_stats(pid_t tid, thread_stats_t *st)
+{
+    char path[64];
+    char line[512];
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int) tid);
+    if (FILE *fp = fopen(path, "r")) {
+        if (fgets(line, sizeof(line), fp)) {
+            // field 39 is the processor, counted from the state field after the comm
+            const char *p = strrchr(line, ')');
+            for (int field = 2; p && field < 39; field++) {
+                p = strchr(p + 1, ' ');
+            }
+            if (p) {
+                st->cpu = atoi(p + 1);
+            }
+        }
+        fclose(fp);
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int) tid);
+    if (FILE *fp = fopen(path, "r")) {
+        while (fgets(line, sizeof(line), fp)) {
+            if (!strncmp(line, "nonvoluntary_ctxt_switches:", 27)) {
+                st->n_nonvoluntary = atoll(line + 27);
+            }
+        }
+        fclose(fp);
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/sched", (int) tid);
+    if (FILE *fp = fopen(path, "r")) {
+        while (fgets(line, sizeof(line), fp)) {
+            if (!strncmp(line, "se.nr_migrations", 16)) {
+                const char *colon = strchr(line, ':');
+                if (colon) {
+                    st->n_migrations = atoll(colon + 1);
+                }
+            }
+        }
+        fclose(fp);
+    }
+}
+
+
+int thread_affinity_add(thread_affinity_t *ta, const std::string &spec)
+{
+    const size_t eq = spec.find('=');
+    if (!ta || eq == std::string::npos || eq == 0) {
+        LOG_ERR("bad affinity '%s', expected ROLE=CPUS[:POLICY[:PRIO]]", spec.c_str());
+        return -1;
+    }
+
+    thread_role_t role;
+    role.name = spec.substr(0, eq);
+    CPU_ZERO(&role.cpus_seen);
+
+    std::string rest = spec.substr(eq + 1);
+    std::string fields[3];
+    for (int i = 0; i < 3; i++) {
+        const size_t colon = rest.find(':');
+        fields[i] = rest.substr(0, colon);
+        rest = colon == std::string::npos ? "" : rest.substr(colon + 1);
+    }
+
+    if (!fields[0].empty()) {
+        if (thread_affinity_parse_cpus(fields[0], &role.cpus) < 0) {
+            return -1;
+        }
+        role.has_cpus = true;
+    }
+
+    if (!fields[1].empty()) {
+        role.policy = thread_affinity_parse_policy(fields[1]);
+        if (role.policy < 0) {
+            LOG_ERR("bad scheduling policy '%s' in '%s'", fields[1].c_str(), spec.c_str());
+            return -1;
+        }
+    }
+
+    if (!fields[2].empty()) {
+        role.priority = atoi(fields[2].c_str());
+    }
+
+    if (role.policy == SCHED_FIFO || role.policy == SCHED_RR) {
+        const int lo = sched_get_priority_min(role.policy);
+        const int hi = sched_get_priority_max(role.policy);
+        if (role.priority < lo || role.priority > hi) {
+            LOG_ERR("priority %d of '%s' out of [%d, %d]", role.priority, spec.c_str(), lo, hi);
+            return -1;
+        }
+    } else {
+        role.priority = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(ta->mutex);
+
+    if (thread_role_t *old = thread_affinity_find(ta, role.name)) {
+        *old = role;
+    } else {
+        ta->roles.push_back(role);
+    }
+
+    return 0;
+}
+
+
+int thread_affinity_enter(thread_affinity_t *ta, const char *name)
+{
+    if (!ta || !name) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(ta->mutex);
+
+    thread_role_t *role = thread_affinity_find(ta, name);
+    if (!role) {
+        thread_role_t untracked;
+
+        // a stream role like "inference.1" without its own spec takes the one of "inference"
+        const char *dot = strrchr(name, '.');
+        if (dot) {
+            if (const thread_role_t *base = thread_affinity_find(ta, std::string(name, dot - name))) {
+                untracked.cpus     = base->cpus;
+                untracked.has_cpus = base->has_cpus;
+                untracked.policy   = base->policy;
+                untracked.priority = base->priority;
+            }
+        }
+
+        untracked.name = name;
+        CPU_ZERO(&untracked.cpus_seen);
+        ta->roles.push_back(untracked);
+        role = &ta->roles.back();
+    }
+
+    int ret = 0;
+
+    if (role->has_cpus && sched_setaffinity(0, sizeof(role->cpus), &role->cpus) < 0) {
+        LOG_ERR("%s: fail to set CPUs %s: %s", name, thread_affinity_cpus_str(&role->cpus).c_str(), strerror(errno));
+        ret = -1;
+    }
+
+    if (role->policy >= 0) {
+        struct sched_param param;
+        param.sched_priority = role->priority;
+
+        const int err = pthread_setschedparam(pthread_self(), role->policy, &param);
+        if (err) {
+            LOG_ERR("%s: fail to set policy %s/%d: %s", name, thread_affinity_policy_name(role->policy),
+                role->priority, strerror(err));
+            ret = -1;
+        }
+    }
+
+    thread_affinity_rec_t rec;
+    rec.tid  = thread_affinity_gettid();
+    rec.role = name;
+
+    ta->threads.push_back(rec);
+
+    return ret;
+}
+
+
+void thread_affinity_leave(thread_affinity_t *ta)
+{
+    if (!ta) {
+        return;
+    }
+
+    const pid_t tid = thread_affinity_gettid();
+
+    thread_stats_t st;
+    thread_affinity_stats(tid, &st);
+
+    std::lock_guard<std::mutex> lock(ta->mutex);
+
+    for (size_t i = 0; i < ta->threads.size(); i++) {
+        if (ta->threads[i].tid != tid) {
+            continue;
+        }
+
+        if (thread_role_t *role = thread_affinity_find(ta, ta->threads[i].role)) {
+            role->n_threads++;
+            role->n_migrations   += std::max<int64_t>(0, st.n_migrations);
+            role->n_nonvoluntary += std::max<int64_t>(0, st.n_nonvoluntary);
+            if (st.cpu >= 0) {
+                CPU_SET(st.cpu, &role->cpus_seen);
+            }
+        }
+
+        ta->threads.erase(ta->threads.begin() + i);
+        break;
+    }
+}
+
+
+void thread_affinity_report(thread_affinity_t *ta)
+{
+    if (!ta) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(ta->mutex);
+
+    for (const auto &role : ta->roles) {
+        LOG_INFO("affinity: role %-10s cpus %-8s policy %s/%d", role.name.c_str(),
+            role.has_cpus ? thread_affinity_cpus_str(&role.cpus).c_str() : "any",
+            role.policy >= 0 ? thread_affinity_policy_name(role.policy) : "inherit", role.priority);
+
+        if (role.n_threads) {
+            LOG_INFO("affinity:   %llu exited threads, %lld migrations, %lld involuntary switches, ran last on %s",
+                (unsigned long long) role.n_threads, (long long) role.n_migrations,
+                (long long) role.n_nonvoluntary, thread_affinity_cpus_str(&role.cpus_seen).c_str());
+        }
+    }
+
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir) {
+        return;
+    }
+
+    while (struct dirent *ent = readdir(dir)) {
+        const pid_t tid = (pid_t) atoi(ent->d_name);
+        if (tid <= 0) {
+            continue;
+        }
+
+        const char *name = "-";
+        for (const auto &rec : ta->threads) {
+            if (rec.tid == tid) {
+                name = rec.role.c_str();
+            }
+        }
+
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        sched_getaffinity(tid, sizeof(allowed), &allowed);
+
+        const int policy = sched_getscheduler(tid);
+
+        thread_stats_t st;
+        thread_affinity_stats(tid, &st);
+
+        LOG_INFO("affinity: tid %6d %-10s allowed %-8s on cpu %2d, policy %-5s, migrations %lld, involuntary switches %lld",
+            (int) tid, name, thread_affinity_cpus_str(&allowed).c_str(), st.cpu,
+            thread_affinity_policy_name(policy), (long long) st.n_migrations, (long long) st.n_nonvoluntary);
+    }
+
+    closedir(dir);
+}
+
+
+int thread_affinity_n_cpus(thread_affinity_t *ta, const char *name)
+{
+    std::lock_guard<std::mutex> lock(ta->mutex);
+
+    const thread_role_t *role = thread_affinity_find(ta, name);
+
+    return role && role->has_cpus ? CPU_COUNT(&role->cpus) : 0;
+}
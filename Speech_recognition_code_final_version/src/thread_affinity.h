@@ -0,0 +1,61 @@
+#ifndef __THREAD_AFFINITY_H__
+#define __THREAD_AFFINITY_H__
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <sys/types.h>
+
+
+// Placement of one named thread role, parsed from "ROLE=CPUS[:POLICY[:PRIO]]",
+// e.g. "inference=1-3", "pwm=0:fifo:50". CPUS is a list like "0,2-3",
+// POLICY one of other, batch, idle, fifo, rr. A role "NAME.N" that has no
+// spec of its own uses the one of NAME.
+struct thread_role_t {
+    std::string name;
+    cpu_set_t   cpus;
+    bool        has_cpus = false;
+    int         policy   = -1;      // -1 - unchanged
+    int         priority = 0;
+
+    // threads that left, see thread_affinity_leave()
+    uint64_t n_threads       = 0;
+    int64_t  n_migrations    = 0;
+    int64_t  n_nonvoluntary  = 0;
+    cpu_set_t cpus_seen;
+};
+
+
+struct thread_affinity_rec_t {
+    pid_t       tid  = 0;
+    std::string role;
+};
+
+
+struct thread_affinity_t {
+    std::mutex mutex;
+
+    std::vector<thread_role_t>         roles;
+    std::vector<thread_affinity_rec_t> threads;     // live threads that entered a role
+};
+
+
+// spec: "ROLE=CPUS[:POLICY[:PRIO]]", a role given twice is replaced
+int thread_affinity_add(thread_affinity_t *ta, const std::string &spec);
+
+// apply the role to the calling thread and track it, roles without a spec are only tracked
+int thread_affinity_enter(thread_affinity_t *ta, const char *role);
+
+// fold the calling thread's counters into its role before it exits
+void thread_affinity_leave(thread_affinity_t *ta);
+
+// allowed and last CPU, migrations and involuntary switches of every thread of the process
+void thread_affinity_report(thread_affinity_t *ta);
+
+// number of CPUs of a role, 0 if it has no CPU list
+int thread_affinity_n_cpus(thread_affinity_t *ta, const char *role);
+
+#endif //__THREAD_AFFINITY_H__
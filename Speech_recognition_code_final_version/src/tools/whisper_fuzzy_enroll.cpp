@@ -0,0 +1,334 @@
+// Command classifier and keyword template enrollment for whisper-fuzzy
+//
+// Replays a labelled corpus once with --classifier-enroll to write the
+// classifier (and with -k --kws-enroll for the keyword templates), then, with
+// -e, replays a second labelled corpus in shadow mode and compares what each
+// would have dispatched with what the full decode did, per utterance:
+// accuracy of all of them, of the stages combined, and the time to the
+// verdict against the time to the transcript. Both runs are forked children
+// calling whisper_fuzzy(), like whisper-fuzzy-bench.
+//
+#include "corpus_labels.h"
+#include "debug.h"
+#include "json.hpp"
+#include "whisper_fuzzy.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+
+struct enroll_params_t {
+    std::string user;
+    std::string model = "models/ggml-base.en.bin";
+    std::string corpus;
+    std::string labels;             // "" - labels.tsv in the first corpus directory
+    std::string eval;
+    std::string eval_labels;        // "" - labels.tsv in the first eval directory
+    std::string out = "classifier.json";
+    std::string kws;                // "" - no keyword templates
+    std::string work_dir = "enroll";
+
+    std::vector<std::string> extra;  // after --, passed to both runs
+
+    const char *program_name = nullptr;
+};
+
+
+// one row of the evaluation, per expected code and in total
+struct enroll_eval_t {
+    int    n         = 0;
+    int    n_decided = 0;
+    int    n_decoder = 0;           // the decoded command was the label
+    int    n_clf     = 0;           // the closest class was the label
+    int    n_result  = 0;           // keyword hit, else the classifier when decided, else the decoder
+    int    n_kws_hit   = 0;
+    int    n_kws_right = 0;         // hits that were the label
+    double t_verdict = 0.0;         // ms
+    double t_infer   = 0.0;         // ms
+};
+
+
+static void enroll_print_usage(const enroll_params_t &params)
+{
+    printf("\n");
+    printf("usage: %s [options] [-- whisper-fuzzy options for both runs]\n", params.program_name);
+    printf("\n");
+    printf("options:\n");
+    printf("  -h,       --help           show this help message and exit\n");
+    printf("  -u FNAME, --user FNAME     user config.json path\n");
+    printf("  -m FNAME, --model FNAME    model, the classifier only fits this one [%s]\n", params.model.c_str());
+    printf("  -r PATHS, --corpus PATHS   enrollment WAV files or directories (comma separated)\n");
+    printf("  -lb FNAME, --labels FNAME  code per enrollment file, 'name code' lines, code 'none' for no command\n");
+    printf("                             (default: labels.tsv in the first corpus directory)\n");
+    printf("  -e PATHS, --eval PATHS     held-out WAV files or directories to evaluate the classifier on\n");
+    printf("  -elb FNAME, --eval-labels FNAME  labels of the held-out files (default: labels.tsv next to them)\n");
+    printf("  -o FNAME, --out FNAME      classifier file to write [%s]\n", params.out.c_str());
+    printf("  -k FNAME, --kws FNAME      also write keyword templates (needs --step 0 after --)\n");
+    printf("  -w DIR,   --work-dir DIR   logs and JSON lines of the evaluation [%s]\n", params.work_dir.c_str());
+    printf("\n");
+}
+
+
+static bool enroll_params_parse(int argc, char const *argv[], enroll_params_t &params)
+{
+    params.program_name = argv[0];
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--") {
+            params.extra.assign(argv + i + 1, argv + argc);
+            break;
+        }
+
+        if (arg == "-h" || arg == "--help") {
+            enroll_print_usage(params);
+            exit(0);
+        }
+
+        if (i + 1 >= argc) {
+            fprintf(stderr, "error: %s needs a value\n", arg.c_str());
+            return false;
+        }
+
+        if      (arg == "-u"   || arg == "--user")        { params.user        = argv[++i]; }
+        else if (arg == "-m"   || arg == "--model")       { params.model       = argv[++i]; }
+        else if (arg == "-r"   || arg == "--corpus")      { params.corpus      = argv[++i]; }
+        else if (arg == "-lb"  || arg == "--labels")      { params.labels      = argv[++i]; }
+        else if (arg == "-e"   || arg == "--eval")        { params.eval        = argv[++i]; }
+        else if (arg == "-elb" || arg == "--eval-labels") { params.eval_labels = argv[++i]; }
+        else if (arg == "-o"   || arg == "--out")         { params.out         = argv[++i]; }
+        else if (arg == "-k"   || arg == "--kws")         { params.kws         = argv[++i]; }
+        else if (arg == "-w"   || arg == "--work-dir")    { params.work_dir    = argv[++i]; }
+        else {
+            fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    if (params.user.empty() || params.corpus.empty()) {
+        fprintf(stderr, "error: -u and -r are required\n");
+        return false;
+    }
+
+    return true;
+}
+
+
+// the commands are read back from the JSON lines
+static int enroll_callback(size_t /*leat_count*/, const char * /*text*/, const char * /*code*/, void * /*userdata*/)
+{
+    return 0;
+}
+
+
+// whisper_fuzzy() with these arguments in a child, its exit status
+static int enroll_run(const std::vector<std::string> &args)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        LOG_ERR("fork failed: %s", strerror(errno));
+        return -1;
+    }
+
+    if (pid == 0) {
+        std::vector<const char *> argv;
+        for (const auto &arg : args) {
+            argv.push_back(arg.c_str());
+        }
+        argv.push_back(nullptr);
+
+        whisper_fuzzy_t *w = whisper_fuzzy_init(argv.size() - 1, argv.data());
+        if (!w) {
+            _exit(100);
+        }
+
+        const int ret = whisper_fuzzy(w, enroll_callback, nullptr);
+
+        whisper_fuzzy_exit(w);
+
+        fflush(stdout);
+        fflush(stderr);
+        _exit(ret < 0 ? 101 : ret);
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        LOG_ERR("waitpid failed: %s", strerror(errno));
+        return -1;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+
+static void enroll_eval_add(enroll_eval_t &e, const nlohmann::json &j, const std::string &label)
+{
+    const std::string code     = j["code"].is_string() ? j["code"].get<std::string>() : "none";
+    const std::string clf_code = j["clf_code"].get<std::string>();
+    const bool        decided  = j.value("clf_decided", false);
+    const bool        kws_hit  = j.value("kws_hit", false) && j["kws_code"].is_string();
+    const std::string kws_code = kws_hit ? j["kws_code"].get<std::string>() : "";
+
+    e.n++;
+    e.n_decided += decided;
+    e.n_decoder += code == label;
+    e.n_clf     += clf_code == label;
+    e.n_result  += (kws_hit ? kws_code : decided ? clf_code : code) == label;
+
+    e.n_kws_hit   += kws_hit;
+    e.n_kws_right += kws_hit && kws_code == label;
+    e.t_verdict += j.value("clf_ms", 0.0);
+    e.t_infer   += j.value("infer_ms", 0.0);
+}
+
+
+static void enroll_eval_print(const char *name, const enroll_eval_t &e)
+{
+    if (!e.n) {
+        return;
+    }
+
+    char kws[32] = "-";
+    if (e.n_kws_hit) {
+        snprintf(kws, sizeof(kws), "%.0f%% / %.0f%%", 100.0*e.n_kws_hit/e.n, 100.0*e.n_kws_right/e.n_kws_hit);
+    }
+
+    printf("%-10s %6d %8.0f%% %8.0f%% %8.0f%% %12s %8.0f%% %10.1f %10.1f\n", name, e.n,
+        100.0*e.n_decided/e.n, 100.0*e.n_decoder/e.n, 100.0*e.n_clf/e.n, kws, 100.0*e.n_result/e.n,
+        e.t_verdict/e.n, e.t_infer/e.n);
+}
+
+
+// every utterance of a labelled file, per label
+static int enroll_eval_score(const std::string &jsonl, const std::map<std::string, std::string> &labels)
+{
+    std::ifstream file(jsonl);
+    if (!file) {
+        LOG_ERR("fail to open %s", jsonl.c_str());
+        return -1;
+    }
+
+    std::map<std::string, enroll_eval_t> rows;
+    enroll_eval_t total;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        const nlohmann::json j = nlohmann::json::parse(line, nullptr, false);
+        if (j.is_discarded() || !j["file"].is_string() || !j["clf_code"].is_string()) {
+            continue;
+        }
+
+        auto label = labels.find(corpus_labels_basename(j["file"].get<std::string>()));
+        if (label == labels.end()) {
+            continue;
+        }
+
+        enroll_eval_add(rows[label->second], j, label->second);
+        enroll_eval_add(total, j, label->second);
+    }
+
+    printf("\n%-10s %6s %9s %9s %9s %12s %9s %10s %10s\n",
+        "label", "utts", "decided", "decoder", "clf", "kws hit/ok", "combined", "verdict ms", "infer ms");
+    for (const auto &row : rows) {
+        enroll_eval_print(row.first.c_str(), row.second);
+    }
+    enroll_eval_print("total", total);
+    printf("\n");
+
+    return 0;
+}
+
+
+int main(int argc, char const *argv[])
+{
+    enroll_params_t params;
+
+    if (!enroll_params_parse(argc, argv, params)) {
+        enroll_print_usage(params);
+        return 1;
+    }
+
+    if (params.labels.empty()) {
+        params.labels = corpus_labels_default(params.corpus);
+    }
+
+    std::vector<std::string> args = {
+        "whisper-fuzzy",
+        "-u", params.user,
+        "-m", params.model,
+        "-r", params.corpus,
+        "-lb", params.labels,
+        "--classifier-enroll", params.out,
+    };
+    if (!params.kws.empty()) {
+        args.push_back("--kws-enroll");
+        args.push_back(params.kws);
+    }
+    args.insert(args.end(), params.extra.begin(), params.extra.end());
+
+    LOG_INFO("enrolling %s from %s", params.out.c_str(), params.corpus.c_str());
+
+    int ret = enroll_run(args);
+    if (ret != 0) {
+        LOG_ERR("enrollment exited with %d", ret);
+        return 1;
+    }
+
+    if (params.eval.empty()) {
+        return 0;
+    }
+
+    if (params.eval_labels.empty()) {
+        params.eval_labels = corpus_labels_default(params.eval);
+    }
+
+    std::map<std::string, std::string> labels;
+    if (corpus_labels_read(params.eval_labels, labels) < 0) {
+        return 1;
+    }
+
+    mkdir(params.work_dir.c_str(), 0755);
+
+    const std::string jsonl = params.work_dir + "/eval.jsonl";
+
+    // shadow: every utterance is decoded as well, the verdict is only recorded
+    args = {
+        "whisper-fuzzy",
+        "-u", params.user,
+        "-m", params.model,
+        "-r", params.eval,
+        "-lb", params.eval_labels,
+        "-jo", jsonl,
+        "--classifier", params.out,
+        "--classifier-shadow",
+    };
+    if (!params.kws.empty()) {
+        args.insert(args.end(), { "--kws", params.kws, "--kws-shadow" });
+    }
+    args.insert(args.end(), params.extra.begin(), params.extra.end());
+
+    LOG_INFO("evaluating on %s", params.eval.c_str());
+
+    ret = enroll_run(args);
+    if (ret != 0) {
+        LOG_ERR("evaluation exited with %d", ret);
+        return 1;
+    }
+
+    return enroll_eval_score(jsonl, labels) < 0 ? 1 : 0;
+}
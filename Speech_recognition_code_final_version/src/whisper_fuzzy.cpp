@@ -1,11 +1,19 @@
 #include "whisper.h"
 #include "debug.h"
 #include "json.hpp"
+#include <cctype>
+#include <chrono>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include "whisper_stream.h"
+#include "stream_startup.h"
+#include "stream_trace.h"
+#include "thread_affinity.h"
+#include "alloc_count.h"
 
 using json = nlohmann::json;
 
@@ -16,15 +24,42 @@ typedef struct whisper_fuzzy_t {
     whisper_callback_t callback;                       
     void *userdata;                                     
     std::unordered_map<std::string, std::string>* map;  
+    stream_trace_t *trace;
+    stream_startup_t *startup;
+    thread_affinity_t *affinity;
+    std::mutex *callback_mutex; // every stream dispatches on its own thread, the callback runs one at a time
 } whisper_fuzzy_t;
 
 
+// utterance and stream being dispatched, each stream dispatches on its own thread
+static thread_local uint64_t g_trace_current  = 0;
+static thread_local int      g_source_current = 0;
+
+
+static const char *const trace_names[WHISPER_TRACE_N] = {
+    "capture", "vad", "encode begin", "encode end", "decode end",
+    "match", "callback", "servo edge", "oled flush",
+};
+
+
 whisper_params_t *whisper_fuzzy_get_params(whisper_fuzzy_t *w)
 {
     return w ? w->params : nullptr;
 }
 
 
+stream_trace_t *whisper_fuzzy_get_trace(whisper_fuzzy_t *w)
+{
+    return w ? w->trace : nullptr;
+}
+
+
+stream_startup_t *whisper_fuzzy_get_startup(whisper_fuzzy_t *w)
+{
+    return w ? w->startup : nullptr;
+}
+
+
 static bool whisper_fuzzy_params_parse(int argc, char const* argv[], whisper_params_t & params) {
     params.program_name = argv[0];
     for (int i = 1; i < argc; i++) {
@@ -38,24 +73,68 @@ static bool whisper_fuzzy_params_parse(int argc, char const* argv[], whisper_par
         else if (                  arg == "--step")          { params.step_ms       = std::stoi(argv[++i]); }
         else if (                  arg == "--length")        { params.length_ms     = std::stoi(argv[++i]); }
         else if (                  arg == "--keep")          { params.keep_ms       = std::stoi(argv[++i]); }
-        else if (arg == "-c"    || arg == "--capture")       { params.capture_id    = std::stoi(argv[++i]); }
+        else if (arg == "-as"   || arg == "--adaptive-step") { params.adaptive_step = true; }
+        else if (                  arg == "--step-min")      { params.step_min_ms   = std::stoi(argv[++i]); }
+        else if (                  arg == "--step-max")      { params.step_max_ms   = std::stoi(argv[++i]); }
+        else if (                  arg == "--queue-target")  { params.queue_target_ms = std::stoi(argv[++i]); }
+        else if (arg == "-c"    || arg == "--capture")       { params.capture_ids.push_back(std::stoi(argv[++i])); }
+        else if (arg == "-ab"   || arg == "--audio-backend") { params.audio_backend = argv[++i]; }
+        else if (                  arg == "--alsa-device")   { params.alsa_device   = argv[++i]; }
+        else if (                  arg == "--alsa-period")   { params.alsa_period   = std::stoi(argv[++i]); }
+        else if (                  arg == "--alsa-buffer")   { params.alsa_buffer   = std::stoi(argv[++i]); }
+        else if (arg == "-np"   || arg == "--parallel")      { params.n_parallel    = std::stoi(argv[++i]); }
         else if (arg == "-d"    || arg == "--debug")         { set_dbg_enable(log_dbg_flag_t(std::stoi(argv[++i]))); }
         else if (arg == "-mt"   || arg == "--max-tokens")    { params.max_tokens    = std::stoi(argv[++i]); }
+        else if (arg == "-mtm"  || arg == "--max-tokens-margin") { params.max_tokens_margin = std::stoi(argv[++i]); }
         else if (arg == "-ac"   || arg == "--audio-ctx")     { params.audio_ctx     = std::stoi(argv[++i]); }
+        else if (arg == "-aca"  || arg == "--audio-ctx-auto")    { params.audio_ctx_auto      = true; }
+        else if (arg == "-acm"  || arg == "--audio-ctx-margin")  { params.audio_ctx_margin_ms = std::stoi(argv[++i]); }
+        else if (arg == "-acb"  || arg == "--audio-ctx-buckets") { params.audio_ctx_buckets   = argv[++i]; }
         else if (arg == "-vth"  || arg == "--vad-thold")     { params.vad_thold     = std::stof(argv[++i]); }
         else if (arg == "-fth"  || arg == "--freq-thold")    { params.freq_thold    = std::stof(argv[++i]); }
+        else if (arg == "-vf"   || arg == "--vad-frame")     { params.vad_frame_ms    = std::stoi(argv[++i]); }
+        else if (arg == "-vh"   || arg == "--vad-hangover")  { params.vad_hangover_ms = std::stoi(argv[++i]); }
+        else if (arg == "-vp"   || arg == "--vad-preroll")   { params.vad_preroll_ms  = std::stoi(argv[++i]); }
         else if (arg == "-tr"   || arg == "--translate")     { params.translate     = true; }
         else if (arg == "-nf"   || arg == "--no-fallback")   { params.no_fallback   = true; }
         else if (arg == "-ps"   || arg == "--print-special") { params.print_special = true; }
         else if (arg == "-kc"   || arg == "--keep-context")  { params.no_context    = false; }
         else if (arg == "-l"    || arg == "--language")      { params.language      = argv[++i]; }
         else if (arg == "-m"    || arg == "--model")         { params.model         = argv[++i]; }
+        else if (arg == "-mf"   || arg == "--model-fast")    { params.model_fast    = argv[++i]; }
+        else if (arg == "-ct"   || arg == "--cascade-thold") { params.cascade_thold = std::stof(argv[++i]); }
         else if (arg == "-f"    || arg == "--file")          { params.fname_out     = argv[++i]; }
+        else if (arg == "-r"    || arg == "--replay")        { params.replay.push_back(argv[++i]); }
+        else if (arg == "-rrt"  || arg == "--replay-realtime") { params.replay_realtime = true; }
+        else if (arg == "-jo"   || arg == "--json-out")      { params.json_out      = argv[++i]; }
         else if (arg == "-u"    || arg == "--user")          { params.user          = argv[++i]; }
         else if (arg == "-tdrz" || arg == "--tinydiarize")   { params.tinydiarize   = true; }
         else if (arg == "-sa"   || arg == "--save-audio")    { params.save_audio    = true; }
+        else if (                  arg == "--rotate-mb")     { params.rotate_mb     = std::stoi(argv[++i]); }
+        else if (                  arg == "--rotate-s")      { params.rotate_s      = std::stoi(argv[++i]); }
         else if (arg == "-ng"   || arg == "--no-gpu")        { params.use_gpu       = false; }
         else if (arg == "-fa"   || arg == "--flash-attn")    { params.flash_attn    = true; }
+        else if (arg == "-pw"   || arg == "--poll-wait")     { params.poll_wait     = true; }
+        else if (arg == "-af"   || arg == "--affinity")      { params.affinity.push_back(argv[++i]); }
+        else if (arg == "-ai"   || arg == "--abort-inference") { params.abort_stale = true; }
+        else if (arg == "-cd"   || arg == "--constrained")   { params.constrained   = true; }
+        else if (arg == "-ef"   || arg == "--early-fire")    { params.early_fire    = true; }
+        else if (arg == "-dd"   || arg == "--dedup")         { params.dedup         = true; }
+        else if (arg == "-dth"  || arg == "--dedup-thold")   { params.dedup_thold   = std::stof(argv[++i]); }
+        else if (                  arg == "--alloc-check")   { params.alloc_check   = true; }
+        else if (                  arg == "--no-mmap")       { params.use_mmap      = false; }
+        else if (arg == "-pf"   || arg == "--prefetch")      { params.prefetch      = true; }
+        else if (arg == "-wu"   || arg == "--warmup")        { params.warmup        = true; }
+        else if (arg == "-cls"  || arg == "--classifier")    { params.classifier    = argv[++i]; }
+        else if (                  arg == "--classifier-enroll") { params.classifier_enroll = argv[++i]; }
+        else if (                  arg == "--classifier-margin") { params.classifier_margin = std::stof(argv[++i]); }
+        else if (                  arg == "--classifier-shadow") { params.classifier_shadow = true; }
+        else if (arg == "-lb"   || arg == "--labels")        { params.labels        = argv[++i]; }
+        else if (arg == "-kws"  || arg == "--kws")           { params.kws           = argv[++i]; }
+        else if (                  arg == "--kws-enroll")    { params.kws_enroll    = argv[++i]; }
+        else if (                  arg == "--kws-thold")     { params.kws_thold     = std::stof(argv[++i]); }
+        else if (                  arg == "--kws-ratio")     { params.kws_ratio     = std::stof(argv[++i]); }
+        else if (                  arg == "--kws-shadow")    { params.kws_shadow    = true; }
 
         else {
             fprintf(stderr, "error: unknown argument: %s\n", arg.c_str());
@@ -118,16 +197,42 @@ std::string str_trim(const std::string& str)
 }
 
 
+// trimmed and lowercased into a per-thread buffer that keeps its capacity,
+// so looking up a transcript does not allocate once the buffer has grown
+static const std::string &whisper_fuzzy_key(const char *text)
+{
+    static thread_local std::string key;
+
+    const char *first = text;
+    while (*first && isspace((unsigned char) *first)) {
+        first++;
+    }
+
+    const char *last = first + strlen(first);
+    while (last > first && isspace((unsigned char) last[-1])) {
+        last--;
+    }
+
+    if (key.capacity() < 256) {
+        key.reserve(256);
+    }
+    key.assign(first, last - first);
+    to_lower(key);
+
+    return key;
+}
+
+
 const char* text_to_code(std::unordered_map<std::string, std::string>& map, const char* text)
 {
-    std::string text_lower = text;
-    to_lower(text_lower);
+    const std::string &text_lower = whisper_fuzzy_key(text);
 
-    if (map.find(text_lower) == map.end()) {
+    auto it = map.find(text_lower);
+    if (it == map.end()) {
         LOG_ERR("unknow %s ", text_lower.c_str());
         return "0x00";
     }
-    return map[text_lower].c_str();
+    return it->second.c_str();
 }
 
 
@@ -140,6 +245,9 @@ whisper_fuzzy_t* whisper_fuzzy_init(int argc, char const* argv[])
         return nullptr;
     }
     memset(w, 0, sizeof(whisper_fuzzy_t));
+
+    w->startup = new stream_startup_t;
+    stream_startup_init(w->startup);
     
     w->params = new whisper_params_t;
     if (!w->params) {
@@ -164,11 +272,40 @@ whisper_fuzzy_t* whisper_fuzzy_init(int argc, char const* argv[])
         goto _exit;
     }
 
-    ret = read_config(w->params->user.c_str(), *w->map);
-    if (ret < 0) {
-        LOG_DBG("fail to read_config");
+    {
+        const auto t_start = std::chrono::steady_clock::now();
+
+        ret = read_config(w->params->user.c_str(), *w->map);
+        if (ret < 0) {
+            LOG_DBG("fail to read_config");
+            goto _exit;
+        }
+
+        stream_startup_add(w->startup, "config", std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t_start).count(), nullptr);
+    }
+
+    w->trace = new stream_trace_t;
+    if (stream_trace_init(w->trace, WHISPER_TRACE_N, trace_names, 64) < 0) {
+        LOG_ERR("fail to init trace");
         goto _exit;
     }
+
+    w->callback_mutex = new std::mutex;
+
+    w->affinity = new thread_affinity_t;
+    for (const auto &spec : w->params->affinity) {
+        if (thread_affinity_add(w->affinity, spec) < 0) {
+            goto _exit;
+        }
+    }
+
+    {
+        const int n_cpus = thread_affinity_n_cpus(w->affinity, "inference");
+        if (n_cpus > 0 && n_cpus < w->params->n_threads) {
+            LOG_INFO("%d inference threads share %d CPUs, consider -t %d", w->params->n_threads, n_cpus, n_cpus);
+        }
+    }
     return w;
 
 _exit:
@@ -191,10 +328,140 @@ void whisper_fuzzy_exit(whisper_fuzzy_t* w)
         delete w->map;
         w->map = nullptr;
     }
+
+    if (w->trace) {
+        delete w->trace;
+        w->trace = nullptr;
+    }
+
+    if (w->affinity) {
+        delete w->affinity;
+        w->affinity = nullptr;
+    }
+
+    if (w->startup) {
+        delete w->startup;
+        w->startup = nullptr;
+    }
+
+    if (w->callback_mutex) {
+        delete w->callback_mutex;
+        w->callback_mutex = nullptr;
+    }
     free(w);
 }
 
 
+const char *whisper_fuzzy_lookup(whisper_fuzzy_t* w, const char *text)
+{
+    if (!text || !w) {
+        return nullptr;
+    }
+    auto it = w->map->find(whisper_fuzzy_key(text));
+
+    return it == w->map->end() ? nullptr : it->second.c_str();
+}
+
+
+uint64_t whisper_fuzzy_trace_current(whisper_fuzzy_t* w)
+{
+    return w ? g_trace_current : 0;
+}
+
+
+void whisper_fuzzy_trace_set_current(whisper_fuzzy_t* w, uint64_t trace_id)
+{
+    if (w) {
+        g_trace_current = trace_id;
+    }
+}
+
+
+int whisper_fuzzy_source_current(whisper_fuzzy_t* w)
+{
+    return w ? g_source_current : 0;
+}
+
+
+void whisper_fuzzy_source_set_current(whisper_fuzzy_t* w, int source)
+{
+    if (w) {
+        g_source_current = source;
+    }
+}
+
+
+int whisper_fuzzy_trace_mark(whisper_fuzzy_t* w, uint64_t trace_id, whisper_trace_stage_t stage, int64_t t)
+{
+    if (!w || !w->trace || !trace_id) {
+        return -1;
+    }
+
+    return stream_trace_mark(w->trace, trace_id, stage, t);
+}
+
+
+void whisper_fuzzy_trace_dump(whisper_fuzzy_t* w)
+{
+    if (w && w->trace) {
+        stream_trace_dump(w->trace);
+    }
+}
+
+
+int whisper_fuzzy_thread_enter(whisper_fuzzy_t* w, const char *role)
+{
+    if (!w || !w->affinity) {
+        return -1;
+    }
+
+    return thread_affinity_enter(w->affinity, role);
+}
+
+
+void whisper_fuzzy_thread_leave(whisper_fuzzy_t* w)
+{
+    if (w) {
+        thread_affinity_leave(w->affinity);
+    }
+}
+
+
+void whisper_fuzzy_thread_report(whisper_fuzzy_t* w)
+{
+    if (w) {
+        thread_affinity_report(w->affinity);
+    }
+}
+
+
+void whisper_fuzzy_startup_mark(whisper_fuzzy_t* w, const char *name, int64_t t_us)
+{
+    if (w && w->startup) {
+        stream_startup_add(w->startup, name, t_us, nullptr);
+    }
+}
+
+
+int whisper_fuzzy_foreach_alias(whisper_fuzzy_t* w, whisper_alias_callback_t callback, void *userdata)
+{
+    if (!w || !w->map || !callback) {
+        LOG_ERR("args fail!  w(%p), callback(%p)", w, callback);
+        return -1;
+    }
+
+    int n = 0;
+    for (const auto &item : *w->map) {
+        n++;
+        if (callback(item.first.c_str(), item.second.c_str(), userdata) < 0) {
+            return -1;
+        }
+    }
+
+    return n;
+}
+
+
 int whisper_fuzzy_match(whisper_fuzzy_t* w, size_t leat_count, const char *text)
 {
     if (!text || !w || !w->callback) {
@@ -202,10 +469,24 @@ int whisper_fuzzy_match(whisper_fuzzy_t* w, size_t leat_count, const char *text)
             text, w, w ? w->callback : nullptr);
         return -1;
     }
-    std::string trim_text = str_trim(text);
-    const char *code = text_to_code(*w->map, trim_text.c_str());
+    const uint64_t trace_id = g_trace_current;
+
+    whisper_fuzzy_trace_mark(w, trace_id, WHISPER_TRACE_MATCH, 0);
+
+    const char *code = text_to_code(*w->map, text);
+
+    whisper_fuzzy_trace_mark(w, trace_id, WHISPER_TRACE_CALLBACK, 0);
+
+    // what the user callback allocates is not the pipeline's
+    alloc_count_pause();
+    int ret;
+    {
+        std::lock_guard<std::mutex> lock(*w->callback_mutex);
+        ret = w->callback(leat_count, text, code, w->userdata);
+    }
+    alloc_count_resume();
 
-    return w->callback(leat_count, text, code, w->userdata);
+    return ret;
 }
 
 
@@ -11,14 +11,41 @@ extern "C" {
 
 struct whisper_fuzzy_t;
 struct whisper_params_t;
+struct stream_trace_t;
+struct stream_startup_t;
+
+
+// per-utterance trace stages, latencies are measured from WHISPER_TRACE_CAPTURE
+typedef enum {
+    WHISPER_TRACE_CAPTURE = 0,      // last sample of the utterance captured
+    WHISPER_TRACE_VAD,              // end of speech detected / window complete
+    WHISPER_TRACE_ENCODE_BEGIN,
+    WHISPER_TRACE_ENCODE_END,
+    WHISPER_TRACE_DECODE_END,
+    WHISPER_TRACE_MATCH,            // whisper_fuzzy_match() entered
+    WHISPER_TRACE_CALLBACK,         // user callback entered
+    WHISPER_TRACE_SERVO_EDGE,       // first servo pulse edge, marked by the user
+    WHISPER_TRACE_OLED_FLUSH,       // OLED frame flushed, marked by the user
+    WHISPER_TRACE_N,
+} whisper_trace_stage_t;
 
 
 typedef int (*whisper_callback_t)(size_t leat_count, const char *text, const char* code, void* userdata);
 
 
+// return < 0 to stop the iteration
+typedef int (*whisper_alias_callback_t)(const char *text, const char *code, void *userdata);
+
+
 whisper_params_t *whisper_fuzzy_get_params(whisper_fuzzy_t *w);
 
 
+stream_trace_t *whisper_fuzzy_get_trace(whisper_fuzzy_t *w);
+
+
+stream_startup_t *whisper_fuzzy_get_startup(whisper_fuzzy_t *w);
+
+
 whisper_fuzzy_t* whisper_fuzzy_init(int argc, char const* argv[]);
 
 
@@ -31,6 +58,54 @@ int whisper_fuzzy(whisper_fuzzy_t* w, whisper_callback_t callback, void* userdat
 int whisper_fuzzy_match(whisper_fuzzy_t* w, size_t leat_count, const char *text);
 
 
+// code of the command text matches, nullptr if it is not a command; does not dispatch
+const char *whisper_fuzzy_lookup(whisper_fuzzy_t* w, const char *text);
+
+
+// trace id of the utterance being dispatched, valid inside the callback, 0 otherwise
+uint64_t whisper_fuzzy_trace_current(whisper_fuzzy_t* w);
+
+
+void whisper_fuzzy_trace_set_current(whisper_fuzzy_t* w, uint64_t trace_id);
+
+
+// audio source (-c / -r, in the order given) of the command being dispatched, valid inside the callback;
+// with several sources the callback is called from one thread per source, never concurrently
+int whisper_fuzzy_source_current(whisper_fuzzy_t* w);
+
+
+void whisper_fuzzy_source_set_current(whisper_fuzzy_t* w, int source);
+
+
+// record a stage of a traced utterance at t (steady clock ns, 0 - now), only the first mark of a stage counts
+int whisper_fuzzy_trace_mark(whisper_fuzzy_t* w, uint64_t trace_id, whisper_trace_stage_t stage, int64_t t);
+
+
+// latency histograms of every stage, through LOG_INFO
+void whisper_fuzzy_trace_dump(whisper_fuzzy_t* w);
+
+
+// apply the --affinity placement of role to the calling thread and track it for the report
+int whisper_fuzzy_thread_enter(whisper_fuzzy_t* w, const char *role);
+
+
+// call before a thread that entered a role exits
+void whisper_fuzzy_thread_leave(whisper_fuzzy_t* w);
+
+
+// placement, migrations and involuntary switches of every thread, through LOG_INFO
+void whisper_fuzzy_thread_report(whisper_fuzzy_t* w);
+
+
+// add a startup phase timed by the user, e.g. the OLED and GPIO init, before whisper_fuzzy();
+// name must stay valid, the phases are reported once the pipeline is ready
+void whisper_fuzzy_startup_mark(whisper_fuzzy_t* w, const char *name, int64_t t_us);
+
+
+// every configured alias (lowercased) with its code, returns the number visited, -1 if the callback failed
+int whisper_fuzzy_foreach_alias(whisper_fuzzy_t* w, whisper_alias_callback_t callback, void *userdata);
+
+
 #ifdef __cplusplus
 }
 #endif
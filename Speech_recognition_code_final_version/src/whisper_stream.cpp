@@ -1,19 +1,39 @@
-// Real-time speech recognition of input from a microphone
+// Real-time speech recognition of input from a microphone or replayed recordings
 //
-// A very quick-n-dirty implementation serving mainly as a proof of concept.
+// Capture/VAD, inference and dispatch run on their own threads and hand
+// utterances over through bounded queues, so neither a long whisper_full nor a
+// slow servo callback stops the microphone audio from being consumed.
 //
+// Every audio source (-c, -r) is one such pipeline with its own whisper_state;
+// the model is loaded once and shared, and a stream_pool_t shares the CPUs.
+//
+// This file sets the model and the streams up, runs their stages and reports
+// on them. The stages live in
+// whisper_stream_capture.cpp, whisper_stream_inference.cpp and
+// whisper_stream_dispatch.cpp, the shared model in whisper_stream_model.cpp,
+// and the state they share in whisper_stream_pipeline.h.
+//
+#ifdef WHISPER_FUZZY_SDL
 #include "common-sdl.h"
+#endif
 #include "common.h"
 #include "whisper.h"
 #include "whisper_stream.h"
+#include "whisper_stream_pipeline.h"
+#include "alloc_count.h"
+#include "audio_dsp.h"
 #include "debug.h"
 
-#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <cstdio>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
-#include <fstream>
+
+#include <sys/resource.h>
 
 
 
@@ -28,13 +48,29 @@ void whisper_print_usage(const whisper_params_t & params) {
     printf("            --step N        [%-7d] audio step size in milliseconds\n",                params.step_ms);
     printf("            --length N      [%-7d] audio length in milliseconds\n",                   params.length_ms);
     printf("            --keep N        [%-7d] audio to keep from previous step in ms\n",         params.keep_ms);
-    printf("  -c ID,    --capture ID    [%-7d] capture device ID\n",                              params.capture_id);
+    printf("  -as,      --adaptive-step [%-7s] follow the inference speed with the step\n",       params.adaptive_step ? "true" : "false");
+    printf("            --step-min N    [%-7d] smallest -as step in ms (0 - step/4, at least 100)\n", params.step_min_ms);
+    printf("            --step-max N    [%-7d] largest -as step in ms (0 - length)\n",            params.step_max_ms);
+    printf("            --queue-target N [%-6d] -as backs off while windows wait longer than this in ms\n", params.queue_target_ms);
+    printf("  -c ID,    --capture ID             capture device ID, repeat to recognize several microphones\n");
+    printf("  -ab NAME, --audio-backend NAME     microphone through sdl or alsa (default: sdl when built with it)\n");
+    printf("            --alsa-device NAME [%-4s] ALSA device without -c, -c ID opens plughw:ID\n", params.alsa_device.c_str());
+    printf("            --alsa-period N [%-7d] ALSA period in frames\n",                           params.alsa_period);
+    printf("            --alsa-buffer N [%-7d] ALSA buffer in frames (0 - 4 periods)\n",           params.alsa_buffer);
+    printf("  -np N,    --parallel N    [%-7d] inferences running at a time over every stream (0 - one per stream)\n", params.n_parallel);
     printf("  -d N,     --debug N       [%-7d] debug flag, ERR(%d), INFO(%d), DBG(%d) \n",        get_dbg_enable(),
         log_dbg_flag_t::LOG_ERR_FLAG, log_dbg_flag_t::LOG_INFO_FLAG, log_dbg_flag_t::LOG_DBG_FLAG);
-    printf("  -mt N,    --max-tokens N  [%-7d] maximum number of tokens per audio chunk\n",       params.max_tokens);
+    printf("  -mt N,    --max-tokens N  [%-7d] maximum number of tokens per decode (-1 - longest command + -mtm, 0 - no limit)\n", params.max_tokens);
+    printf("  -mtm N,   --max-tokens-margin N [%-2d] tokens allowed beyond the longest command for -mt -1\n", params.max_tokens_margin);
     printf("  -ac N,    --audio-ctx N   [%-7d] audio context size (0 - all)\n",                   params.audio_ctx);
-    printf("  -vth N,   --vad-thold N   [%-7.2f] voice activity detection threshold\n",           params.vad_thold);
+    printf("  -aca,     --audio-ctx-auto [%-4s] size the audio context to every utterance\n",     params.audio_ctx_auto ? "true" : "false");
+    printf("  -acm N,   --audio-ctx-margin N [%-4d] audio context margin in ms for -aca\n",    params.audio_ctx_margin_ms);
+    printf("  -acb L,   --audio-ctx-buckets L    round the -aca context up to one of these sizes, e.g. 256,512,768\n");
+    printf("  -vth N,   --vad-thold N   [%-7.2f] voice activity detection threshold (noise/speech amplitude)\n", params.vad_thold);
     printf("  -fth N,   --freq-thold N  [%-7.2f] high-pass frequency cutoff\n",                   params.freq_thold);
+    printf("  -vf N,    --vad-frame N   [%-7d] VAD frame length in milliseconds (10 - 30)\n",       params.vad_frame_ms);
+    printf("  -vh N,    --vad-hangover N [%-6d] silence in milliseconds that ends an utterance\n",  params.vad_hangover_ms);
+    printf("  -vp N,    --vad-preroll N [%-7d] audio in milliseconds kept before the speech onset\n", params.vad_preroll_ms);
     printf("  -tr,      --translate     [%-7s] translate from source language to english\n",      params.translate ? "true" : "false");
     printf("  -nf,      --no-fallback   [%-7s] do not use temperature fallback while decoding\n", params.no_fallback ? "true" : "false");
     printf("  -ps,      --print-special [%-7s] print special tokens\n",                           params.print_special ? "true" : "false");
@@ -44,49 +80,449 @@ void whisper_print_usage(const whisper_params_t & params) {
     printf("  -f FNAME, --file FNAME    [%-7s] text output file name\n",                          params.fname_out.c_str());
     printf("  -tdrz,    --tinydiarize   [%-7s] enable tinydiarize (requires a tdrz model)\n",     params.tinydiarize ? "true" : "false");
     printf("  -sa,      --save-audio    [%-7s] save the recorded audio to a file\n",              params.save_audio ? "true" : "false");
+    printf("            --rotate-mb N   [%-7d] start new -sa/-f files after N MB (0 - never)\n",  params.rotate_mb);
+    printf("            --rotate-s N    [%-7d] start new -sa/-f files after N seconds (0 - never)\n", params.rotate_s);
     printf("  -ng,      --no-gpu        [%-7s] disable GPU inference\n",                          params.use_gpu ? "false" : "true");
     printf("  -fa,      --flash-attn    [%-7s] flash attention during inference\n",               params.flash_attn ? "true" : "false");
+    printf("  -ai,      --abort-inference [%-5s] abort a running inference when a newer utterance is queued\n", params.abort_stale ? "true" : "false");
+    printf("  -cd,      --constrained   [%-7s] only decode the commands from the config file\n", params.constrained ? "true" : "false");
+    printf("  -ef,      --early-fire    [%-7s] dispatch a command as soon as the partial transcript is one\n", params.early_fire ? "true" : "false");
+    printf("  -dd,      --dedup         [%-7s] sliding mode: dispatch a command heard again in the next windows once\n", params.dedup ? "true" : "false");
+    printf("  -dth N,   --dedup-thold N [%-7.2f] transcripts this similar are the same words for -dd\n", params.dedup_thold);
+    printf("  -mf FNAME, --model-fast FNAME [%-3s] cascade: run this model first, the main model only on a miss\n", params.model_fast.c_str());
+    printf("  -ct N,    --cascade-thold N [%-5.2f] cascade: lowest token probability accepted from the fast model\n", params.cascade_thold);
+    printf("  -r PATHS, --replay PATHS           replay WAV files or directories (comma separated) instead of the microphone,\n");
+    printf("                                     repeat for one stream each\n");
+    printf("  -rrt,     --replay-realtime [%-3s] replay at the capture rate instead of as fast as possible\n", params.replay_realtime ? "true" : "false");
+    printf("  -jo FNAME, --json-out FNAME [%-3s] write one JSON line per utterance\n", params.json_out.c_str());
+    printf("  -af SPEC, --affinity SPEC          pin a thread role, ROLE=CPUS[:POLICY[:PRIO]], e.g. inference=1-3, repeatable\n");
+    printf("                                     roles: audio, capture, inference, dispatch, recorder, pwm;\n");
+    printf("                                     with several streams ROLE.N applies to stream N only\n");
+    printf("  -pw,      --poll-wait     [%-7s] poll for audio every 1 ms instead of waiting on an eventfd\n", params.poll_wait ? "true" : "false");
+    printf("            --alloc-check   [%-7s] report heap allocations of the pipeline after the warm-up, fail on any\n", params.alloc_check ? "true" : "false");
+    printf("            --no-mmap       [%-7s] let whisper.cpp read the model instead of mapping it\n", params.use_mmap ? "false" : "true");
+    printf("  -pf,      --prefetch      [%-7s] read the mapped model into the page cache while the rest starts up\n", params.prefetch ? "true" : "false");
+    printf("  -wu,      --warmup        [%-7s] run one inference on silence before listening\n", params.warmup ? "true" : "false");
+    printf("  -cls FNAME, --classifier FNAME [%-3s] decide commands from the first decoder step, decode only when unsure\n", params.classifier.c_str());
+    printf("            --classifier-enroll FNAME    enroll a classifier from the labelled -r files and write it here\n");
+    printf("            --classifier-margin N [%-5.2f] lead over the runner-up class needed to skip decoding (0 - from the file)\n", params.classifier_margin);
+    printf("            --classifier-shadow [%-3s] decode everything, only report what the classifier would have done\n", params.classifier_shadow ? "true" : "false");
+    printf("  -kws FNAME, --kws FNAME   [%-3s] VAD mode: match MFCC templates first, whisper_full only when unsure\n", params.kws.c_str());
+    printf("            --kws-enroll FNAME           enroll keyword templates from the labelled -r files and write them here\n");
+    printf("            --kws-thold N [%-7.2f] largest DTW distance of a hit (0 - from the file)\n", params.kws_thold);
+    printf("            --kws-ratio N [%-7.2f] the next code must be this much farther (0 - from the file)\n", params.kws_ratio);
+    printf("            --kws-shadow  [%-7s] decode everything, only report what keyword spotting would have done\n", params.kws_shadow ? "true" : "false");
+    printf("  -lb FNAME, --labels FNAME [%-3s] 'name code' lines for the -r files, default labels.tsv next to them\n", params.labels.c_str());
     printf("\n");
 }
 
 
-int whisper_stream_main(whisper_fuzzy_t *whisper_fuzzy_ctx) {
-    if (!whisper_fuzzy_ctx) {
-        LOG_ERR("whisper_fuzzy_ctx null");
-        return -1;
+
+// utterances every stage handles before its allocations are checked, buffers grow meanwhile
+static const uint64_t k_alloc_warmup = 4;
+
+
+static const char *const k_stage_names[WHISPER_STAGE_N] = { "capture", "inference", "dispatch" };
+
+
+// kill -USR1 <pid> dumps the latency histograms
+static volatile sig_atomic_t g_trace_dump = 0;
+
+static void whisper_stream_sigusr1(int /*sig*/)
+{
+    g_trace_dump = 1;
+}
+
+
+// Ctrl + C without SDL, which otherwise turns it into SDL_QUIT
+static volatile sig_atomic_t g_quit = 0;
+
+static void whisper_stream_sigint(int /*sig*/)
+{
+    g_quit = 1;
+}
+
+
+int64_t whisper_stream_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// "capture" with a single stream, "capture.1" for the second of several
+void whisper_stream_thread_enter(whisper_stream_t *s, const char *role)
+{
+    if (s->n_streams <= 1) {
+        whisper_fuzzy_thread_enter(s->fuzzy, role);
+        return;
     }
-    whisper_params_t *params_tmp = whisper_fuzzy_get_params(whisper_fuzzy_ctx);
-    if (!params_tmp) {
-        LOG_ERR("fail to get params\n");
+
+    char name[32];
+    snprintf(name, sizeof(name), "%s.%d", role, s->index);
+
+    whisper_fuzzy_thread_enter(s->fuzzy, name);
+}
+
+
+// allocations of a stage since its previous call, made at the top of every iteration;
+// after the warm-up each one means the steady state is no longer allocation free
+void whisper_stream_alloc_account(whisper_stream_t *s, whisper_stage_t stage)
+{
+    whisper_alloc_stats_t &st = s->alloc[stage];
+
+    const uint64_t n_now = alloc_count_thread();
+    const uint64_t n     = n_now - st.n_last;
+
+    st.n_last = n_now;
+
+    if (!s->use_alloc_check || st.n_done <= k_alloc_warmup) {
+        return;
+    }
+
+    st.n_iter++;
+
+    if (!n) {
+        return;
+    }
+
+    st.n_alloc += n;
+    if (!st.n_bad++) {
+        LOG_ERR("%s: %llu heap allocations in a steady-state iteration, later ones are only counted",
+            k_stage_names[stage], (unsigned long long) n);
+    }
+}
+
+
+// the replayed file u was cut from, by its middle; the pre-roll may reach back into the gap before it
+const audio_replay_file_t *whisper_stream_replay_file(const whisper_stream_t *s, const whisper_utterance_t *u)
+{
+    return s->use_replay ? audio_replay_file_at(&s->replay, u->pcmf32.pos + u->pcmf32.n/2) : nullptr;
+}
+
+
+static void whisper_stream_recorder_thread(void *userdata)
+{
+    whisper_stream_thread_enter((whisper_stream_t *)userdata, "recorder");
+}
+
+
+// -as with its bounds, from the command line
+static stream_sched_params_t whisper_stream_sched_params(const whisper_params_t &params)
+{
+    stream_sched_params_t sched_params;
+
+    sched_params.step_ms         = params.step_ms;
+    sched_params.step_min_ms     = params.step_min_ms;
+    sched_params.step_max_ms     = params.step_max_ms;
+    sched_params.length_ms       = params.length_ms;
+    sched_params.keep_ms         = params.keep_ms;
+    sched_params.queue_target_ms = params.queue_target_ms;
+
+    return sched_params;
+}
+
+
+static void whisper_stream_print_stats(whisper_stream_t *s, double t_sec)
+{
+    whisper_params_t &params = *s->params;
+
+    const whisper_capture_stats_t   &sc = s->st_capture;
+    const whisper_inference_stats_t &si = s->st_inference;
+
+    if (s->n_streams > 1) {
+        if (s->replay_paths.empty()) {
+            LOG_INFO("stream %d: capture device %d", s->index, s->capture_id);
+        } else {
+            LOG_INFO("stream %d: replay %s", s->index, s->replay_paths.c_str());
+        }
+    }
+
+    LOG_INFO("capture:   ring fill max %.1f ms of %.1f s, overruns %llu (%llu samples dropped)",
+        sc.ring_fill_max*1000.0/WHISPER_SAMPLE_RATE, s->ring.capacity*1.0/WHISPER_SAMPLE_RATE,
+        (unsigned long long) s->ring.n_overruns.load(), (unsigned long long) s->ring.n_dropped.load());
+
+    if (sc.n_slot_waits || sc.n_catchup) {
+        LOG_INFO("capture:   waited for a free slot %llu times (%.1f ms in all, longest %.1f ms), %llu windows caught up",
+            (unsigned long long) sc.n_slot_waits, sc.t_slot_wait*1e-6, sc.t_slot_wait_max*1e-6,
+            (unsigned long long) sc.n_catchup);
+    }
+
+    LOG_INFO("capture:   %llu wakeups waiting for audio in %.1f s (%.1f/s, %s)",
+        (unsigned long long) sc.n_wakeups, t_sec, t_sec > 0 ? sc.n_wakeups/t_sec : 0.0,
+        params.poll_wait ? "1 ms polling" : "eventfd");
+
+#ifdef WHISPER_FUZZY_ALSA
+    if (s->use_alsa) {
+        LOG_INFO("capture:   ALSA %s, period %d frames, buffer %d frames, %llu xruns, %llu suspends, ~%llu samples missing",
+            s->alsa.params.device.c_str(), s->alsa.period_frames, s->alsa.buffer_frames,
+            (unsigned long long) s->alsa.n_xruns.load(), (unsigned long long) s->alsa.n_suspends.load(),
+            (unsigned long long) audio_alsa_missing(&s->alsa));
+        LOG_INFO("capture:   ALSA device buffer fill max %.1f ms",
+            s->alsa.avail_max*1000.0/WHISPER_SAMPLE_RATE);
+    }
+#endif
+
+    stream_queue_stats_t stats;
+
+    stream_queue_stats(&s->q_infer, &stats);
+    LOG_INFO("inference: %llu queued, depth avg %.2f max %zu",
+        (unsigned long long) stats.n_push, stats.depth_avg, stats.depth_max);
+
+    LOG_INFO("inference: %llu completed (avg %.1f ms estimated thread-time), %llu aborted "
+        "(%.1f ms estimated thread-time spent, %.1f ms estimated thread-time saved)",
+        (unsigned long long) si.n_completed, si.n_completed ? si.t_thread_completed*1e-6/si.n_completed : 0.0,
+        (unsigned long long) si.n_aborted, si.t_thread_aborted*1e-6, si.t_thread_saved*1e-6);
+
+    stream_budget_print_stats(&s->budget, si.n_completed);
+
+    if (si.n_completed) {
+        const double t_audio = si.n_samples_done*1.0/WHISPER_SAMPLE_RATE;
+
+        LOG_INFO("inference: %.1f s of audio in %.1f s of inference (rtf %.2f), %.2f s of audio per second",
+            t_audio, si.t_infer_sum*1e-9, si.t_infer_sum > 0 ? si.t_infer_sum*1e-9/t_audio : 0.0,
+            t_sec > 0 ? t_audio/t_sec : 0.0);
+    }
+
+    stream_cascade_print_stats(&s->cascade);
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        LOG_INFO("inference: peak RSS %.1f MB", usage.ru_maxrss/1024.0);
+    }
+
+    if (si.n_endpoint) {
+        LOG_INFO("inference: end-of-speech to inference start avg %.2f ms, max %.2f ms over %llu utterances",
+            si.t_endpoint_sum*1e-3/si.n_endpoint, si.t_endpoint_max*1e-3, (unsigned long long) si.n_endpoint);
+    }
+
+    stream_queue_stats(&s->q_dispatch, &stats);
+    LOG_INFO("dispatch:  %llu queued, depth avg %.2f max %zu",
+        (unsigned long long) stats.n_push, stats.depth_avg, stats.depth_max);
+
+    if (s->use_dedup) {
+        LOG_INFO("dispatch:  %llu of %llu commands suppressed as repeats from overlapping windows",
+            (unsigned long long) s->dedup.n_suppressed, (unsigned long long) s->dedup.n_checked);
+    }
+
+    if (params.early_fire) {
+        stream_early_print_stats(&s->early);
+    }
+
+    if (s->use_alloc_check) {
+        for (int i = 0; i < WHISPER_STAGE_N; i++) {
+            const whisper_alloc_stats_t &st = s->alloc[i];
+
+            LOG_INFO("alloc:     %-9s %llu steady-state iterations, %llu allocated (%llu allocations)",
+                k_stage_names[i], (unsigned long long) st.n_iter, (unsigned long long) st.n_bad,
+                (unsigned long long) st.n_alloc);
+        }
+    }
+
+    {
+        size_t   used_max    = s->arena_dispatch.used_max;
+        uint64_t n_overflows = s->arena_dispatch.n_overflows;
+
+        for (const auto &u : s->utterances) {
+            used_max     = std::max(used_max, u.arena.used_max);
+            n_overflows += u.arena.n_overflows;
+        }
+
+        if (n_overflows) {
+            LOG_INFO("dispatch:  %llu strings truncated, an utterance needed up to %zu of %zu arena bytes",
+                (unsigned long long) n_overflows, used_max, k_arena_size);
+        }
+    }
+
+    if (s->model->use_kws) {
+        whisper_stream_kws_print_stats(s);
+    }
+
+    if (s->model->use_clf) {
+        whisper_stream_clf_print_stats(s);
+    }
+
+    for (size_t i = 0; i < s->ctx_stats.size(); i++) {
+        const whisper_ctx_stats_t &cs = s->ctx_stats[i];
+        if (!cs.n_runs) {
+            continue;
+        }
+
+        LOG_INFO("audio_ctx: %4zu frames, %llu runs, encode avg %.1f ms, %llu matched a command (%.0f%%)",
+            i, (unsigned long long) cs.n_runs, cs.t_encode*1e-6/cs.n_runs,
+            (unsigned long long) cs.n_matched, 100.0*cs.n_matched/cs.n_runs);
+    }
+}
+
+
+// everything else of one stream, once the model is loaded and its state made
+static int whisper_stream_init(whisper_stream_t *s)
+{
+    whisper_params_t &params = *s->params;
+
+    const whisper_model_t *m = s->model;
+
+    const stream_sched_params_t sched_params = whisper_stream_sched_params(params);
+
+    stream_sched_init(&s->sched, &sched_params, params.adaptive_step && !s->use_vad);
+    stream_cascade_init(&s->cascade, params.cascade_thold);
+    stream_budget_init(&s->budget, params.max_tokens);
+
+    s->ctx_stats.resize(m->n_audio_ctx + 1);
+
+    if (m->use_trie) {
+        s->decode.logits_keep.reserve(m->n_keep);
+    }
+
+    s->clf.features.resize(m->clf.tokens.size());
+
+    if (params.dedup && !s->use_vad) {
+        stream_dedup_params_t dedup_params;
+
+        dedup_params.sample_rate = WHISPER_SAMPLE_RATE;
+        dedup_params.sim_thold   = params.dedup_thold;
+
+        if (stream_dedup_init(&s->dedup, &dedup_params) < 0) {
+            return -1;
+        }
+        s->use_dedup = true;
+    }
+
+    if (s->use_vad) {
+        stream_vad_params_t vad_params;
+
+        vad_params.sample_rate   = WHISPER_SAMPLE_RATE;
+        vad_params.frame_ms      = params.vad_frame_ms;
+        vad_params.hangover_ms   = params.vad_hangover_ms;
+        vad_params.max_speech_ms = params.length_ms;
+        vad_params.preroll_ms    = params.vad_preroll_ms;
+        vad_params.vad_thold     = params.vad_thold;
+        vad_params.freq_thold    = params.freq_thold;
+
+        if (stream_vad_init(&s->vad, &vad_params) < 0) {
+            LOG_ERR("%s: stream_vad_init() failed!\n", __func__);
+            return -1;
+        }
+    }
+
+    if ((m->use_kws || m->kws_enroll) && whisper_stream_kws_init(s) < 0) {
         return -1;
     }
-    whisper_params_t &params = *params_tmp;
 
-    params.keep_ms   = std::min(params.keep_ms,   params.step_ms);
-    params.length_ms = std::max(params.length_ms, params.step_ms);
+    stream_queue_init(&s->q_free,     k_n_utterances);
+    stream_queue_init(&s->q_infer,    k_n_utterances);
+    stream_queue_init(&s->q_dispatch, 2*k_n_utterances);
 
-    const int n_samples_step = (1e-3*params.step_ms  )*WHISPER_SAMPLE_RATE;
-    const int n_samples_len  = (1e-3*params.length_ms)*WHISPER_SAMPLE_RATE;
-    const int n_samples_keep = (1e-3*params.keep_ms  )*WHISPER_SAMPLE_RATE;
-    const int n_samples_30s  = (1e-3*30000.0         )*WHISPER_SAMPLE_RATE;
+    // every string of the steady state lives in these, see stream_arena_t
+    stream_arena_init(&s->arena_dispatch, k_arena_size);
 
-    const bool use_vad = n_samples_step <= 0; // sliding window mode uses VAD
+    for (auto &u : s->utterances) {
+        stream_arena_init(&u.arena, k_arena_size);
+        u.segments.reserve(8);
 
-    const int n_new_line = !use_vad ? std::max(1, params.length_ms / params.step_ms - 1) : 1; // number of steps to print new line
+        stream_queue_push(&s->q_free, &u);
+    }
 
-    params.no_timestamps  = !use_vad;
-    params.no_context    |= use_vad;
-    params.max_tokens     = 0;
+    s->use_alloc_check = params.alloc_check && alloc_count_enabled();
 
-    // init audio
+    // audio to <date>.wav, transcript to -f; the second stream gets -s1 and so on
+    if (params.save_audio || params.fname_out.length() > 0) {
+        stream_recorder_params_t rec_params;
 
-    audio_async audio(params.length_ms);
-    if (!audio.init(params.capture_id, WHISPER_SAMPLE_RATE)) {
-        LOG_ERR("%s: audio.init() failed!\n", __func__);
-        return 1;
+        rec_params.sample_rate = WHISPER_SAMPLE_RATE;
+        rec_params.save_audio  = params.save_audio;
+        rec_params.text_path   = params.fname_out;
+        rec_params.tag         = s->index ? "-s" + std::to_string(s->index) : "";
+        rec_params.rotate_mb   = params.rotate_mb;
+        rec_params.rotate_s    = params.rotate_s;
+
+        s->rec.on_thread_userdata = s;
+        s->rec.on_thread          = whisper_stream_recorder_thread;
+
+        if (stream_recorder_init(&s->rec, &rec_params) < 0) {
+            LOG_ERR("%s: failed to open the output files\n", __func__);
+            return -1;
+        }
+        s->use_recorder = true;
+    }
+
+    if (params.early_fire) {
+        // the final transcript only confirms the early command, unless something records or compares it
+        const bool abort = !s->use_dedup && params.fname_out.empty() && params.json_out.empty() &&
+            !m->clf_enroll && !params.classifier_shadow && !params.kws_shadow;
+
+        if (stream_early_init(&s->early, s->fuzzy, abort) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void whisper_stream_free(whisper_stream_t *s)
+{
+    if (s->use_recorder) {
+        stream_recorder_free(&s->rec);
     }
 
-    audio.resume();
+    audio_replay_free(&s->replay);
+    whisper_stream_free_mic(s);
+    audio_ring_free(&s->ring);
+
+    if (s->state_fast) {
+        whisper_free_state(s->state_fast);
+        s->state_fast = nullptr;
+    }
+
+    if (s->state) {
+        whisper_free_state(s->state);
+        s->state = nullptr;
+    }
+}
+
+
+// the model once, then a state and the pipeline of every stream
+static int whisper_stream_setup(whisper_model_t *m, std::vector<std::unique_ptr<whisper_stream_t>> &streams,
+    whisper_jout_t *jout)
+{
+    whisper_stream_t *s0 = streams[0].get();
+
+    whisper_params_t &params = *s0->params;
+    stream_startup_t *startup = s0->startup;
+
+    // map the models first, with -pf they are read from disk while the audio starts
+    if (params.use_mmap) {
+        const int64_t t_start = whisper_stream_now();
+
+        // a model that cannot be mapped is read by whisper.cpp, which reports the error
+        model_mmap_open(&m->model_map[0], params.model.c_str(), params.prefetch);
+        if (!params.model_fast.empty()) {
+            model_mmap_open(&m->model_map[1], params.model_fast.c_str(), params.prefetch);
+        }
+
+        stream_startup_add(startup, "model map", (whisper_stream_now() - t_start)/1000, nullptr);
+    }
+
+    // init audio
+    {
+        const int64_t t_audio = whisper_stream_now();
+
+        for (auto &s : streams) {
+            if (whisper_stream_open_audio(s.get()) < 0) {
+                return -1;
+            }
+        }
+
+        char note[64];
+        if (streams.size() > 1) {
+            snprintf(note, sizeof(note), "%zu streams", streams.size());
+        } else {
+            snprintf(note, sizeof(note), "%s", s0->use_replay ? "replay" : "");
+        }
+
+        stream_startup_add(startup, "audio init", (whisper_stream_now() - t_audio)/1000, note[0] ? note : nullptr);
+    }
 
     // whisper init
     if (params.language != "auto" && whisper_lang_id(params.language.c_str()) == -1){
@@ -100,18 +536,125 @@ int whisper_stream_main(whisper_fuzzy_t *whisper_fuzzy_ctx) {
     cparams.use_gpu    = params.use_gpu;
     cparams.flash_attn = params.flash_attn;
 
-    struct whisper_context * ctx = whisper_init_from_file_with_params(params.model.c_str(), cparams);
+    m->ctx = whisper_stream_load(m, startup, 0, params.model.c_str(), cparams, params.prefetch);
+    if (!m->ctx) {
+        LOG_ERR("%s: failed to load model '%s'\n", __func__, params.model.c_str());
+        return -1;
+    }
+
+    if (!params.model_fast.empty()) {
+        m->ctx_fast = whisper_stream_load(m, startup, 1, params.model_fast.c_str(), cparams, params.prefetch);
+        if (!m->ctx_fast) {
+            LOG_ERR("%s: failed to load model '%s'\n", __func__, params.model_fast.c_str());
+            return -1;
+        }
+    }
+
+    // compute graphs and buffers, the only per-stream memory the model needs
+    {
+        const int64_t t_start = whisper_stream_now();
+
+        for (auto &s : streams) {
+            s->state = whisper_init_state(m->ctx);
+            if (m->ctx_fast) {
+                s->state_fast = whisper_init_state(m->ctx_fast);
+            }
+
+            if (!s->state || (m->ctx_fast && !s->state_fast)) {
+                LOG_ERR("%s: failed to create the whisper state of stream %d\n", __func__, s->index);
+                return -1;
+            }
+        }
+
+        char note[64];
+        snprintf(note, sizeof(note), "%zu state%s", streams.size(), streams.size() > 1 ? "s" : "");
+
+        stream_startup_add(startup, "graph build", (whisper_stream_now() - t_start)/1000, note);
+    }
+
+    if (params.warmup) {
+        const int64_t t_start = whisper_stream_now();
+
+        for (auto &s : streams) {
+            whisper_stream_warmup(params, m->ctx, s->state);
+            if (m->ctx_fast) {
+                whisper_stream_warmup(params, m->ctx_fast, s->state_fast);
+            }
+        }
+
+        stream_startup_add(startup, "first inference", (whisper_stream_now() - t_start)/1000, nullptr);
+    }
+
+    m->n_audio_ctx        = whisper_model_n_audio_ctx(m->ctx);
+    m->n_audio_ctx_margin = std::max(0, params.audio_ctx_margin_ms)/20;
+
+    if (params.audio_ctx_auto &&
+        whisper_stream_parse_buckets(params.audio_ctx_buckets, m->n_audio_ctx, m->audio_ctx_buckets) < 0) {
+        return -1;
+    }
+
+    const bool use_clf = !params.classifier.empty() || !params.classifier_enroll.empty();
+    const bool use_kws = !params.kws.empty() || !params.kws_enroll.empty();
+
+    if ((!params.classifier_enroll.empty() || !params.kws_enroll.empty()) && params.replay.empty()) {
+        LOG_ERR("%s: enrollment needs labelled recordings through -r\n", __func__);
+        return -1;
+    }
+
+    // the templates are matched against what the VAD cut out
+    if (use_kws && !s0->use_vad) {
+        LOG_ERR("%s: keyword spotting needs the VAD, --step 0\n", __func__);
+        return -1;
+    }
+
+    if (whisper_stream_labels(m, params) < 0) {
+        return -1;
+    }
+
+    if (use_kws && whisper_stream_kws_setup(m, s0->fuzzy, params) < 0) {
+        return -1;
+    }
+
+    // the classifier's features are the command tokens too, and they size the token budget
+    if ((params.constrained || use_clf || params.max_tokens < 0) && whisper_stream_build_trie(m, s0->fuzzy) < 0) {
+        if (params.constrained || use_clf) {
+            return -1;
+        }
+        m->trie.max_depth = 0;
+    }
+
+    m->use_trie = params.constrained;
+
+    if (params.max_tokens < 0) {
+        params.max_tokens = stream_budget_size(m->trie.max_depth, params.max_tokens_margin, m->use_trie);
+    }
+
+    if (use_clf && whisper_stream_clf_setup(m, s0->fuzzy, params) < 0) {
+        return -1;
+    }
+
+    if (params.alloc_check && !alloc_count_enabled()) {
+        LOG_ERR("%s: --alloc-check needs a build with WHISPER_FUZZY_ALLOC_COUNT, ignored\n", __func__);
+    }
 
-    std::vector<float> pcmf32    (n_samples_30s, 0.0f);
-    std::vector<float> pcmf32_old;
-    std::vector<float> pcmf32_new(n_samples_30s, 0.0f);
+    if (params.json_out.length() > 0) {
+        jout->out.open(params.json_out);
+        if (!jout->out.is_open()) {
+            LOG_ERR("%s: failed to open output file '%s'!\n", __func__, params.json_out.c_str());
+            return -1;
+        }
+    }
 
-    std::vector<whisper_token> prompt_tokens;
+    for (auto &s : streams) {
+        if (whisper_stream_init(s.get()) < 0) {
+            return -1;
+        }
+    }
 
     // print some info about the processing
     {
         LOG_ERR("");
-        if (!whisper_is_multilingual(ctx)) {
+        if (!whisper_is_multilingual(m->ctx)) {
             if (params.language != "en" || params.translate) {
                 params.language = "en";
                 params.translate = false;
@@ -120,246 +663,285 @@ int whisper_stream_main(whisper_fuzzy_t *whisper_fuzzy_ctx) {
         }
         LOG_ERR("%s: processing %d samples (step = %.1f sec / len = %.1f sec / keep = %.1f sec), %d threads, lang = %s, task = %s, timestamps = %d ...\n",
                 __func__,
-                n_samples_step,
-                float(n_samples_step)/WHISPER_SAMPLE_RATE,
-                float(n_samples_len )/WHISPER_SAMPLE_RATE,
-                float(n_samples_keep)/WHISPER_SAMPLE_RATE,
+                s0->n_samples_step,
+                float(s0->n_samples_step)/WHISPER_SAMPLE_RATE,
+                float(s0->n_samples_len )/WHISPER_SAMPLE_RATE,
+                float(s0->n_samples_keep)/WHISPER_SAMPLE_RATE,
                 params.n_threads,
                 params.language.c_str(),
                 params.translate ? "translate" : "transcribe",
                 params.no_timestamps ? 0 : 1);
 
-        if (!use_vad) {
-            LOG_ERR("%s: n_new_line = %d, no_context = %d\n", __func__, n_new_line, params.no_context);
+        if (!s0->use_vad) {
+            LOG_ERR("%s: n_new_line = %d, no_context = %d\n", __func__, s0->n_new_line, params.no_context);
         } else {
-            LOG_ERR("%s: using VAD, will transcribe on speech activity\n", __func__);
+            LOG_ERR("%s: using VAD, will transcribe on speech activity (%s DSP kernels)\n", __func__, audio_dsp_backend());
+        }
+
+        if (streams.size() > 1) {
+            LOG_ERR("%s: %zu streams share one model, up to %d inferences at a time over %d threads\n",
+                __func__, streams.size(), s0->pool->n_parallel, s0->pool->n_threads);
         }
 
         LOG_ERR("");
     }
 
-    int n_iter = 0;
+    return 0;
+}
 
-    bool is_running = true;
 
-    std::ofstream fout;
-    if (params.fname_out.length() > 0) {
-        fout.open(params.fname_out);
-        if (!fout.is_open()) {
-            LOG_ERR("%s: failed to open output file '%s'!\n", __func__, params.fname_out.c_str());
-            return 1;
+static bool whisper_stream_any_running(const std::vector<std::unique_ptr<whisper_stream_t>> &streams)
+{
+    for (const auto &s : streams) {
+        if (s->running) {
+            return true;
         }
     }
 
-    wav_writer wavWriter;
-    // save wav file
-    if (params.save_audio) {
-        // Get current date/time for filename
-        time_t now = time(0);
-        char buffer[80];
-        strftime(buffer, sizeof(buffer), "%Y%m%d%H%M%S", localtime(&now));
-        std::string filename = std::string(buffer) + ".wav";
+    return false;
+}
 
-        wavWriter.open(filename, WHISPER_SAMPLE_RATE, 16, 1);
+
+static int whisper_stream_run(std::vector<std::unique_ptr<whisper_stream_t>> &streams)
+{
+    whisper_stream_t *s0 = streams[0].get();
+
+    bool use_sdl  = false;
+    bool use_alsa = false;
+    for (auto &s : streams) {
+        use_sdl  |= !s->use_replay && !s->use_alsa;
+        use_alsa |= s->use_alsa;
     }
+
+    stream_startup_report(s0->startup);
+
     LOG_DBG("[Start speaking]\n");
     fflush(stdout);
 
-    auto t_last  = std::chrono::high_resolution_clock::now();
-    const auto t_start = t_last;
+    const auto t_start = std::chrono::high_resolution_clock::now();
 
-    // main audio loop
-    while (is_running) {
-        if (params.save_audio) {
-            wavWriter.write(pcmf32_new.data(), pcmf32_new.size());
-        }
-        // handle Ctrl + C
-        is_running = sdl_poll_events();
-
-        if (!is_running) {
-            break;
+    for (auto &s : streams) {
+        if (s->use_replay) {
+            audio_replay_resume(&s->replay);
         }
+    }
 
-        // process new audio
+    signal(SIGUSR1, whisper_stream_sigusr1);
 
-        if (!use_vad) {
-            while (true) {
-                audio.get(params.step_ms, pcmf32_new);
+    if (use_alsa && !use_sdl) {
+        signal(SIGINT,  whisper_stream_sigint);
+        signal(SIGTERM, whisper_stream_sigint);
+    }
 
-                if ((int) pcmf32_new.size() > 2*n_samples_step) {
-                    LOG_ERR("\n\n%s: WARNING: cannot process audio fast enough, dropping audio ...\n\n", __func__);
-                    audio.clear();
-                    continue;
-                }
+    for (auto &s : streams) {
+        s->th_capture   = std::thread(whisper_stream_capture,   s.get());
+        s->th_inference = std::thread(whisper_stream_inference, s.get());
+        s->th_dispatch  = std::thread(whisper_stream_dispatch,  s.get());
+    }
 
-                if ((int) pcmf32_new.size() >= n_samples_step) {
-                    audio.clear();
-                    break;
+    // handle Ctrl + C; a replay stops its capture stage by itself once it has been consumed
+    while (whisper_stream_any_running(streams)) {
+#ifdef WHISPER_FUZZY_SDL
+        if (use_sdl && !sdl_poll_events()) {
+            break;
+        }
+#endif
+        if (g_quit) {
+            break;
+        }
+        if (g_trace_dump) {
+            g_trace_dump = 0;
+            stream_trace_dump(s0->trace);
+            whisper_fuzzy_thread_report(s0->fuzzy);
+            for (auto &s : streams) {
+                if (s->sched.use) {
+                    stream_sched_print_stats(&s->sched);
                 }
-
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
 
-            const int n_samples_new = pcmf32_new.size();
-
-            // take up to params.length_ms audio from previous iteration
-            const int n_samples_take = std::min((int) pcmf32_old.size(), std::max(0, n_samples_keep + n_samples_len - n_samples_new));
+    // stop capturing, then let the queued utterances drain through the later stages
+    for (auto &s : streams) {
+        s->running = false;
+        audio_ring_wakeup(&s->ring);
+    }
+    for (auto &s : streams) {
+        s->th_capture.join();
+        stream_queue_close(&s->q_infer);
+    }
+    for (auto &s : streams) {
+        s->th_inference.join();
+        stream_queue_close(&s->q_dispatch);
+    }
+    for (auto &s : streams) {
+        s->th_dispatch.join();
 
-            //LOG_DBG("processing: take = %d, new = %d, old = %d\n", n_samples_take, n_samples_new, (int) pcmf32_old.size());
+        if (s->use_replay) {
+            audio_replay_pause(&s->replay);
+        } else {
+            whisper_stream_pause_mic(s.get());
+        }
 
-            pcmf32.resize(n_samples_new + n_samples_take);
+        // flush before the stats are printed
+        if (s->use_recorder) {
+            stream_recorder_free(&s->rec);
+        }
+    }
 
-            for (int i = 0; i < n_samples_take; i++) {
-                pcmf32[i] = pcmf32_old[pcmf32_old.size() - n_samples_take + i];
-            }
+    {
+        const auto t_end  = std::chrono::high_resolution_clock::now();
+        const double t_sec = std::chrono::duration_cast<std::chrono::milliseconds>(t_end - t_start).count()*1e-3;
 
-            memcpy(pcmf32.data() + n_samples_take, pcmf32_new.data(), n_samples_new*sizeof(float));
+        uint64_t n_samples = 0;
 
-            pcmf32_old = pcmf32;
-        } else {
-            const auto t_now  = std::chrono::high_resolution_clock::now();
-            const auto t_diff = std::chrono::duration_cast<std::chrono::milliseconds>(t_now - t_last).count();
+        for (auto &s : streams) {
+            whisper_stream_print_stats(s.get(), t_sec);
+            if (s->sched.use) {
+                stream_sched_print_stats(&s->sched);
+            }
+            if (s->use_recorder) {
+                stream_recorder_print_stats(&s->rec);
+            }
+            n_samples += s->st_inference.n_samples_done;
+        }
 
-            if (t_diff < 2000) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // the throughput of N streams against the same run with one
+        if (streams.size() > 1) {
+            stream_pool_print_stats(s0->pool);
 
-                continue;
-            }
+            LOG_INFO("streams:   %zu, %.1f s of audio recognized in %.1f s, %.2f s of audio per second",
+                streams.size(), n_samples*1.0/WHISPER_SAMPLE_RATE, t_sec,
+                t_sec > 0 ? n_samples*1.0/WHISPER_SAMPLE_RATE/t_sec : 0.0);
+        }
 
-            audio.get(2000, pcmf32_new);
+        stream_trace_dump(s0->trace);
+        whisper_fuzzy_thread_report(s0->fuzzy);
+    }
 
-            if (::vad_simple(pcmf32_new, WHISPER_SAMPLE_RATE, 1000, params.vad_thold, params.freq_thold, false)) {
-                audio.get(params.length_ms, pcmf32);
-            } else {
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    int ret = 0;
 
-                continue;
+    for (auto &s : streams) {
+        if (s->use_alloc_check && !s->ret) {
+            for (const auto &st : s->alloc) {
+                if (st.n_bad) {
+                    s->ret = 7;
+                }
             }
-
-            t_last = t_now;
         }
 
-        // run the inference
-        {
-            whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
-
-            wparams.print_progress   = false;
-            wparams.print_special    = params.print_special;
-            wparams.print_realtime   = false;
-            wparams.print_timestamps = !params.no_timestamps;
-            wparams.translate        = params.translate;
-            wparams.single_segment   = !use_vad;
-            wparams.max_tokens       = params.max_tokens;
-            wparams.language         = params.language.c_str();
-            wparams.n_threads        = params.n_threads;
-
-            wparams.audio_ctx        = params.audio_ctx;
+        if (!ret) {
+            ret = s->ret;
+        }
+    }
 
-            wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
+    return ret;
+}
 
-            // disable temperature fallback
-            //wparams.temperature_inc  = -1.0f;
-            wparams.temperature_inc  = params.no_fallback ? 0.0f : wparams.temperature_inc;
 
-            wparams.prompt_tokens    = params.no_context ? nullptr : prompt_tokens.data();
-            wparams.prompt_n_tokens  = params.no_context ? 0       : prompt_tokens.size();
+int whisper_stream_main(whisper_fuzzy_t *whisper_fuzzy_ctx) {
+    if (!whisper_fuzzy_ctx) {
+        LOG_ERR("whisper_fuzzy_ctx null");
+        return -1;
+    }
+    whisper_params_t *params_tmp = whisper_fuzzy_get_params(whisper_fuzzy_ctx);
+    if (!params_tmp) {
+        LOG_ERR("fail to get params\n");
+        return -1;
+    }
+    whisper_params_t &params = *params_tmp;
 
-            if (whisper_full(ctx, wparams, pcmf32.data(), pcmf32.size()) != 0) {
-                LOG_ERR("%s: failed to process audio\n", params.program_name);
-                return 6;
-            }
+    params.keep_ms   = std::min(params.keep_ms,   params.step_ms);
+    params.length_ms = std::max(params.length_ms, params.step_ms);
 
-            // print result;
-            {
-                if (!use_vad) {
-                    LOG_DBG("\33[2K\r");
+    const bool use_vad = params.step_ms <= 0;
 
-                    // print long empty line to clear the previous line
-                    LOG_DBG("%s", std::string(100, ' ').c_str());
+    if (params.adaptive_step && !use_vad) {
+        const stream_sched_params_t sched_params = whisper_stream_sched_params(params);
 
-                    LOG_DBG("\33[2K\r");
-                } else {
-                    const int64_t t1 = (t_last - t_start).count()/1000000;
-                    const int64_t t0 = std::max(0.0, t1 - pcmf32.size()*1000.0/WHISPER_SAMPLE_RATE);
+        int step_min_ms = 0;
+        int step_max_ms = 0;
+        if (stream_sched_bounds(&sched_params, &step_min_ms, &step_max_ms) < 0) {
+            return 1;
+        }
+    }
 
-                    LOG_DBG("");
-                    LOG_DBG("### Transcription %d START | t0 = %d ms | t1 = %d ms\n", n_iter, (int) t0, (int) t1);
-                    LOG_DBG("");
-                }
+    params.no_timestamps  = !use_vad;
+    params.no_context    |= use_vad;
 
-                const int n_segments = whisper_full_n_segments(ctx);
-                for (int i = 0; i < n_segments; ++i) {
-                    const char * text = whisper_full_get_segment_text(ctx, i);
-                    
-                    whisper_fuzzy_match(whisper_fuzzy_ctx, n_segments - i - 1, text);
+    if (params.audio_backend.empty()) {
+#ifdef WHISPER_FUZZY_SDL
+        params.audio_backend = "sdl";
+#else
+        params.audio_backend = "alsa";
+#endif
+    }
 
-                    if (params.no_timestamps) {
-                        LOG_DBG("%s", text);
-                        fflush(stdout);
+    if (params.audio_backend != "sdl" && params.audio_backend != "alsa") {
+        LOG_ERR("%s: unknown audio backend '%s', sdl or alsa\n", __func__, params.audio_backend.c_str());
+        return 1;
+    }
 
-                        if (params.fname_out.length() > 0) {
-                            fout << text;
-                        }
-                    } else {
-                        const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-                        const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
+    // one stream per -c device and per -r, the default device when there are none
+    std::vector<int32_t> capture_ids = params.capture_ids;
+    if (capture_ids.empty() && params.replay.empty()) {
+        capture_ids.push_back(-1);
+    }
 
-                        std::string output = "[" + to_timestamp(t0, false) + " --> " + to_timestamp(t1, false) + "]  " + text;
+    const int n_streams = capture_ids.size() + params.replay.size();
 
-                        if (whisper_full_get_segment_speaker_turn_next(ctx, i)) {
-                            output += " [SPEAKER_TURN]";
-                        }
+    whisper_model_t model;
+    whisper_jout_t  jout;
+    stream_pool_t   pool;
 
-                        output += "\n";
+    if (stream_pool_init(&pool, n_streams, std::max(1, params.n_threads), params.n_parallel) < 0) {
+        return 1;
+    }
 
-                        LOG_DBG("%s", output.c_str());
-                        fflush(stdout);
+    std::vector<std::unique_ptr<whisper_stream_t>> streams;
 
-                        if (params.fname_out.length() > 0) {
-                            fout << output;
-                        }
-                    }
-                }
+    for (int i = 0; i < n_streams; i++) {
+        streams.emplace_back(new whisper_stream_t);
 
-                if (params.fname_out.length() > 0) {
-                    fout << std::endl;
-                }
+        whisper_stream_t *s = streams.back().get();
 
-                if (use_vad) {
-                    LOG_DBG("");
-                    LOG_DBG("### Transcription %d END\n", n_iter);
-                }
-            }
+        s->fuzzy     = whisper_fuzzy_ctx;
+        s->params    = &params;
+        s->trace     = whisper_fuzzy_get_trace(whisper_fuzzy_ctx);
+        s->startup   = whisper_fuzzy_get_startup(whisper_fuzzy_ctx);
+        s->model     = &model;
+        s->pool      = &pool;
+        s->jout      = &jout;
+        s->index     = i;
+        s->n_streams = n_streams;
 
-            ++n_iter;
+        if (i < (int) capture_ids.size()) {
+            s->capture_id = capture_ids[i];
+        } else {
+            s->replay_paths = params.replay[i - capture_ids.size()];
+        }
+    }
 
-            if (!use_vad && (n_iter % n_new_line) == 0) {
-                LOG_DBG("");
+    int ret = 1;
 
-                // keep part of the audio for next iteration to try to mitigate word boundary issues
-                pcmf32_old = std::vector<float>(pcmf32.end() - n_samples_keep, pcmf32.end());
+    if (whisper_stream_setup(&model, streams, &jout) == 0) {
+        ret = whisper_stream_run(streams);
 
-                // Add tokens of the last full length segment as the prompt
-                if (!params.no_context) {
-                    prompt_tokens.clear();
+        if (!ret && model.clf_enroll) {
+            ret = whisper_stream_clf_enroll(&model, params);
+        }
 
-                    const int n_segments = whisper_full_n_segments(ctx);
-                    for (int i = 0; i < n_segments; ++i) {
-                        const int token_count = whisper_full_n_tokens(ctx, i);
-                        for (int j = 0; j < token_count; ++j) {
-                            prompt_tokens.push_back(whisper_full_get_token_id(ctx, i, j));
-                        }
-                    }
-                }
-            }
-            fflush(stdout);
+        if (!ret && model.kws_enroll) {
+            ret = whisper_stream_kws_enroll(&model, params);
         }
     }
 
-    audio.pause();
+    for (auto &s : streams) {
+        whisper_stream_free(s.get());
+    }
 
-    whisper_print_timings(ctx);
-    whisper_free(ctx);
+    whisper_stream_model_free(&model);
 
-    return 0;
+    return ret;
 }
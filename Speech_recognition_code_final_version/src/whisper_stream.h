@@ -3,6 +3,7 @@
 
 #include <thread>
 #include <string>
+#include <vector>
 
 #include "stdint.h"
 #include "whisper_fuzzy.h"
@@ -15,12 +16,31 @@ struct whisper_params_t {
     int32_t step_ms    = 1000;  
     int32_t length_ms  = 3000;  
     int32_t keep_ms    = 100;   
-    int32_t capture_id = -1;   
-    int32_t max_tokens = 8;     
+    int32_t max_tokens = -1;    // per decode, -1 - longest command plus max_tokens_margin, 0 - no limit
+    int32_t max_tokens_margin = 3;  // tokens beyond the longest command, for punctuation
     int32_t audio_ctx  = 0;    
+    int32_t n_parallel = 0;     // inferences at a time over every stream, 0 - one per stream
+
+    int32_t step_min_ms   = 0;      // -as bounds, 0 - step_ms/4 (at least 100)
+    int32_t step_max_ms   = 0;      // 0 - length_ms
+    int32_t queue_target_ms = 500;
+    int32_t alsa_period   = 256;    // -ab alsa, frames
+    int32_t alsa_buffer   = 0;      // -ab alsa, frames, 0 - 4 periods
+    int32_t rotate_mb     = 0;
+    int32_t rotate_s      = 0;
+    int32_t audio_ctx_margin_ms = 1000;
+
+    int32_t vad_frame_ms    = 20;
+    int32_t vad_hangover_ms = 300;
+    int32_t vad_preroll_ms  = 200;
 
     float vad_thold    = 0.6f;  
     float freq_thold   = 100.0f;
+    float dedup_thold   = 0.6f;
+    float cascade_thold = 0.5f;
+    float classifier_margin = 0.0f;   // 0 - the one stored with the classifier
+    float kws_thold    = 0.0f;        // 0 - the one stored with the templates
+    float kws_ratio    = 0.0f;        // 0 - the one stored with the templates
 
     bool translate     = false; 
     bool no_fallback   = false; 
@@ -31,11 +51,38 @@ struct whisper_params_t {
     bool save_audio    = false;
     bool use_gpu       = true;  
     bool flash_attn    = false; 
+    bool poll_wait     = false;
+    bool abort_stale   = false;
+    bool audio_ctx_auto = false;
+    bool constrained   = false;
+    bool early_fire    = false;
+    bool dedup         = false;
+    bool adaptive_step = false;
+    bool replay_realtime = false;
+    bool alloc_check   = false;
+    bool use_mmap      = true;
+    bool prefetch      = false;
+    bool warmup        = false;
+    bool classifier_shadow = false;
+    bool kws_shadow    = false;
 
     std::string language  = "en"; 
     std::string model     = "models/ggml-base.en.bin"; 
+    std::string model_fast;
+    std::vector<int32_t>     capture_ids;   // -c, one stream per device, none - the default device
+    std::vector<std::string> replay;        // -r, one stream per occurrence
+    std::string audio_backend;              // -ab sdl|alsa, "" - sdl when built with it
+    std::string alsa_device = "default";    // -ab alsa without -c, -c ID opens plughw:ID
+    std::string json_out;
+    std::vector<std::string> affinity;   // ROLE=CPUS[:POLICY[:PRIO]]
     std::string user      = ""; 
     std::string fname_out;      
+    std::string audio_ctx_buckets;
+    std::string classifier;
+    std::string classifier_enroll;
+    std::string labels;
+    std::string kws;
+    std::string kws_enroll;
     const char *program_name;  
 };
 
@@ -0,0 +1,399 @@
+// Capture stage of a stream: the microphone or replay writes the ring, this
+// stage cuts it into sliding windows or VAD utterances and queues them for
+// inference. Nothing is dropped here: while every slot is in flight the stage
+// waits, and the ring holds the audio until it catches up.
+//
+#include "whisper_stream_pipeline.h"
+#include "alloc_count.h"
+#include "audio_dsp.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+
+
+// take a free slot, waiting while every slot is in flight, e.g. while the dispatch stage holds
+// them during a servo motion; nothing is dropped, the ring keeps the audio until capture catches up
+static whisper_utterance_t *whisper_stream_acquire(whisper_stream_t *s)
+{
+    whisper_capture_stats_t &st = s->st_capture;
+
+    whisper_utterance_t *u = nullptr;
+
+    if (stream_queue_pop(&s->q_free, &u, 0) > 0) {
+        return u;
+    }
+
+    const int64_t t_start = whisper_stream_now();
+
+    while (s->running && stream_queue_pop(&s->q_free, &u, 100) <= 0) {
+        u = nullptr;
+    }
+
+    const int64_t t_wait = whisper_stream_now() - t_start;
+
+    ++st.n_slot_waits;
+    st.t_slot_wait    += t_wait;
+    st.t_slot_wait_max = std::max(st.t_slot_wait_max, t_wait);
+
+    return u;
+}
+
+
+static void whisper_stream_submit(whisper_stream_t *s, whisper_utterance_t *u)
+{
+    u->audio_busy.store(true, std::memory_order_release);
+    u->abort.store(false, std::memory_order_relaxed);
+    u->aborted = false;
+    u->seq      = s->n_submitted.load(std::memory_order_relaxed) + 1;
+    u->t_submit = whisper_stream_now();
+    u->trace_id = stream_trace_begin(s->trace, u->t_end);
+    u->peak     = audio_dsp_peak(u->pcmf32.data, u->pcmf32.n);
+
+    stream_trace_mark(s->trace, u->trace_id, WHISPER_TRACE_VAD, u->t_submit);
+
+    // cannot fail, the queue holds every slot
+    stream_queue_push(&s->q_infer, u);
+
+    s->n_submitted.store(u->seq, std::memory_order_relaxed);
+}
+
+
+// a replay has ended and nothing was written since pos_head was read
+static bool whisper_stream_input_done(whisper_stream_t *s, uint64_t pos_head)
+{
+    return s->use_replay && audio_replay_done(&s->replay) && audio_ring_head(&s->ring) == pos_head;
+}
+
+
+// release the ring up to pos, except what queued or running utterances still read
+static void whisper_stream_release(whisper_stream_t *s, uint64_t pos)
+{
+    for (auto &u : s->utterances) {
+        if (u.audio_busy.load(std::memory_order_acquire)) {
+            pos = std::min(pos, u.pcmf32.pos);
+        }
+    }
+
+    audio_ring_release(&s->ring, pos);
+}
+
+
+static void whisper_stream_audio_thread(void *userdata)
+{
+    whisper_stream_thread_enter((whisper_stream_t *)userdata, "audio");
+}
+
+
+void whisper_stream_capture(whisper_stream_t *s)
+{
+    whisper_params_t &params = *s->params;
+
+    whisper_capture_stats_t &st = s->st_capture;
+
+    whisper_stream_thread_enter(s, "capture");
+
+    uint64_t pos_start = 0;  // first sample of the sliding window
+    uint64_t pos_read  = 0;  // first sample not yet consumed
+    uint64_t pos_saved = 0;  // first sample not yet handed to the recorder
+
+    stream_vad_segment_t segment;
+
+    int n_iter       = 0;
+    int n_since_line = 0;   // windows since the last new line
+
+    while (s->running) {
+        whisper_stream_alloc_account(s, WHISPER_STAGE_CAPTURE);
+
+        if (params.save_audio) {
+            const uint64_t pos_head = audio_ring_head(&s->ring);
+
+            audio_view_t pcmf32_new;
+            while (pos_saved < pos_head &&
+                   audio_ring_view(&s->ring, pos_saved, std::min<uint64_t>(pos_head - pos_saved, s->n_samples_view), &pcmf32_new) == 0) {
+                stream_recorder_audio(&s->rec, pcmf32_new.data, pcmf32_new.n);
+                pos_saved += pcmf32_new.n;
+            }
+        }
+
+        const uint64_t pos_head = audio_ring_head(&s->ring);
+
+        st.ring_fill_max = std::max<size_t>(st.ring_fill_max, pos_head - audio_ring_tail(&s->ring));
+
+        whisper_utterance_t *u = nullptr;
+
+        if (!s->use_vad) {
+            uint64_t n_samples_new = pos_head - pos_read;
+
+            // may change after every window with -as
+            const int      step_ms = s->sched.step_ms.load(std::memory_order_relaxed);
+            const uint64_t n_step  = (uint64_t) step_ms*WHISPER_SAMPLE_RATE/1000;
+
+            if (n_samples_new < n_step) {
+                if (whisper_stream_input_done(s, pos_head)) {
+                    break;
+                }
+                if (params.poll_wait) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                } else if (audio_ring_wait(&s->ring, pos_read + n_step, 2*step_ms) < 0) {
+                    s->ret = 6;
+                    break;
+                }
+                ++st.n_wakeups;
+                continue;
+            }
+
+            // behind, the ring is the backlog: a window takes at most one length of new audio, so
+            // every sample is in some window and capture catches up a length per window
+            const uint64_t pos_end = std::min<uint64_t>(pos_head, pos_read + s->n_samples_len);
+
+            if (pos_end < pos_head) {
+                ++st.n_catchup;
+            }
+
+            // take up to params.length_ms audio from previous iteration
+            if (pos_end - pos_start > (uint64_t) (s->n_samples_keep + s->n_samples_len)) {
+                pos_start = pos_end - (s->n_samples_keep + s->n_samples_len);
+            }
+
+            u = whisper_stream_acquire(s);
+            if (!u) {
+                break;
+            }
+
+            if (audio_ring_view(&s->ring, pos_start, pos_end - pos_start, &u->pcmf32) < 0) {
+                LOG_ERR("%s: failed to get the audio window\n", __func__);
+                stream_queue_push(&s->q_free, u);
+                s->ret = 6;
+                break;
+            }
+
+            //LOG_DBG("processing: take = %d, new = %d", (int) (pos_read - pos_start), (int) (pos_end - pos_read));
+
+            // a new line every length/step - 1 windows, the step may have changed
+            const int n_new_line = s->sched.use ? std::max(1, params.length_ms/step_ms - 1) : s->n_new_line;
+
+            u->id       = n_iter++;
+            u->new_line = ++n_since_line >= n_new_line;
+            if (u->new_line) {
+                n_since_line = 0;
+            }
+            u->t_end    = audio_ring_time(&s->ring, pos_end - 1, WHISPER_SAMPLE_RATE);
+
+            pos_read = pos_end;
+
+            if (u->new_line) {
+                // keep part of the audio for next iteration to try to mitigate word boundary issues
+                pos_start = std::max(pos_start, pos_read - std::min<uint64_t>(pos_read, s->n_samples_keep));
+            }
+        } else {
+            stream_vad_t &vad = s->vad;
+
+            // wait for the next complete frame
+            if (pos_head < pos_read + vad.n_frame) {
+                if (whisper_stream_input_done(s, pos_head)) {
+                    break;
+                }
+                if (audio_ring_wait(&s->ring, pos_read + vad.n_frame, 100) < 0) {
+                    s->ret = 6;
+                    break;
+                }
+                ++st.n_wakeups;
+                continue;
+            }
+
+            stream_vad_event_t event = STREAM_VAD_NONE;
+
+            while (event != STREAM_VAD_END && pos_read + vad.n_frame <= pos_head) {
+                audio_view_t frame;
+                if (audio_ring_view(&s->ring, pos_read, vad.n_frame, &frame) < 0) {
+                    s->ret = 6;
+                    break;
+                }
+
+                event = stream_vad_process(&vad, frame.data, frame.pos);
+                pos_read += vad.n_frame;
+
+                if (s->kws.use) {
+                    whisper_stream_kws_feed(s, frame.data, frame.n);
+                }
+
+                if (event == STREAM_VAD_START) {
+                    LOG_DBG("speech start at %.2f s (noise %.2e, energy %.2e)",
+                        (double) vad.pos_start/WHISPER_SAMPLE_RATE, vad.noise, vad.energy);
+                }
+            }
+
+            // nothing before the current utterance, or the pre-roll of one that may start, is needed again
+            if (event == STREAM_VAD_END) {
+                stream_vad_segment(&vad, &segment);
+                pos_start = segment.pos_begin;
+            } else {
+                pos_start = stream_vad_keep_pos(&vad, pos_read);
+            }
+
+            if (event != STREAM_VAD_END) {
+                whisper_stream_release(s, params.save_audio ? std::min(pos_start, pos_saved) : pos_start);
+                continue;
+            }
+
+            u = whisper_stream_acquire(s);
+            if (!u) {
+                break;
+            }
+
+            // exactly pre-roll + speech + hangover
+            if (audio_ring_view(&s->ring, segment.pos_begin, segment.pos_end - segment.pos_begin, &u->pcmf32) < 0) {
+                LOG_ERR("%s: failed to get the utterance\n", __func__);
+                stream_queue_push(&s->q_free, u);
+                s->ret = 6;
+                break;
+            }
+
+            u->id       = n_iter++;
+            u->new_line = false;
+            u->t_end    = audio_ring_time(&s->ring, segment.pos_end - 1, WHISPER_SAMPLE_RATE);
+
+            LOG_DBG("utterance %d: samples [%llu, %llu) = pre-roll %d + speech %d + hangover %d", u->id,
+                (unsigned long long) segment.pos_begin, (unsigned long long) segment.pos_end,
+                (int) (segment.pos_speech     - segment.pos_begin),
+                (int) (segment.pos_speech_end - segment.pos_speech),
+                (int) (segment.pos_end        - segment.pos_speech_end));
+
+            if (s->kws.use) {
+                whisper_stream_kws_match(s, u, segment);
+            }
+        }
+
+        whisper_stream_submit(s, u);
+        s->alloc[WHISPER_STAGE_CAPTURE].n_done++;
+
+        // everything before the window start is no longer needed
+        whisper_stream_release(s, params.save_audio ? std::min(pos_start, pos_saved) : pos_start);
+    }
+
+    s->running = false;
+
+    whisper_fuzzy_thread_leave(s->fuzzy);
+}
+
+
+// the microphone of one stream, through the backend picked with -ab
+static int whisper_stream_open_mic(whisper_stream_t *s)
+{
+#ifdef WHISPER_FUZZY_ALSA
+    if (s->use_alsa) {
+        const whisper_params_t &params = *s->params;
+
+        audio_alsa_params_t alsa_params;
+        alsa_params.device        = s->capture_id >= 0 ? "plughw:" + std::to_string(s->capture_id) : params.alsa_device;
+        alsa_params.sample_rate   = WHISPER_SAMPLE_RATE;
+        alsa_params.period_frames = params.alsa_period;
+        alsa_params.buffer_frames = params.alsa_buffer;
+
+        s->alsa.on_thread_userdata = s;
+        s->alsa.on_thread          = whisper_stream_audio_thread;
+
+        if (audio_alsa_init(&s->alsa, &s->ring, &alsa_params) < 0) {
+            LOG_ERR("%s: audio_alsa_init() failed!\n", __func__);
+            return -1;
+        }
+
+        return audio_alsa_resume(&s->alsa);
+    }
+#endif
+
+#ifdef WHISPER_FUZZY_SDL
+    if (!s->use_alsa) {
+        if (audio_capture_init(&s->audio, &s->ring, s->capture_id, WHISPER_SAMPLE_RATE) < 0) {
+            LOG_ERR("%s: audio_capture_init() failed!\n", __func__);
+            return -1;
+        }
+
+        return audio_capture_resume(&s->audio);
+    }
+#endif
+
+    LOG_ERR("%s: built without the %s capture backend\n", __func__, s->use_alsa ? "ALSA" : "SDL");
+    return -1;
+}
+
+
+void whisper_stream_pause_mic(whisper_stream_t *s)
+{
+#ifdef WHISPER_FUZZY_ALSA
+    if (s->use_alsa) {
+        audio_alsa_pause(&s->alsa);
+    }
+#endif
+#ifdef WHISPER_FUZZY_SDL
+    if (!s->use_alsa) {
+        audio_capture_pause(&s->audio);
+    }
+#endif
+    (void) s;
+}
+
+
+void whisper_stream_free_mic(whisper_stream_t *s)
+{
+#ifdef WHISPER_FUZZY_ALSA
+    audio_alsa_free(&s->alsa);
+#endif
+#ifdef WHISPER_FUZZY_SDL
+    audio_capture_free(&s->audio);
+#endif
+    (void) s;
+}
+
+
+// ring and audio source of one stream, before the model is loaded so the device starts meanwhile
+int whisper_stream_open_audio(whisper_stream_t *s)
+{
+    whisper_params_t &params = *s->params;
+
+    s->n_samples_step = (1e-3*params.step_ms  )*WHISPER_SAMPLE_RATE;
+    s->n_samples_len  = (1e-3*params.length_ms)*WHISPER_SAMPLE_RATE;
+    s->n_samples_keep = (1e-3*params.keep_ms  )*WHISPER_SAMPLE_RATE;
+
+    const int n_samples_30s  = (1e-3*30000.0         )*WHISPER_SAMPLE_RATE;
+    const int n_samples_pre  = (1e-3*params.vad_preroll_ms)*WHISPER_SAMPLE_RATE;
+
+    s->use_vad = s->n_samples_step <= 0; // sliding window mode uses VAD
+
+    s->n_new_line = !s->use_vad ? std::max(1, params.length_ms / params.step_ms - 1) : 1; // number of steps to print new line
+
+    // longest window handed to whisper_full, views up to this size are contiguous
+    s->n_samples_view = std::max(s->n_samples_keep + s->n_samples_len, n_samples_pre + s->n_samples_len);
+
+    if (audio_ring_init(&s->ring, std::max(n_samples_30s, 4*s->n_samples_view), s->n_samples_view) < 0) {
+        LOG_ERR("%s: audio_ring_init() failed!\n", __func__);
+        return -1;
+    }
+
+    s->use_replay = !s->replay_paths.empty();
+    s->use_alsa   = !s->use_replay && params.audio_backend == "alsa";
+    s->fast_replay = s->use_replay && !params.replay_realtime;
+
+    s->audio.on_thread_userdata  = s;
+    s->audio.on_thread           = whisper_stream_audio_thread;
+    s->replay.on_thread_userdata = s;
+    s->replay.on_thread          = whisper_stream_audio_thread;
+
+    if (s->use_replay) {
+        // long enough for the last utterance of a file to end, and for one more sliding step
+        const int gap_ms = std::max(std::max(1000, params.vad_hangover_ms + 2*params.vad_frame_ms), params.step_ms);
+
+        if (audio_replay_init(&s->replay, &s->ring, s->replay_paths, WHISPER_SAMPLE_RATE, params.replay_realtime, gap_ms) < 0) {
+            LOG_ERR("%s: audio_replay_init() failed!\n", __func__);
+            return -1;
+        }
+    } else if (whisper_stream_open_mic(s) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
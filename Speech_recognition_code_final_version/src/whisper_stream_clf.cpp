@@ -0,0 +1,240 @@
+#include "whisper_stream_clf.h"
+#include "whisper_stream_pipeline.h"
+#include "corpus_labels.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+
+// --classifier loads the centroids, --classifier-enroll starts collecting them;
+// the features are the log-probabilities of every token of every alias
+int whisper_stream_clf_setup(whisper_model_t *m, whisper_fuzzy_t *fuzzy, const whisper_params_t &params)
+{
+    std::vector<int32_t> tokens;
+    for (const auto &node : m->trie.nodes) {
+        for (const auto &next : node.next) {
+            tokens.push_back(next.first);
+        }
+    }
+
+    if (!params.classifier_enroll.empty()) {
+        if (stream_classifier_init(&m->clf, tokens, corpus_labels_basename(params.model)) < 0) {
+            return -1;
+        }
+
+        m->clf_enroll = true;
+
+        LOG_INFO("classifier: enrolling %zu labelled files over %zu tokens", m->labels.size(), m->clf.tokens.size());
+
+        return 0;
+    }
+
+    if (stream_classifier_load(&m->clf, params.classifier) < 0) {
+        return -1;
+    }
+
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+    if (tokens != m->clf.tokens) {
+        LOG_INFO("classifier: the commands changed since %s was enrolled, enroll again", params.classifier.c_str());
+    }
+
+    for (int32_t token : m->clf.tokens) {
+        if (token < 0 || token >= m->n_vocab) {
+            LOG_ERR("classifier: token %d is not in the vocabulary of %s", token, params.model.c_str());
+            return -1;
+        }
+    }
+
+    if (params.classifier_margin > 0.0f) {
+        m->clf.margin = params.classifier_margin;
+    }
+
+    std::vector<std::string> codes;
+    for (const auto &cls : m->clf.classes) {
+        codes.push_back(cls.code);
+    }
+
+    whisper_stream_code_text(fuzzy, "classifier", codes, m->clf_text);
+
+    m->use_clf = true;
+
+    LOG_INFO("classifier: %zu classes over %zu tokens, margin %.3f%s (enrolled with %s)",
+        m->clf.classes.size(), m->clf.tokens.size(), m->clf.margin,
+        params.classifier_shadow ? ", shadow mode" : "", m->clf.model.c_str());
+
+    return 0;
+}
+
+
+// first decoder step of the main model: classify the utterance; when the margin is reached
+// (and not in shadow mode), or while enrolling, end the decode right there with EOT.
+// Reads and writes the stream and u unguarded, the decode runs a single sequence.
+bool whisper_stream_classify(whisper_stream_t *s, struct whisper_context *ctx, int n_tokens, float *logits)
+{
+    const whisper_model_t *m = s->model;
+    whisper_utterance_t   *u = s->decode.u;
+
+    whisper_stream_clf_t &c = s->clf;
+
+    if (n_tokens || ctx != m->ctx) {
+        return false;
+    }
+
+    // a temperature fallback starts over with one sequence again, the verdict of the first attempt stays
+    if (!c.seen) {
+        c.seen = true;
+
+        stream_classifier_features(&m->clf, logits, m->n_vocab, c.features.data());
+
+        if (m->use_clf) {
+            u->clf_class   = stream_classifier_classify(&m->clf, c.features.data(), &u->clf_sim, &u->clf_margin);
+            // a code missing from the config has nothing to dispatch
+            u->clf_decided = u->clf_class >= 0 && u->clf_margin >= m->clf.margin &&
+                (!m->clf_text[u->clf_class].empty() || m->clf.classes[u->clf_class].code == "none");
+            u->t_clf       = whisper_stream_now();
+        }
+    }
+
+    if (!m->clf_enroll && (!u->clf_decided || s->params->classifier_shadow)) {
+        return false;
+    }
+
+    std::fill(logits, logits + m->n_vocab, -INFINITY);
+    logits[m->token_eot] = 0.0f;
+
+    return true;
+}
+
+
+// keep the features of the longest utterance of every replayed file
+void whisper_stream_clf_collect(whisper_stream_t *s, const whisper_utterance_t *u)
+{
+    whisper_model_t *m = s->model;
+
+    const audio_replay_file_t *file = whisper_stream_replay_file(s, u);
+    if (!file || !s->clf.seen) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m->clf_mutex);
+
+    auto &best = m->clf_files[file->path];
+    if (best.second.empty() || u->pcmf32.n > best.first) {
+        best.first  = u->pcmf32.n;
+        best.second = s->clf.features;
+    }
+}
+
+
+// centroids from the collected files by their labels, written to --classifier-enroll
+int whisper_stream_clf_enroll(whisper_model_t *m, const whisper_params_t &params)
+{
+    int n_unlabelled = 0;
+
+    for (const auto &file : m->clf_files) {
+        auto label = m->labels.find(corpus_labels_basename(file.first));
+        if (label == m->labels.end()) {
+            n_unlabelled++;
+            continue;
+        }
+
+        stream_classifier_enroll(&m->clf, label->second, file.second.second.data());
+    }
+
+    LOG_INFO("classifier: %zu files heard, %d without a label", m->clf_files.size(), n_unlabelled);
+
+    if (stream_classifier_finish(&m->clf) < 0 || stream_classifier_save(&m->clf, params.classifier_enroll) < 0) {
+        LOG_ERR("%s: enrollment failed\n", __func__);
+        return 1;
+    }
+
+    LOG_INFO("classifier: written to %s", params.classifier_enroll.c_str());
+
+    return 0;
+}
+
+
+// the classifier against the decoder, and both against the label of the replayed file
+void whisper_stream_clf_account(whisper_stream_t *s, const whisper_utterance_t *u, const char *code)
+{
+    const whisper_model_t *m = s->model;
+
+    whisper_stream_clf_t &c = s->clf;
+
+    if (u->clf_class < 0) {
+        return;
+    }
+
+    const bool shadow = s->params->classifier_shadow;
+
+    const int64_t t_infer = u->t_infer_end - u->t_infer_begin;
+
+    c.t_verdict += u->t_clf - u->t_infer_begin;
+
+    if (u->clf_decided) {
+        c.n_decided++;
+        c.t_decided += t_infer;
+    } else {
+        c.n_decoded++;
+        c.t_decoded += t_infer;
+    }
+
+    const std::string &clf_code = m->clf.classes[u->clf_class].code;
+    const std::string  result   = code ? code : "none";
+
+    if (shadow && u->clf_decided) {
+        c.n_agree += clf_code == result;
+    }
+
+    const audio_replay_file_t *file = whisper_stream_replay_file(s, u);
+    if (!file) {
+        return;
+    }
+
+    auto label = m->labels.find(corpus_labels_basename(file->path));
+    if (label == m->labels.end()) {
+        return;
+    }
+
+    c.n_lab++;
+
+    if (shadow) {
+        c.n_lab_result  += label->second == (u->clf_decided ? clf_code : result);
+        c.n_lab_decoder += label->second == result;
+        c.n_lab_clf     += label->second == clf_code;
+    } else {
+        c.n_lab_result  += label->second == result;
+    }
+}
+
+
+void whisper_stream_clf_print_stats(const whisper_stream_t *s)
+{
+    const whisper_stream_clf_t &c = s->clf;
+
+    const uint64_t n = c.n_decided + c.n_decoded;
+
+    if (s->params->classifier_shadow) {
+        LOG_INFO("classifier: shadow, verdict after avg %.1f ms against a whole decode of avg %.1f ms, "
+            "%llu of %llu over the margin, %llu of those agree with the decoder",
+            n ? c.t_verdict*1e-6/n : 0.0, n ? (c.t_decided + c.t_decoded)*1e-6/n : 0.0,
+            (unsigned long long) c.n_decided, (unsigned long long) n, (unsigned long long) c.n_agree);
+    } else {
+        LOG_INFO("classifier: %llu decided in avg %.1f ms, %llu left to the decoder in avg %.1f ms",
+            (unsigned long long) c.n_decided, c.n_decided ? c.t_decided*1e-6/c.n_decided : 0.0,
+            (unsigned long long) c.n_decoded, c.n_decoded ? c.t_decoded*1e-6/c.n_decoded : 0.0);
+    }
+
+    if (c.n_lab && s->params->classifier_shadow) {
+        LOG_INFO("classifier: %llu labelled utterances right by the decoder %.0f%%, the classifier alone %.0f%%, "
+            "the classifier with the decoder below the margin %.0f%%", (unsigned long long) c.n_lab,
+            100.0*c.n_lab_decoder/c.n_lab, 100.0*c.n_lab_clf/c.n_lab, 100.0*c.n_lab_result/c.n_lab);
+    } else if (c.n_lab) {
+        LOG_INFO("classifier: %llu labelled utterances, %.0f%% right", (unsigned long long) c.n_lab,
+            100.0*c.n_lab_result/c.n_lab);
+    }
+}
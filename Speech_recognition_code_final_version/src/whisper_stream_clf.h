@@ -0,0 +1,56 @@
+#ifndef __WHISPER_STREAM_CLF_H__
+#define __WHISPER_STREAM_CLF_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "whisper.h"
+#include "whisper_stream.h"
+
+
+struct whisper_model_t;
+struct whisper_stream_t;
+struct whisper_utterance_t;
+
+
+// The command classifier of one stream (--classifier): the first decoder step
+// of every utterance is classified against the centroids of stream_classifier_t,
+// and a confident verdict ends the decode there. The full encoder and that one
+// decoder step always run, only the decode after it is saved.
+struct whisper_stream_clf_t {
+    // the features of the running whisper_full, one sequence at a time (greedy.best_of = 1)
+    std::vector<float> features;
+    bool               seen = false;
+
+    // stats, the classifier against the decoder, see whisper_stream_clf_account()
+    uint64_t n_decided     = 0;      // the margin was reached
+    uint64_t n_decoded     = 0;      // left to the decoder
+    int64_t  t_decided     = 0;      // ns, inference time of the decided ones
+    int64_t  t_decoded     = 0;      // ns, inference time of the others
+    int64_t  t_verdict     = 0;      // ns, inference start to the verdict, all of them
+    uint64_t n_agree       = 0;      // shadow: decided and the decoder found the same command
+    uint64_t n_lab         = 0;      // utterances of labelled files
+    uint64_t n_lab_result  = 0;      // the dispatched command was the label
+    uint64_t n_lab_clf     = 0;      // shadow: the closest class was the label
+    uint64_t n_lab_decoder = 0;      // shadow: the decoded command was the label
+};
+
+
+// --classifier loads the centroids, --classifier-enroll starts collecting them
+int whisper_stream_clf_setup(whisper_model_t *m, whisper_fuzzy_t *fuzzy, const whisper_params_t &params);
+
+// logits filter, first decoder step of the main model; true if the decode ends here with EOT
+bool whisper_stream_classify(whisper_stream_t *s, struct whisper_context *ctx, int n_tokens, float *logits);
+
+// --classifier-enroll, after every whisper_full
+void whisper_stream_clf_collect(whisper_stream_t *s, const whisper_utterance_t *u);
+
+// --classifier-enroll, once every stream is done
+int whisper_stream_clf_enroll(whisper_model_t *m, const whisper_params_t &params);
+
+// dispatch stage, code is what the utterance dispatched
+void whisper_stream_clf_account(whisper_stream_t *s, const whisper_utterance_t *u, const char *code);
+
+void whisper_stream_clf_print_stats(const whisper_stream_t *s);
+
+#endif //__WHISPER_STREAM_CLF_H__
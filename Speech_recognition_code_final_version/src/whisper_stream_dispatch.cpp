@@ -0,0 +1,263 @@
+// Dispatch stage of a stream: the commands of every result go to the user
+// callback (servos, OLED), early commands ahead of their decode, repeats from
+// overlapping windows suppressed; then the transcript, -jo line and accuracy
+// stats. A slow callback only holds slots, see whisper_stream_acquire().
+//
+#include "whisper_stream_pipeline.h"
+#include "alloc_count.h"
+#include "debug.h"
+#include "json.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+
+
+// "hh:mm:ss.mmm" of t in 10 ms units, what to_timestamp() prints
+static const char *whisper_stream_timestamp(stream_arena_t *a, int64_t t)
+{
+    int64_t msec = t*10;
+
+    const int64_t hr  = msec/(1000*60*60);
+    msec -= hr*(1000*60*60);
+    const int64_t min = msec/(1000*60);
+    msec -= min*(1000*60);
+    const int64_t sec = msec/1000;
+    msec -= sec*1000;
+
+    return stream_arena_printf(a, "%02d:%02d:%02d.%03d", (int) hr, (int) min, (int) sec, (int) msec);
+}
+
+
+// one machine-readable line per utterance: where it is, what was heard and how long each stage took
+static void whisper_stream_write_json(whisper_stream_t *s, const whisper_utterance_t *u, const char *code, bool duplicate)
+{
+    nlohmann::json j;
+
+    // the pre-roll may reach back into the gap before the file
+    const audio_replay_file_t *file = whisper_stream_replay_file(s, u);
+    const uint64_t pos_file = file ? file->pos : 0;
+
+    std::string text;
+    for (int i = 0; i < u->n_segments; ++i) {
+        text += u->segments[i].text;
+    }
+
+    j["stream"] = s->index;
+    j["id"]    = u->id;
+    j["trace"] = u->trace_id;
+    j["file"]  = file ? nlohmann::json(file->path) : nlohmann::json(nullptr);
+    j["t0_ms"] = (int64_t) (u->pcmf32.pos - std::min(u->pcmf32.pos, pos_file))*1000/WHISPER_SAMPLE_RATE;
+    j["t1_ms"] = (int64_t) (u->pcmf32.pos + u->pcmf32.n - std::min(u->pcmf32.pos, pos_file))*1000/WHISPER_SAMPLE_RATE;
+    j["text"]  = text;
+    j["code"]  = code ? nlohmann::json(code) : nlohmann::json(nullptr);
+    j["model"] = u->kws_only ? "kws" : u->tier ? "main" : "fast";
+    j["early"] = u->early_code && !u->early_skipped ? nlohmann::json(u->early_code) : nlohmann::json(nullptr);
+    j["duplicate"] = duplicate;
+    j["budget_hit"] = u->budget_hit;
+
+    j["peak_dbfs"] = u->peak > 0.0f ? nlohmann::json(20.0*std::log10(u->peak)) : nlohmann::json(nullptr);
+
+    if (s->model->use_clf) {
+        j["clf_code"]    = u->clf_class >= 0 ? nlohmann::json(s->model->clf.classes[u->clf_class].code) : nlohmann::json(nullptr);
+        j["clf_margin"]  = u->clf_class >= 0 ? nlohmann::json(u->clf_margin) : nlohmann::json(nullptr);
+        j["clf_decided"] = u->clf_decided;
+        j["clf_ms"]      = u->clf_class >= 0 ? nlohmann::json((u->t_clf - u->t_infer_begin)*1e-6) : nlohmann::json(nullptr);
+    }
+
+    if (s->model->use_kws) {
+        const bool matched = u->kws_class >= 0;
+
+        j["kws_code"]  = matched ? nlohmann::json(s->model->kws.classes[u->kws_class].code) : nlohmann::json(nullptr);
+        j["kws_dist"]  = matched ? nlohmann::json(u->kws_dist) : nlohmann::json(nullptr);
+        j["kws_ratio"] = matched && std::isfinite(u->kws_ratio) ? nlohmann::json(u->kws_ratio) : nlohmann::json(nullptr);
+        j["kws_hit"]   = u->kws_hit;
+        j["kws_ms"]    = u->t_kws*1e-6;
+    }
+
+    j["audio_ctx"]   = u->audio_ctx;
+    j["step_ms"]     = s->use_vad ? nlohmann::json(nullptr) : nlohmann::json(s->sched.step_ms.load());
+    j["rtf"]         = s->sched.use ? nlohmann::json(s->sched.rtf.load()) : nlohmann::json(nullptr);
+    j["queue_ms"]    = (u->t_infer_begin - u->t_submit)*1e-6;
+    j["encode_ms"]   = u->t_encode*1e-6;
+    j["infer_ms"]    = (u->t_infer_end - u->t_infer_begin)*1e-6;
+    j["dispatch_ms"] = (whisper_stream_now() - u->t_infer_end)*1e-6;
+    j["early_ms"]    = u->early_code && !u->early_skipped ? nlohmann::json((u->t_infer_end - u->t_early)*1e-6) : nlohmann::json(nullptr);
+    j["endpoint_ms"] = s->fast_replay ? nlohmann::json(nullptr) : nlohmann::json((u->t_infer_end - u->t_end)*1e-6);
+
+    const std::string line = j.dump();
+
+    std::lock_guard<std::mutex> lock(s->jout->mutex);
+    s->jout->out << line << std::endl;
+}
+
+
+void whisper_stream_dispatch(whisper_stream_t *s)
+{
+    whisper_params_t &params = *s->params;
+
+    whisper_stream_thread_enter(s, "dispatch");
+
+    // the callback can tell the sources apart
+    whisper_fuzzy_source_set_current(s->fuzzy, s->index);
+
+    whisper_utterance_t *u = nullptr;
+
+    while (stream_queue_pop(&s->q_dispatch, &u, -1) > 0) {
+        whisper_stream_alloc_account(s, WHISPER_STAGE_DISPATCH);
+
+        // the inference stage is still decoding u, only its early command is ours
+        if (u->early_pending) {
+            u->early_pending = false;
+
+            // there are no word timestamps yet, a window overlapping the same command waits for them
+            if (s->use_dedup) {
+                stream_dedup_release(&s->dedup, u->pcmf32.pos);
+                u->early_skipped = stream_dedup_seen(&s->dedup, u->pcmf32.pos, u->pcmf32.pos + u->pcmf32.n, u->early_code);
+            } else {
+                u->early_skipped = false;
+            }
+
+            if (!u->early_skipped) {
+                s->early.n_fired++;
+
+                whisper_fuzzy_trace_set_current(s->fuzzy, u->trace_id);
+                whisper_fuzzy_match(s->fuzzy, 0, u->early_text);
+                whisper_fuzzy_trace_set_current(s->fuzzy, 0);
+            }
+            continue;
+        }
+
+        if (u->n_segments < 0) {
+            stream_queue_push(&s->q_free, u);
+            continue;
+        }
+
+        s->alloc[WHISPER_STAGE_DISPATCH].n_done++;
+        stream_arena_reset(&s->arena_dispatch);
+
+        if (!s->use_vad) {
+            LOG_DBG("\33[2K\r");
+
+            // print long empty line to clear the previous line
+            LOG_DBG("%100s", "");
+
+            LOG_DBG("\33[2K\r");
+        } else {
+            const int64_t t0 = u->pcmf32.pos*1000/WHISPER_SAMPLE_RATE;
+            const int64_t t1 = (u->pcmf32.pos + u->pcmf32.n)*1000/WHISPER_SAMPLE_RATE;
+
+            LOG_DBG("");
+            LOG_DBG("### Transcription %d START | t0 = %d ms | t1 = %d ms\n", u->id, (int) t0, (int) t1);
+            LOG_DBG("");
+        }
+
+        bool matched = false;
+        const char *matched_code = nullptr;
+        bool early_confirmed = false;
+        bool duplicate       = false;
+
+        const char *early_code = u->early_code && !u->early_skipped ? u->early_code : nullptr;
+
+        if (s->use_dedup) {
+            stream_dedup_release(&s->dedup, u->pcmf32.pos);
+        }
+
+        // the user callback can mark the servo and OLED stages under this id
+        whisper_fuzzy_trace_set_current(s->fuzzy, u->trace_id);
+
+        for (int i = 0; i < u->n_segments; ++i) {
+            const whisper_segment_t &seg = u->segments[i];
+            const char * text = seg.text;
+
+            const char *code = whisper_fuzzy_lookup(s->fuzzy, text);
+            if (code && !matched_code) {
+                matched_code = code;
+            }
+            matched |= code != nullptr;
+
+            // do not fire the command a second time
+            if (early_code && code && !early_confirmed && !strcmp(code, early_code)) {
+                early_confirmed = true;
+                if (s->use_dedup) {
+                    stream_dedup_check(&s->dedup, seg.pos0, seg.pos1, code, text);
+                }
+            } else if (code && s->use_dedup && stream_dedup_check(&s->dedup, seg.pos0, seg.pos1, code, text)) {
+                duplicate = true;
+            } else {
+                whisper_fuzzy_match(s->fuzzy, u->n_segments - i - 1, text);
+            }
+
+            if (params.fname_out.length() > 0) {
+                stream_recorder_text(&s->rec, seg.pos0, seg.pos1, text);
+            }
+
+            if (params.no_timestamps) {
+                LOG_DBG("%s", text);
+                fflush(stdout);
+            } else {
+                const char *output = stream_arena_printf(&s->arena_dispatch, "[%s --> %s]  %s%s\n",
+                    whisper_stream_timestamp(&s->arena_dispatch, seg.t0), whisper_stream_timestamp(&s->arena_dispatch, seg.t1),
+                    text, seg.speaker_turn ? " [SPEAKER_TURN]" : "");
+
+                LOG_DBG("%s", output);
+                fflush(stdout);
+            }
+        }
+
+        if (s->use_vad) {
+            LOG_DBG("");
+            LOG_DBG("### Transcription %d END\n", u->id);
+        }
+
+        if (u->new_line) {
+            LOG_DBG("");
+        }
+
+        fflush(stdout);
+
+        whisper_fuzzy_trace_set_current(s->fuzzy, 0);
+
+        if (early_confirmed) {
+            s->early.n_confirmed++;
+            s->early.t_saved += u->t_infer_end - u->t_early;
+        } else if (early_code) {
+            LOG_INFO("utterance %d: early command '%s' was not confirmed by the final transcript",
+                u->id, u->early_text);
+        }
+
+        // optional diagnostics, not part of the steady state
+        if (s->model->use_clf) {
+            alloc_count_pause();
+            whisper_stream_clf_account(s, u, matched_code);
+            alloc_count_resume();
+        }
+
+        if (s->model->use_kws) {
+            alloc_count_pause();
+            whisper_stream_kws_account(s, u, matched_code);
+            alloc_count_resume();
+        }
+
+        if (s->jout->out.is_open()) {
+            alloc_count_pause();
+            whisper_stream_write_json(s, u, matched_code, duplicate);
+            alloc_count_resume();
+        }
+
+        if (!u->kws_only) {
+            whisper_ctx_stats_t &cs = s->ctx_stats[u->audio_ctx > 0 ? u->audio_ctx : s->model->n_audio_ctx];
+
+            cs.n_runs++;
+            cs.n_matched += matched;
+            cs.t_encode  += u->t_encode;
+        }
+
+        stream_queue_push(&s->q_free, u);
+    }
+
+    whisper_fuzzy_thread_leave(s->fuzzy);
+}
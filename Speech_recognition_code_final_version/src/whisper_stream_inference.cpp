@@ -0,0 +1,571 @@
+// Inference stage of a stream: whisper_full on every queued utterance, on the
+// CPUs the stream_pool_t grants, with the callbacks that let the optional modes
+// act on a running decode (abort, classifier, early firing, constrained
+// decoding, token budget).
+//
+#include "whisper_stream_pipeline.h"
+#include "alloc_count.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+
+
+// Estimated thread-time of one whisper_full: its wall time on the threads the pool granted it.
+// Not measured CPU: stalls, oversubscription and idle workers count too. The workers belong to
+// ggml (a pool per graph, or OpenMP's), their CPU clocks cannot be tied to a stream, and the
+// process clock would also count the other stages and every other stream's inference.
+static int64_t whisper_stream_thread_time(int64_t t_wall, int n_threads)
+{
+    return t_wall*std::max(1, n_threads);
+}
+
+
+// polled by ggml between graph nodes and by whisper before encoding
+static bool whisper_stream_abort(void *userdata)
+{
+    whisper_stream_t    *s = (whisper_stream_t *)userdata;
+    whisper_utterance_t *u = s->decode.u;
+
+    if (u->aborted) {
+        return true;
+    }
+
+    if (u->abort.load(std::memory_order_relaxed) ||
+        (s->decode.abort_stale && s->n_submitted.load(std::memory_order_relaxed) > u->seq)) {
+        u->aborted = true;
+    }
+
+    return u->aborted;
+}
+
+
+static bool whisper_stream_encoder_begin(struct whisper_context * /*ctx*/, struct whisper_state * /*state*/, void *userdata)
+{
+    whisper_stream_t *s = (whisper_stream_t *)userdata;
+
+    s->decode.t_encode_begin = whisper_stream_now();
+
+    return !whisper_stream_abort(userdata);
+}
+
+
+// hand the running utterance to the dispatch stage as soon as its partial transcript is
+// a command that no longer alias can turn into another one ("stand" vs "stand up")
+static void whisper_stream_early(whisper_stream_t *s, struct whisper_context *ctx,
+    const whisper_token_data *tokens, int n_tokens)
+{
+    whisper_utterance_t *u = s->decode.u;
+
+    if (!n_tokens || u->early_fired.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    const whisper_token token_eot = whisper_token_eot(ctx);
+
+    std::string &text = s->early.partial;
+    text.clear();
+
+    for (int i = 0; i < n_tokens; i++) {
+        if (tokens[i].id < token_eot) {
+            text += whisper_token_to_str(ctx, tokens[i].id);
+        }
+    }
+
+    const char *code = stream_early_code(&s->early, s->fuzzy, text);
+    if (!code) {
+        return;
+    }
+
+    // one entry per utterance, whichever sequence gets here first
+    bool expected = false;
+    if (!u->early_fired.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    u->early_code    = code;
+    u->early_text    = stream_arena_strdup(&u->arena, text.c_str());
+    u->t_early       = whisper_stream_now();
+    u->early_pending = true;
+
+    LOG_DBG("utterance %d: '%s' fired after %d tokens", u->id, text.c_str(), n_tokens);
+
+    // never waits, the queue has room for two entries of every slot
+    stream_queue_push_wait(&s->q_dispatch, u);
+
+    if (s->early.abort) {
+        u->abort.store(true, std::memory_order_relaxed);
+    }
+}
+
+
+// mask out every token that cannot continue a command; logits_keep is per stream,
+// so the decode runs a single sequence, see greedy.best_of in whisper_stream_inference()
+static void whisper_stream_constrain(whisper_stream_t *s, const whisper_token_data *tokens, int n_tokens, float *logits)
+{
+    const whisper_model_t *m = s->model;
+
+    auto &keep = s->decode.logits_keep;
+
+    int node = 0;
+    for (int i = 0; i < n_tokens && node >= 0; i++) {
+        node = command_trie_next(&m->trie, node, tokens[i].id);
+    }
+
+    keep.clear();
+
+    // the root may end too, so speech that is no command can decode to nothing
+    if (node <= 0 || m->trie.nodes[node].terminal) {
+        keep.emplace_back(m->token_eot, logits[m->token_eot]);
+    }
+
+    if (node >= 0) {
+        for (const auto &next : m->trie.nodes[node].next) {
+            keep.emplace_back(next.first, logits[next.first]);
+        }
+    }
+
+    std::fill(logits, logits + m->n_vocab, -INFINITY);
+
+    for (const auto &k : keep) {
+        logits[k.first] = k.second;
+    }
+}
+
+
+// called before every sampled token, the first call marks the end of the encoder;
+// past the token budget the decode ends, with a classifier the first step may end it,
+// with -ef the partial transcript is checked for a command, in constrained mode the
+// logits are limited to the commands
+static void whisper_stream_logits_filter(struct whisper_context *ctx, struct whisper_state * /*state*/,
+    const whisper_token_data *tokens, int n_tokens, float *logits, void *userdata)
+{
+    whisper_stream_t *s = (whisper_stream_t *)userdata;
+
+    if (!s->decode.t_first_logits) {
+        s->decode.t_first_logits = whisper_stream_now();
+    }
+
+    if (stream_budget_filter(&s->budget, n_tokens, logits, whisper_n_vocab(ctx), whisper_token_eot(ctx))) {
+        return;
+    }
+
+    // whisper_full() is not counted, this part of it is ours
+    alloc_count_resume();
+
+    if ((s->model->use_clf || s->model->clf_enroll) && whisper_stream_classify(s, ctx, n_tokens, logits)) {
+        alloc_count_pause();
+        return;
+    }
+
+    if (s->params->early_fire) {
+        whisper_stream_early(s, ctx, tokens, n_tokens);
+    }
+
+    if (s->model->use_trie) {
+        whisper_stream_constrain(s, tokens, n_tokens, logits);
+    }
+
+    alloc_count_pause();
+}
+
+
+// true if a segment of the last run on state matches a command; p_min is the lowest text token probability
+static bool whisper_stream_check(whisper_stream_t *s, struct whisper_context *ctx, struct whisper_state *state, float *p_min)
+{
+    const whisper_token token_eot = whisper_token_eot(ctx);
+
+    bool matched = false;
+
+    const int n_segments = whisper_full_n_segments_from_state(state);
+    for (int i = 0; i < n_segments; ++i) {
+        matched |= whisper_fuzzy_lookup(s->fuzzy, whisper_full_get_segment_text_from_state(state, i)) != nullptr;
+
+        const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+        for (int j = 0; j < n_tokens; ++j) {
+            if (whisper_full_get_token_id_from_state(state, i, j) < token_eot) {
+                *p_min = std::min(*p_min, whisper_full_get_token_p_from_state(state, i, j));
+            }
+        }
+    }
+
+    return matched;
+}
+
+
+// encoder frames for n samples: one frame per 320 samples (two 10 ms mel frames)
+static int whisper_stream_audio_ctx(const whisper_stream_t *s, size_t n)
+{
+    if (!s->params->audio_ctx_auto) {
+        return s->params->audio_ctx;
+    }
+
+    const whisper_model_t *m = s->model;
+
+    const int n_ctx = (int)((n + 319)/320) + m->n_audio_ctx_margin;
+
+    for (int bucket : m->audio_ctx_buckets) {
+        if (bucket >= n_ctx) {
+            return bucket;
+        }
+    }
+
+    return n_ctx < m->n_audio_ctx ? n_ctx : 0;
+}
+
+
+// back to the free slots, through the dispatch stage if it may still hold the early command of u
+static void whisper_stream_drop(whisper_stream_t *s, whisper_utterance_t *u)
+{
+    if (u->early_code) {
+        u->n_segments = -1;
+        stream_queue_push_wait(&s->q_dispatch, u);
+    } else {
+        stream_queue_push(&s->q_free, u);
+    }
+}
+
+
+// a verdict without a transcript: the utterance is read as text, an alias of the decided code
+static void whisper_stream_set_result(whisper_utterance_t *u, const std::string &text)
+{
+    // "none", or a code without an alias: no command
+    if (text.empty()) {
+        u->n_segments = 0;
+        return;
+    }
+
+    if (u->segments.empty()) {
+        u->segments.resize(1);
+    }
+
+    whisper_segment_t &seg = u->segments[0];
+
+    seg.text         = stream_arena_strdup(&u->arena, text.c_str());
+    seg.t0           = 0;
+    seg.t1           = (int64_t) u->pcmf32.n*100/WHISPER_SAMPLE_RATE;
+    seg.speaker_turn = false;
+    seg.pos0         = u->pcmf32.pos;
+    seg.pos1         = u->pcmf32.pos + u->pcmf32.n;
+
+    u->n_segments = 1;
+}
+
+
+// a keyword hit, or a --kws-enroll run: the utterance goes to dispatch without whisper_full
+static void whisper_stream_kws_result(whisper_stream_t *s, whisper_utterance_t *u)
+{
+    const whisper_model_t *m = s->model;
+
+    u->audio_busy.store(false, std::memory_order_release);
+
+    u->kws_only      = true;
+    u->early_fired.store(false, std::memory_order_relaxed);
+    u->early_code    = nullptr;
+    u->early_text    = "";
+    u->clf_class     = -1;
+    u->clf_decided   = false;
+    u->audio_ctx     = 0;
+    u->t_encode      = 0;
+    u->t_infer_begin = whisper_stream_now();
+    u->t_infer_end   = u->t_infer_begin;
+
+    if (u->kws_hit) {
+        whisper_stream_set_result(u, m->kws_text[u->kws_class]);
+    } else {
+        u->n_segments = 0;
+    }
+
+    stream_trace_mark(s->trace, u->trace_id, WHISPER_TRACE_DECODE_END, u->t_infer_end);
+
+    // never waits, the queue has room for two entries of every slot
+    stream_queue_push_wait(&s->q_dispatch, u);
+}
+
+
+void whisper_stream_inference(whisper_stream_t *s)
+{
+    whisper_params_t &params = *s->params;
+
+    const whisper_model_t *m = s->model;
+
+    whisper_inference_stats_t &st = s->st_inference;
+    whisper_decode_t          &d  = s->decode;
+
+    // the ggml worker threads are created from this thread and inherit its CPUs
+    whisper_stream_thread_enter(s, "inference");
+
+    std::vector<whisper_token> prompt_tokens;
+    prompt_tokens.reserve(whisper_n_text_ctx(m->ctx));
+
+    bool last_aborted = false;
+
+    whisper_utterance_t *u = nullptr;
+
+    while (stream_queue_pop(&s->q_infer, &u, -1) > 0) {
+        whisper_stream_alloc_account(s, WHISPER_STAGE_INFERENCE);
+        s->alloc[WHISPER_STAGE_INFERENCE].n_done++;
+
+        stream_arena_reset(&u->arena);
+
+        u->kws_only = false;
+
+        // the capture stage already knows the command, or only the MFCC frames are being enrolled
+        if ((u->kws_hit && !params.kws_shadow) || (m->kws_enroll && !m->clf_enroll)) {
+            whisper_stream_kws_result(s, u);
+            continue;
+        }
+
+        whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+
+        wparams.print_progress   = false;
+        wparams.print_special    = params.print_special;
+        wparams.print_realtime   = false;
+        wparams.print_timestamps = !params.no_timestamps;
+        wparams.translate        = params.translate;
+        wparams.single_segment   = !s->use_vad;
+        wparams.max_tokens       = stream_budget_whisper_max_tokens(&s->budget);
+        wparams.language         = params.language.c_str();
+
+        wparams.audio_ctx        = whisper_stream_audio_ctx(s, u->pcmf32.n);
+
+        wparams.tdrz_enable      = params.tinydiarize; // [TDRZ]
+
+        // disable temperature fallback
+        //wparams.temperature_inc  = -1.0f;
+        wparams.temperature_inc  = params.no_fallback ? 0.0f : wparams.temperature_inc;
+
+        // a fallback samples best_of sequences and whisper.cpp filters their logits on as many
+        // threads at once; the filter's scratch, verdicts and budget cut belong to one decode
+        if (m->use_trie || params.early_fire || m->use_clf || m->clf_enroll || s->budget.max_tokens > 0) {
+            wparams.greedy.best_of = 1;
+        }
+
+        wparams.prompt_tokens    = params.no_context ? nullptr : prompt_tokens.data();
+        wparams.prompt_n_tokens  = params.no_context ? 0       : prompt_tokens.size();
+
+        wparams.encoder_begin_callback           = whisper_stream_encoder_begin;
+        wparams.encoder_begin_callback_user_data = s;
+        wparams.abort_callback                   = whisper_stream_abort;
+        wparams.abort_callback_user_data         = s;
+        wparams.logits_filter_callback           = whisper_stream_logits_filter;
+        wparams.logits_filter_callback_user_data = s;
+
+        // timestamp tokens would have to be interleaved with the command tokens
+        wparams.no_timestamps    = wparams.no_timestamps || m->use_trie;
+
+        // where in the window the words are, to tell a repeat from the same words in the next window
+        wparams.token_timestamps = s->use_dedup;
+
+        // a classified utterance ends with EOT at the first step, nothing may mask it
+        if (m->clf_enroll || (m->use_clf && !params.classifier_shadow)) {
+            wparams.no_timestamps  = true;
+            wparams.suppress_blank = false;
+        }
+
+        u->audio_ctx      = wparams.audio_ctx;
+        u->early_fired.store(false, std::memory_order_relaxed);
+        u->early_code     = nullptr;
+        u->early_text     = "";
+        u->t_early        = 0;
+        u->clf_class      = -1;
+        u->clf_decided    = false;
+        u->budget_hit     = false;
+        d.t_first_logits  = 0;
+        s->clf.seen       = false;
+
+        // never abort two sliding windows in a row, or a slow device would never finish one
+        d.abort_stale = params.abort_stale && (s->use_vad || !last_aborted);
+        d.u           = u;
+
+        // wait for a share of the CPUs, oldest utterance of every stream first; both tiers are one run
+        wparams.n_threads = stream_pool_acquire(s->pool, s->index, u->t_end);
+
+        u->t_infer_begin = whisper_stream_now();
+
+        // capture times are meaningless when the audio is not paced by a clock
+        if (s->use_vad && !s->fast_replay) {
+            const int64_t t_latency = (whisper_stream_now() - u->t_end)/1000;
+
+            ++st.n_endpoint;
+            st.t_endpoint_sum += t_latency;
+            st.t_endpoint_max  = std::max(st.t_endpoint_max, t_latency);
+
+            LOG_DBG("end-of-speech to inference start: %.2f ms", t_latency*1e-3);
+        }
+
+        // cascade: the fast model first, the main model only when its result is not trusted
+        struct whisper_context *ctx   = m->ctx_fast ? m->ctx_fast : m->ctx;
+        struct whisper_state   *state = m->ctx_fast ? s->state_fast : s->state;
+
+        int     ret      = 0;
+        int64_t t_thread = 0;
+
+        for (;;) {
+            const int tier = ctx == m->ctx;
+
+            const int64_t t_start = whisper_stream_now();
+
+            d.t_first_logits = 0;
+            stream_budget_begin(&s->budget);
+
+            // whisper.cpp allocates its result segments, only what is around it is checked
+            alloc_count_pause();
+            ret = whisper_full_with_state(ctx, state, wparams, u->pcmf32.data, u->pcmf32.n);
+            alloc_count_resume();
+
+            t_thread += whisper_stream_thread_time(whisper_stream_now() - t_start, wparams.n_threads);
+
+            if (ret != 0 || u->aborted) {
+                break;
+            }
+
+            // per tier, a cut-off fast decode is no concern once the main model finishes
+            u->budget_hit = stream_budget_cut(&s->budget);
+
+            float p_min = 1.0f;
+            const bool matched = whisper_stream_check(s, ctx, state, &p_min);
+
+            if (stream_cascade_done(&s->cascade, tier, matched, p_min, whisper_stream_now() - t_start)) {
+                break;
+            }
+
+            LOG_DBG("utterance %d: escalate to the main model (%s, min token p %.2f)",
+                u->id, matched ? "matched" : "no command", p_min);
+
+            ctx   = m->ctx;
+            state = s->state;
+        }
+
+        stream_pool_release(s->pool, s->index);
+
+        // the capture stage may release this audio from now on
+        u->audio_busy.store(false, std::memory_order_release);
+
+        last_aborted = u->aborted;
+
+        if (u->aborted) {
+            ++st.n_aborted;
+            s->early.n_aborted  += u->abort.load(std::memory_order_relaxed);
+            st.t_thread_aborted += t_thread;
+            if (st.n_completed) {
+                st.t_thread_saved += std::max<int64_t>(0, st.t_thread_completed/(int64_t) st.n_completed - t_thread);
+            }
+
+            LOG_DBG("inference of utterance %d aborted after an estimated %.1f ms of thread-time", u->id, t_thread*1e-6);
+
+            whisper_stream_drop(s, u);
+            continue;
+        }
+
+        if (ret != 0) {
+            LOG_ERR("%s: failed to process audio\n", params.program_name);
+            whisper_stream_drop(s, u);
+            s->ret     = 6;
+            s->running = false;
+            break;
+        }
+
+        ++st.n_completed;
+        st.t_thread_completed += t_thread;
+
+        if (u->budget_hit) {
+            ++s->budget.n_hit;
+            LOG_DBG("utterance %d was cut off by the budget of %d tokens, %d sampled",
+                u->id, s->budget.max_tokens, s->budget.n_sampled);
+        }
+
+        u->t_encode    = d.t_first_logits ? d.t_first_logits - d.t_encode_begin : 0;
+        u->t_infer_end = whisper_stream_now();
+
+        st.n_samples_done += u->pcmf32.n;
+        st.t_infer_sum    += u->t_infer_end - u->t_infer_begin;
+
+        stream_trace_mark(s->trace, u->trace_id, WHISPER_TRACE_ENCODE_BEGIN, d.t_encode_begin);
+        if (d.t_first_logits) {
+            stream_trace_mark(s->trace, u->trace_id, WHISPER_TRACE_ENCODE_END, d.t_first_logits);
+        }
+        stream_trace_mark(s->trace, u->trace_id, WHISPER_TRACE_DECODE_END, u->t_infer_end);
+
+        if (s->sched.use) {
+            stream_sched_update(&s->sched, u->t_infer_end - u->t_infer_begin, u->t_infer_begin - u->t_submit,
+                u->pcmf32.n*1000.0/WHISPER_SAMPLE_RATE);
+        }
+        u->tier        = ctx == m->ctx;
+
+        u->n_segments = whisper_full_n_segments_from_state(state);
+        if ((int) u->segments.size() < u->n_segments) {
+            u->segments.resize(u->n_segments);
+        }
+
+        for (int i = 0; i < u->n_segments; ++i) {
+            whisper_segment_t &seg = u->segments[i];
+
+            seg.text         = stream_arena_strdup(&u->arena, whisper_full_get_segment_text_from_state(state, i));
+            seg.t0           = whisper_full_get_segment_t0_from_state(state, i);
+            seg.t1           = whisper_full_get_segment_t1_from_state(state, i);
+            seg.speaker_turn = whisper_full_get_segment_speaker_turn_next_from_state(state, i);
+
+            int64_t t0 = seg.t0;
+            int64_t t1 = seg.t1;
+
+            if (wparams.token_timestamps) {
+                const whisper_token token_eot = whisper_token_eot(ctx);
+
+                int64_t tt0 = INT64_MAX;
+                int64_t tt1 = -1;
+
+                const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+                for (int j = 0; j < n_tokens; ++j) {
+                    const whisper_token_data data = whisper_full_get_token_data_from_state(state, i, j);
+                    if (data.id < token_eot && data.t1 > data.t0) {
+                        tt0 = std::min(tt0, data.t0);
+                        tt1 = std::max(tt1, data.t1);
+                    }
+                }
+
+                if (tt1 >= 0) {
+                    t0 = tt0;
+                    t1 = tt1;
+                }
+            }
+
+            // timestamps are in 10 ms units from the window start
+            seg.pos0 = u->pcmf32.pos + std::max<int64_t>(0, t0)*WHISPER_SAMPLE_RATE/100;
+            seg.pos1 = u->pcmf32.pos + std::max<int64_t>(0, t1)*WHISPER_SAMPLE_RATE/100;
+        }
+
+        if (m->clf_enroll) {
+            alloc_count_pause();
+            whisper_stream_clf_collect(s, u);
+            alloc_count_resume();
+        }
+
+        // the decode ended at the first step, the transcript is an alias of the class
+        if (u->clf_decided && !params.classifier_shadow) {
+            whisper_stream_set_result(u, m->clf_text[u->clf_class]);
+        }
+
+        // Add tokens of the last full length segment as the prompt
+        if (u->new_line && !params.no_context) {
+            prompt_tokens.clear();
+
+            for (int i = 0; i < u->n_segments; ++i) {
+                const int token_count = whisper_full_n_tokens_from_state(state, i);
+                for (int j = 0; j < token_count; ++j) {
+                    prompt_tokens.push_back(whisper_full_get_token_id_from_state(state, i, j));
+                }
+            }
+        }
+
+        // never waits, the queue has room for two entries of every slot
+        stream_queue_push_wait(&s->q_dispatch, u);
+    }
+
+    whisper_stream_alloc_account(s, WHISPER_STAGE_INFERENCE);
+
+    whisper_fuzzy_thread_leave(s->fuzzy);
+}
@@ -0,0 +1,248 @@
+#include "whisper_stream_kws.h"
+#include "whisper_stream_pipeline.h"
+#include "alloc_count.h"
+#include "corpus_labels.h"
+#include "debug.h"
+
+
+
+// --kws loads the templates, --kws-enroll starts collecting them
+int whisper_stream_kws_setup(whisper_model_t *m, whisper_fuzzy_t *fuzzy, const whisper_params_t &params)
+{
+    if (!params.kws_enroll.empty()) {
+        m->kws_enroll = true;
+
+        LOG_INFO("kws: enrolling %zu labelled files", m->labels.size());
+
+        return 0;
+    }
+
+    if (stream_kws_load(&m->kws, params.kws) < 0) {
+        return -1;
+    }
+
+    if (params.kws_thold > 0.0f) {
+        m->kws.thold = params.kws_thold;
+    }
+    if (params.kws_ratio > 0.0f) {
+        m->kws.ratio = params.kws_ratio;
+    }
+
+    std::vector<std::string> codes;
+    size_t n_templates = 0;
+    for (const auto &cls : m->kws.classes) {
+        codes.push_back(cls.code);
+        n_templates += cls.templates.size();
+    }
+
+    whisper_stream_code_text(fuzzy, "kws", codes, m->kws_text);
+
+    m->use_kws = true;
+
+    LOG_INFO("kws: %zu classes, %zu templates, thold %.3f, ratio %.2f%s",
+        m->kws.classes.size(), n_templates, m->kws.thold, m->kws.ratio, params.kws_shadow ? ", shadow mode" : "");
+
+    return 0;
+}
+
+
+// the frames reach back over the longest utterance and its hangover
+int whisper_stream_kws_init(whisper_stream_t *s)
+{
+    const whisper_params_t &params = *s->params;
+    const whisper_model_t  *m      = s->model;
+
+    whisper_stream_kws_t &k = s->kws;
+
+    stream_mfcc_params_t mfcc_params;
+
+    mfcc_params.sample_rate = WHISPER_SAMPLE_RATE;
+    mfcc_params.n_ceps      = m->kws.n_ceps;
+    mfcc_params.hop_ms      = m->kws.hop_ms;
+    mfcc_params.max_ms      = params.length_ms + params.vad_hangover_ms + 1000;
+
+    if (stream_mfcc_init(&k.mfcc, &mfcc_params) < 0) {
+        return -1;
+    }
+
+    k.templates = m->kws;
+    k.frames.resize((size_t) k.mfcc.n_cap*k.mfcc.params.n_ceps);
+    k.use = true;
+
+    return 0;
+}
+
+
+void whisper_stream_kws_feed(whisper_stream_t *s, const float *frame, size_t n)
+{
+    const int64_t t_start = whisper_stream_now();
+
+    stream_mfcc_feed(&s->kws.mfcc, frame, n);
+
+    s->kws.t_mfcc += whisper_stream_now() - t_start;
+}
+
+
+// capture stage, at the end of an utterance: its speech against the templates,
+// or with --kws-enroll kept as the template of its file when it is the longest
+void whisper_stream_kws_match(whisper_stream_t *s, whisper_utterance_t *u, const stream_vad_segment_t &seg)
+{
+    whisper_model_t *m = s->model;
+
+    whisper_stream_kws_t &k = s->kws;
+
+    const int64_t t_start = whisper_stream_now();
+    const int     n_ceps  = k.mfcc.params.n_ceps;
+
+    u->kws_class = -1;
+    u->kws_hit   = false;
+
+    uint64_t k0 = 0;
+    uint64_t k1 = 0;
+    stream_mfcc_span(&k.mfcc, seg.pos_speech, seg.pos_speech_end, &k0, &k1);
+
+    const int n = (int) (k1 - k0);
+
+    stream_mfcc_copy(&k.mfcc, k0, k1, k.frames.data());
+    stream_kws_normalize(k.frames.data(), n, n_ceps);
+
+    if (m->use_kws && n > 0) {
+        stream_kws_result_t r;
+        stream_kws_match(&k.templates, k.frames.data(), n, &r);
+
+        u->kws_class = r.cls;
+        u->kws_dist  = r.dist;
+        u->kws_ratio = r.ratio;
+
+        // a code missing from the config has nothing to dispatch
+        u->kws_hit = r.hit && (!m->kws_text[r.cls].empty() || m->kws.classes[r.cls].code == "none");
+
+        k.n_cells     += r.n_cells;
+        k.n_templates += r.n_templates;
+        k.n_abandoned += r.n_abandoned;
+    }
+
+    const audio_replay_file_t *file = s->use_replay ? audio_replay_file_at(&s->replay, seg.pos_speech) : nullptr;
+
+    if (m->kws_enroll && file && n > 0) {
+        alloc_count_pause();
+        {
+            std::lock_guard<std::mutex> lock(m->kws_mutex);
+
+            auto &best = m->kws_files[file->path];
+            if ((size_t) n*n_ceps > best.size()) {
+                best.assign(k.frames.begin(), k.frames.begin() + (size_t) n*n_ceps);
+            }
+        }
+        alloc_count_resume();
+    }
+
+    u->t_kws   = whisper_stream_now() - t_start;
+    k.t_match += u->t_kws;
+}
+
+
+// templates from the collected files by their labels, written to --kws-enroll
+int whisper_stream_kws_enroll(whisper_model_t *m, const whisper_params_t &params)
+{
+    stream_kws_t kws;
+
+    if (params.kws_ratio > 0.0f) {
+        kws.ratio = params.kws_ratio;
+    }
+
+    int n_unlabelled = 0;
+
+    for (const auto &file : m->kws_files) {
+        auto label = m->labels.find(corpus_labels_basename(file.first));
+        if (label == m->labels.end()) {
+            n_unlabelled++;
+            continue;
+        }
+
+        stream_kws_enroll(&kws, label->second, corpus_labels_basename(file.first),
+            file.second.data(), (int) (file.second.size()/kws.n_ceps));
+    }
+
+    LOG_INFO("kws: %zu files heard, %d without a label", m->kws_files.size(), n_unlabelled);
+
+    if (stream_kws_finish(&kws) < 0) {
+        LOG_ERR("%s: enrollment failed\n", __func__);
+        return 1;
+    }
+
+    if (params.kws_thold > 0.0f) {
+        kws.thold = params.kws_thold;
+    }
+
+    if (stream_kws_save(&kws, params.kws_enroll) < 0) {
+        LOG_ERR("%s: enrollment failed\n", __func__);
+        return 1;
+    }
+
+    LOG_INFO("kws: written to %s", params.kws_enroll.c_str());
+
+    return 0;
+}
+
+
+// keyword hits against the decoder in shadow mode, and against the label of the replayed file
+void whisper_stream_kws_account(whisper_stream_t *s, const whisper_utterance_t *u, const char *code)
+{
+    const whisper_model_t *m = s->model;
+
+    whisper_stream_kws_t &k = s->kws;
+
+    if (!u->kws_hit) {
+        k.n_miss++;
+        return;
+    }
+
+    k.n_hit++;
+
+    const std::string &kws_code = m->kws.classes[u->kws_class].code;
+
+    if (s->params->kws_shadow) {
+        k.n_agree += kws_code == (code ? code : "none");
+    }
+
+    const audio_replay_file_t *file = whisper_stream_replay_file(s, u);
+    if (!file) {
+        return;
+    }
+
+    auto label = m->labels.find(corpus_labels_basename(file->path));
+    if (label != m->labels.end()) {
+        k.n_lab++;
+        k.n_lab_right += label->second == kws_code;
+    }
+}
+
+
+void whisper_stream_kws_print_stats(const whisper_stream_t *s)
+{
+    const whisper_params_t          &params = *s->params;
+    const whisper_stream_kws_t      &k      = s->kws;
+    const whisper_inference_stats_t &st     = s->st_inference;
+
+    const uint64_t n       = k.n_hit + k.n_miss;
+    const double   t_audio = (double) k.mfcc.n_samples/WHISPER_SAMPLE_RATE;
+
+    LOG_INFO("kws:       %llu of %llu utterances decided before whisper_full%s, MFCC %.2f ms per s of audio, "
+        "matching avg %.2f ms, %.0f%% of the templates abandoned early",
+        (unsigned long long) k.n_hit, (unsigned long long) n, params.kws_shadow ? " (shadow, all decoded)" : "",
+        t_audio > 0 ? k.t_mfcc*1e-6/t_audio : 0.0, n ? k.t_match*1e-6/n : 0.0,
+        k.n_templates ? 100.0*k.n_abandoned/k.n_templates : 0.0);
+
+    if (params.kws_shadow && k.n_hit) {
+        LOG_INFO("kws:       %llu of the hits agree with the decoder", (unsigned long long) k.n_agree);
+    } else if (k.n_hit && st.n_completed) {
+        LOG_INFO("kws:       about %.1f s of estimated inference thread-time saved at avg %.0f ms per whisper_full",
+            k.n_hit*(st.t_thread_completed*1e-9/st.n_completed), st.t_thread_completed*1e-6/st.n_completed);
+    }
+
+    if (k.n_lab) {
+        LOG_INFO("kws:       %llu hits on labelled files, %.0f%% right", (unsigned long long) k.n_lab,
+            100.0*k.n_lab_right/k.n_lab);
+    }
+}
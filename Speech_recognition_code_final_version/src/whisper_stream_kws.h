@@ -0,0 +1,63 @@
+#ifndef __WHISPER_STREAM_KWS_H__
+#define __WHISPER_STREAM_KWS_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "stream_kws.h"
+#include "stream_mfcc.h"
+#include "stream_vad.h"
+#include "whisper_stream.h"
+
+
+struct whisper_model_t;
+struct whisper_stream_t;
+struct whisper_utterance_t;
+
+
+// Keyword spotting of one stream (--kws): the capture stage feeds the MFCC with
+// every VAD frame and matches the speech of every utterance against the
+// templates; a hit goes to dispatch without whisper_full.
+struct whisper_stream_kws_t {
+    bool               use = false;
+    stream_mfcc_t      mfcc;
+    stream_kws_t       templates;    // a copy of the model's, every stream matches on its own
+    std::vector<float> frames;       // the speech of one utterance
+
+    // capture stage
+    int64_t  t_mfcc      = 0;        // ns
+    int64_t  t_match     = 0;        // ns
+    uint64_t n_cells     = 0;
+    uint64_t n_templates = 0;
+    uint64_t n_abandoned = 0;
+
+    // dispatch stage, against the decoder, see whisper_stream_kws_account()
+    uint64_t n_hit       = 0;
+    uint64_t n_miss      = 0;        // forwarded to whisper_full
+    uint64_t n_agree     = 0;        // shadow: a hit and the decoder found the same command
+    uint64_t n_lab       = 0;        // hits on labelled files
+    uint64_t n_lab_right = 0;
+};
+
+
+// --kws loads the templates, --kws-enroll starts collecting them
+int whisper_stream_kws_setup(whisper_model_t *m, whisper_fuzzy_t *fuzzy, const whisper_params_t &params);
+
+// the MFCC of one stream, reaching back over the longest utterance
+int whisper_stream_kws_init(whisper_stream_t *s);
+
+// capture stage, every VAD frame
+void whisper_stream_kws_feed(whisper_stream_t *s, const float *frame, size_t n);
+
+// capture stage, at the end of an utterance
+void whisper_stream_kws_match(whisper_stream_t *s, whisper_utterance_t *u, const stream_vad_segment_t &seg);
+
+// --kws-enroll, once every stream is done
+int whisper_stream_kws_enroll(whisper_model_t *m, const whisper_params_t &params);
+
+// dispatch stage, code is what the utterance dispatched
+void whisper_stream_kws_account(whisper_stream_t *s, const whisper_utterance_t *u, const char *code);
+
+void whisper_stream_kws_print_stats(const whisper_stream_t *s);
+
+#endif //__WHISPER_STREAM_KWS_H__
@@ -0,0 +1,240 @@
+// The model every stream shares: loading, warm-up, the command vocabulary
+// (token trie, the aliases a classifier or keyword verdict reads as) and the
+// labels of replayed files. Set up once before the streams start.
+//
+#include "whisper_stream_pipeline.h"
+#include "corpus_labels.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+
+// the model is loaded without a state, every stream makes its own afterwards
+struct whisper_context *whisper_stream_load(whisper_model_t *m, stream_startup_t *startup, int tier,
+    const char *path, struct whisper_context_params cparams, bool prefetch)
+{
+    model_mmap_t *mm = &m->model_map[tier];
+
+    const int64_t t_start = whisper_stream_now();
+
+    if (!mm->data) {
+        struct whisper_context *ctx = whisper_init_from_file_with_params_no_state(path, cparams);
+
+        stream_startup_add(startup, tier ? "fast model load" : "model load",
+            (whisper_stream_now() - t_start)/1000, "read by whisper.cpp");
+        return ctx;
+    }
+
+    struct whisper_context *ctx = model_mmap_init(mm, cparams);
+
+    if (ctx) {
+        char note[64];
+        snprintf(note, sizeof(note), "%.1f MB mapped, %llu major faults%s", mm->size/(1024.0*1024.0),
+            (unsigned long long) mm->n_major_faults, prefetch ? ", prefetched" : "");
+
+        stream_startup_add(startup, tier ? "fast model load" : "model load", (whisper_stream_now() - t_start)/1000, note);
+    }
+
+    model_mmap_close(mm);
+
+    return ctx;
+}
+
+
+// the first whisper_full pays for page faults in the weights and the compute buffers,
+// run it on silence before anyone speaks
+int whisper_stream_warmup(const whisper_params_t &params, struct whisper_context *ctx, struct whisper_state *state)
+{
+    std::vector<float> silence(WHISPER_SAMPLE_RATE, 0.0f);
+
+    whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+
+    wparams.print_progress   = false;
+    wparams.print_realtime   = false;
+    wparams.print_timestamps = false;
+    wparams.no_timestamps    = true;
+    wparams.single_segment   = true;
+    wparams.max_tokens       = 1;
+    wparams.language         = params.language.c_str();
+    wparams.n_threads        = params.n_threads;
+    wparams.audio_ctx        = params.audio_ctx;
+
+    if (whisper_full_with_state(ctx, state, wparams, silence.data(), silence.size()) != 0) {
+        LOG_ERR("%s: warmup inference failed\n", __func__);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+// "256,512,768" -> ascending sizes below the model context
+int whisper_stream_parse_buckets(const std::string &list, int n_audio_ctx, std::vector<int> &buckets)
+{
+    size_t i = 0;
+
+    while (i < list.size()) {
+        size_t j = list.find(',', i);
+        if (j == std::string::npos) {
+            j = list.size();
+        }
+
+        const int bucket = atoi(list.substr(i, j - i).c_str());
+        if (bucket <= 0) {
+            LOG_ERR("bad audio context bucket '%s'", list.substr(i, j - i).c_str());
+            return -1;
+        }
+        if (bucket < n_audio_ctx) {
+            buckets.push_back(bucket);
+        }
+        i = j + 1;
+    }
+
+    std::sort(buckets.begin(), buckets.end());
+
+    return 0;
+}
+
+
+struct whisper_trie_build_t {
+    whisper_model_t           *m;
+    std::vector<whisper_token> tokens;
+    int                        n_aliases;
+};
+
+
+// every alias is added lowercased, capitalized and upper case ("SABI!"), with and without the leading space
+static int whisper_stream_trie_add(const char *text, const char * /*code*/, void *userdata)
+{
+    whisper_trie_build_t *b = (whisper_trie_build_t *)userdata;
+
+    std::string variants[3] = { text, text, text };
+    variants[1][0] = toupper((unsigned char) variants[1][0]);
+    for (char &c : variants[2]) {
+        c = toupper((unsigned char) c);
+    }
+
+    for (int i = 0; i < 6; i++) {
+        // one-letter or caseless aliases repeat a variant
+        if (std::find(variants, variants + i/2, variants[i/2]) != variants + i/2) {
+            continue;
+        }
+
+        const std::string variant = (i & 1 ? " " : "") + variants[i/2];
+
+        int n = whisper_tokenize(b->m->ctx, variant.c_str(), b->tokens.data(), b->tokens.size());
+        if (n < 0) {
+            b->tokens.resize(-n);
+            n = whisper_tokenize(b->m->ctx, variant.c_str(), b->tokens.data(), b->tokens.size());
+        }
+
+        if (n > 0 && command_trie_insert(&b->m->trie, b->tokens.data(), n) < 0) {
+            return -1;
+        }
+    }
+
+    b->n_aliases++;
+
+    return 0;
+}
+
+
+int whisper_stream_build_trie(whisper_model_t *m, whisper_fuzzy_t *fuzzy)
+{
+    whisper_trie_build_t b = { m, std::vector<whisper_token>(64), 0 };
+
+    command_trie_init(&m->trie);
+
+    if (whisper_fuzzy_foreach_alias(fuzzy, whisper_stream_trie_add, &b) < 0 || !m->trie.n_commands) {
+        LOG_ERR("no command could be tokenized");
+        return -1;
+    }
+
+    m->n_keep = 1;
+    for (const auto &node : m->trie.nodes) {
+        m->n_keep = std::max(m->n_keep, node.next.size() + 1);
+    }
+
+    m->token_eot = whisper_token_eot(m->ctx);
+    m->n_vocab   = whisper_n_vocab(m->ctx);
+
+    LOG_INFO("command tokens: %d aliases, %d token sequences, %zu trie nodes, longest %d tokens",
+        b.n_aliases, m->trie.n_commands, m->trie.nodes.size(), m->trie.max_depth);
+
+    return 0;
+}
+
+
+struct whisper_code_text_t {
+    const std::vector<std::string> *codes;
+    std::vector<std::string>       *text;
+};
+
+
+static int whisper_stream_code_text_add(const char *text, const char *code, void *userdata)
+{
+    whisper_code_text_t *t = (whisper_code_text_t *)userdata;
+
+    for (size_t i = 0; i < t->codes->size(); i++) {
+        if ((*t->text)[i].empty() && (*t->codes)[i] == code) {
+            (*t->text)[i] = text;
+        }
+    }
+
+    return 0;
+}
+
+
+// the first alias of every code, what a decided utterance is transcribed as
+void whisper_stream_code_text(whisper_fuzzy_t *fuzzy, const char *stage,
+    const std::vector<std::string> &codes, std::vector<std::string> &text)
+{
+    text.assign(codes.size(), "");
+
+    whisper_code_text_t t = { &codes, &text };
+    whisper_fuzzy_foreach_alias(fuzzy, whisper_stream_code_text_add, &t);
+
+    for (size_t i = 0; i < codes.size(); i++) {
+        if (text[i].empty() && codes[i] != "none") {
+            LOG_INFO("%s: code %s is not in the config, it is left to the decoder", stage, codes[i].c_str());
+        }
+    }
+}
+
+
+// -lb, or labels.tsv next to the first -r path, for enrollment and accuracy
+int whisper_stream_labels(whisper_model_t *m, const whisper_params_t &params)
+{
+    if (params.labels.empty() && params.classifier_enroll.empty() && params.kws_enroll.empty()) {
+        return 0;
+    }
+
+    const std::string path = !params.labels.empty() ? params.labels : corpus_labels_default(params.replay[0]);
+
+    return corpus_labels_read(path, m->labels);
+}
+
+
+void whisper_stream_model_free(whisper_model_t *m)
+{
+    model_mmap_close(&m->model_map[0]);
+    model_mmap_close(&m->model_map[1]);
+
+    if (m->ctx_fast) {
+        whisper_print_timings(m->ctx_fast);
+        whisper_free(m->ctx_fast);
+        m->ctx_fast = nullptr;
+    }
+
+    if (m->ctx) {
+        whisper_print_timings(m->ctx);
+        whisper_free(m->ctx);
+        m->ctx = nullptr;
+    }
+}
@@ -0,0 +1,351 @@
+#ifndef __WHISPER_STREAM_PIPELINE_H__
+#define __WHISPER_STREAM_PIPELINE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "whisper.h"
+#include "whisper_stream.h"
+#include "audio_alsa.h"
+#include "audio_capture.h"
+#include "audio_replay.h"
+#include "audio_ring.h"
+#include "command_trie.h"
+#include "model_mmap.h"
+#include "stream_arena.h"
+#include "stream_budget.h"
+#include "stream_cascade.h"
+#include "stream_classifier.h"
+#include "stream_dedup.h"
+#include "stream_early.h"
+#include "stream_kws.h"
+#include "stream_pool.h"
+#include "stream_queue.h"
+#include "stream_recorder.h"
+#include "stream_sched.h"
+#include "stream_startup.h"
+#include "stream_trace.h"
+#include "stream_vad.h"
+#include "whisper_stream_clf.h"
+#include "whisper_stream_kws.h"
+
+
+// The state shared by the stages of one stream and the model they read.
+//
+// whisper_stream.cpp sets a stream up and runs it; every stage is a thread of
+// its own translation unit: whisper_stream_capture.cpp (ring, VAD, windows),
+// whisper_stream_inference.cpp (whisper_full and its callbacks) and
+// whisper_stream_dispatch.cpp (commands, output, accuracy). The optional modes
+// keep their state in stream_budget_t, stream_cascade_t, stream_early_t,
+// stream_sched_t, whisper_stream_clf_t and whisper_stream_kws_t.
+
+
+// utterance slots cycling through the pipeline, this also bounds every queue
+// (the dispatch queue holds two per slot: an early command and the final result)
+static const int k_n_utterances = 8;
+
+
+// strings of one utterance: its transcript, and everything the dispatch stage prints for it
+static const size_t k_arena_size = 4096;
+
+
+enum whisper_stage_t {
+    WHISPER_STAGE_CAPTURE = 0,
+    WHISPER_STAGE_INFERENCE,
+    WHISPER_STAGE_DISPATCH,
+    WHISPER_STAGE_N,
+};
+
+
+struct whisper_segment_t {
+    const char *text         = "";      // in the arena of the utterance
+    int64_t     t0           = 0;
+    int64_t     t1           = 0;
+    bool        speaker_turn = false;
+    uint64_t    pos0         = 0;       // absolute sample span of the words, from the token timestamps
+    uint64_t    pos1         = 0;
+};
+
+
+// One sliding window or VAD segment on its way from capture to dispatch.
+// The audio stays in the ring: the capture stage does not release it while
+// audio_busy is set, the inference stage clears it once whisper_full is done.
+struct whisper_utterance_t {
+    int               id       = 0;
+    uint64_t          seq      = 0;      // submission order
+    uint64_t          trace_id = 0;
+    bool              new_line = false;  // sliding mode: last step of a line
+    audio_view_t      pcmf32;
+    std::atomic<bool> audio_busy{false};
+
+    std::atomic<bool> abort{false};      // stop the running inference, the result is not needed
+    bool              aborted = false;
+
+    float   peak      = 0.0f;            // largest |sample| of pcmf32
+
+    // classifier verdict on the first decoder step, see whisper_stream_classify()
+    int     clf_class   = -1;            // -1 - not classified
+    float   clf_sim     = 0.0f;
+    float   clf_margin  = 0.0f;
+    bool    clf_decided = false;         // the margin was reached, the decoder was or would have been skipped
+    int64_t t_clf       = 0;             // steady clock ns of the verdict
+
+    // keyword spotting verdict of the capture stage, see whisper_stream_kws_match()
+    int     kws_class = -1;              // -1 - not matched
+    float   kws_dist  = 0.0f;
+    float   kws_ratio = 0.0f;
+    bool    kws_hit   = false;           // confident, whisper_full was or would have been skipped
+    bool    kws_only  = false;           // whisper_full did not run
+    int64_t t_kws     = 0;               // ns spent matching
+
+    bool    budget_hit = false;          // a decode was cut off by the token budget, see --max-tokens
+
+    int     audio_ctx = 0;               // encoder frames used, 0 - full context
+    int     tier      = 1;               // model that produced the result, 0 - fast, 1 - main
+    int64_t t_encode  = 0;               // encoder start to first logits, ns
+
+    // stage timestamps, steady clock ns
+    int64_t t_submit      = 0;
+    int64_t t_infer_begin = 0;
+    int64_t t_infer_end   = 0;
+
+    int64_t t_end = 0;                   // capture time of the last sample, ns
+
+    // early firing: a command dispatched from a partial decode, see whisper_stream_early()
+    std::atomic<bool> early_fired{false};  // claimed by the decoder that fires, before any other field
+    const char *early_code    = nullptr;
+    const char *early_text    = "";
+    int64_t     t_early       = 0;
+    bool        early_pending = false;   // queued for dispatch ahead of the final result
+    bool        early_skipped = false;   // may repeat a dispatched command, left to the final result
+
+    std::vector<whisper_segment_t> segments;
+    int n_segments = 0;                  // -1 - no result, only the early command was dispatched
+
+    stream_arena_t arena;                // written by the inference stage, reset when it takes u
+};
+
+
+struct whisper_ctx_stats_t {
+    uint64_t n_runs     = 0;
+    uint64_t n_matched  = 0;   // at least one segment is a command
+    int64_t  t_encode   = 0;   // ns
+};
+
+
+// heap allocations of one stage in its steady state, see whisper_stream_alloc_account()
+struct whisper_alloc_stats_t {
+    uint64_t n_done  = 0;      // utterances handled, including the warm-up
+    uint64_t n_last  = 0;      // alloc_count_thread() at the last account
+    uint64_t n_iter  = 0;      // steady-state iterations
+    uint64_t n_alloc = 0;
+    uint64_t n_bad   = 0;      // iterations that allocated
+};
+
+
+// Loaded once and only read by the streams, whisper_full runs on their own states.
+struct whisper_model_t {
+    struct whisper_context *ctx      = nullptr;
+    struct whisper_context *ctx_fast = nullptr;   // cascade first tier, optional
+
+    model_mmap_t model_map[2];                     // [0] main, [1] fast; mapped until loaded
+
+    int              n_audio_ctx = 0;         // encoder frames of the model
+    int              n_audio_ctx_margin = 0;
+    std::vector<int> audio_ctx_buckets;       // ascending
+
+    // constrained decoding, see whisper_stream_logits_filter()
+    bool             use_trie  = false;
+    command_trie_t   trie;
+    whisper_token    token_eot = 0;
+    int              n_vocab   = 0;
+    size_t           n_keep    = 1;           // most logits a trie node keeps
+
+    // command classifier, see whisper_stream_classify()
+    bool                     use_clf    = false;
+    bool                     clf_enroll = false;   // --classifier-enroll, every decode ends after the first step
+    stream_classifier_t      clf;
+    std::vector<std::string> clf_text;             // per class an alias of its code, "" for none
+    std::map<std::string, std::string> labels;     // -lb, file name -> code
+
+    // enrollment: the longest utterance of every replayed file and its features
+    std::mutex clf_mutex;
+    std::map<std::string, std::pair<size_t, std::vector<float>>> clf_files;
+
+    // keyword spotting pre-stage, see whisper_stream_kws_match()
+    bool                     use_kws    = false;
+    bool                     kws_enroll = false;   // --kws-enroll, whisper_full only runs for --classifier-enroll
+    stream_kws_t             kws;
+    std::vector<std::string> kws_text;             // per class an alias of its code, "" for none
+
+    // enrollment: the MFCC frames of the longest utterance of every replayed file
+    std::mutex kws_mutex;
+    std::map<std::string, std::vector<float>> kws_files;
+};
+
+
+// -jo, one file for every stream
+struct whisper_jout_t {
+    std::mutex    mutex;
+    std::ofstream out;
+};
+
+
+// capture stage, the ring is its input queue
+struct whisper_capture_stats_t {
+    uint64_t n_wakeups       = 0;  // times the stage woke up waiting for audio
+    uint64_t n_catchup       = 0;  // sliding windows cut short of the head because the stage was behind
+    uint64_t n_slot_waits    = 0;  // times every slot was busy, see whisper_stream_acquire()
+    int64_t  t_slot_wait     = 0;  // ns
+    int64_t  t_slot_wait_max = 0;
+    size_t   ring_fill_max   = 0;  // samples
+};
+
+
+// inference stage
+struct whisper_inference_stats_t {
+    // end-of-speech (capture time of the last sample) to inference start, us
+    uint64_t n_endpoint     = 0;
+    int64_t  t_endpoint_sum = 0;
+    int64_t  t_endpoint_max = 0;
+
+    // estimated thread-time of completed and aborted runs, see whisper_stream_thread_time()
+    uint64_t n_completed        = 0;
+    uint64_t n_aborted          = 0;
+    int64_t  t_thread_completed = 0;  // ns
+    int64_t  t_thread_aborted   = 0;  // ns
+    int64_t  t_thread_saved     = 0;  // ns, average completed run minus the aborted part
+
+    // audio of the completed runs and their whisper_full wall time
+    uint64_t n_samples_done = 0;
+    int64_t  t_infer_sum    = 0;  // ns
+};
+
+
+// the running whisper_full of the inference stage, read by its callbacks
+struct whisper_decode_t {
+    whisper_utterance_t *u           = nullptr;
+    bool                 abort_stale = false;   // may be aborted for a newer utterance
+    int64_t              t_encode_begin = 0;
+    int64_t              t_first_logits = 0;
+
+    std::vector<std::pair<whisper_token, float>> logits_keep;   // constrained decoding scratch
+};
+
+
+struct whisper_stream_t {
+    whisper_fuzzy_t  *fuzzy   = nullptr;
+    whisper_params_t *params  = nullptr;
+    stream_trace_t   *trace   = nullptr;
+    stream_startup_t *startup = nullptr;
+
+    whisper_model_t  *model = nullptr;
+    stream_pool_t    *pool  = nullptr;
+    whisper_jout_t   *jout  = nullptr;
+
+    int  index     = 0;           // source, -c devices first, then -r
+    int  n_streams = 1;           // roles and log lines name the stream only when there are several
+
+    struct whisper_state *state      = nullptr;
+    struct whisper_state *state_fast = nullptr;
+
+    int         capture_id = -1;
+    std::string replay_paths;
+
+    std::thread th_capture;
+    std::thread th_inference;
+    std::thread th_dispatch;
+
+    bool use_vad        = false;
+    int  n_samples_step = 0;
+    int  n_samples_len  = 0;
+    int  n_samples_keep = 0;
+    int  n_samples_view = 0;
+    int  n_new_line     = 1;
+
+    audio_ring_t    ring;
+    audio_capture_t audio;
+    audio_alsa_t    alsa;
+    audio_replay_t  replay;
+    bool            use_replay  = false;
+    bool            use_alsa    = false;  // the microphone through -ab alsa instead of SDL
+    bool            fast_replay = false;  // replay as fast as possible, capture times are not paced by a clock
+    stream_vad_t    vad;
+    stream_dedup_t  dedup;
+    bool            use_dedup   = false;
+
+    whisper_utterance_t utterances[k_n_utterances];
+
+    stream_queue_t<whisper_utterance_t *> q_free;
+    stream_queue_t<whisper_utterance_t *> q_infer;     // capture -> inference
+    stream_queue_t<whisper_utterance_t *> q_dispatch;  // inference -> dispatch
+
+    std::atomic<bool> running{true};
+    std::atomic<int>  ret{0};
+
+    std::atomic<uint64_t> n_submitted{0};
+
+    whisper_decode_t decode;
+
+    // optional modes
+    stream_sched_t       sched;      // -as, the capture stage reads its step
+    stream_cascade_t     cascade;    // -mf
+    stream_budget_t      budget;     // -mt
+    stream_early_t       early;      // -ef
+    whisper_stream_clf_t clf;        // --classifier, --classifier-enroll
+    whisper_stream_kws_t kws;        // --kws, --kws-enroll
+
+    // --alloc-check, every stage owns one entry
+    bool                  use_alloc_check = false;
+    whisper_alloc_stats_t alloc[WHISPER_STAGE_N];
+
+    stream_arena_t arena_dispatch;   // reset for every utterance
+
+    stream_recorder_t rec;           // -sa and -f, written off the pipeline threads
+    bool              use_recorder = false;
+
+    whisper_capture_stats_t   st_capture;
+    whisper_inference_stats_t st_inference;
+
+    // dispatch stage, per audio context size
+    std::vector<whisper_ctx_stats_t> ctx_stats;
+};
+
+
+// whisper_stream.cpp
+int64_t whisper_stream_now();
+void whisper_stream_thread_enter(whisper_stream_t *s, const char *role);
+void whisper_stream_alloc_account(whisper_stream_t *s, whisper_stage_t stage);
+const audio_replay_file_t *whisper_stream_replay_file(const whisper_stream_t *s, const whisper_utterance_t *u);
+
+// whisper_stream_model.cpp
+struct whisper_context *whisper_stream_load(whisper_model_t *m, stream_startup_t *startup, int tier,
+    const char *path, struct whisper_context_params cparams, bool prefetch);
+int  whisper_stream_warmup(const whisper_params_t &params, struct whisper_context *ctx, struct whisper_state *state);
+int  whisper_stream_parse_buckets(const std::string &list, int n_audio_ctx, std::vector<int> &buckets);
+int  whisper_stream_build_trie(whisper_model_t *m, whisper_fuzzy_t *fuzzy);
+int  whisper_stream_labels(whisper_model_t *m, const whisper_params_t &params);
+void whisper_stream_code_text(whisper_fuzzy_t *fuzzy, const char *stage,
+    const std::vector<std::string> &codes, std::vector<std::string> &text);
+void whisper_stream_model_free(whisper_model_t *m);
+
+// whisper_stream_capture.cpp
+int  whisper_stream_open_audio(whisper_stream_t *s);
+void whisper_stream_pause_mic(whisper_stream_t *s);
+void whisper_stream_free_mic(whisper_stream_t *s);
+void whisper_stream_capture(whisper_stream_t *s);
+
+// whisper_stream_inference.cpp
+void whisper_stream_inference(whisper_stream_t *s);
+
+// whisper_stream_dispatch.cpp
+void whisper_stream_dispatch(whisper_stream_t *s);
+
+#endif //__WHISPER_STREAM_PIPELINE_H__
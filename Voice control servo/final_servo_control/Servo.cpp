@@ -28,8 +28,15 @@ void Servo::generatePWM(int pulse_width_us, int duration_ms) {
     while (std::chrono::duration_cast<std::chrono::milliseconds>(
         std::chrono::steady_clock::now() - start).count() < duration_ms) {
         gpiod_line_set_value(line, 1);
+        const auto t_edge = std::chrono::steady_clock::now();
         std::this_thread::sleep_for(std::chrono::microseconds(pulse_width_us));
         gpiod_line_set_value(line, 0);
+        // reported once the line is low, so the hook cannot stretch the pulse
+        if (edge_hook) {
+            auto hook = std::move(edge_hook);
+            edge_hook = nullptr;
+            hook(std::chrono::duration_cast<std::chrono::nanoseconds>(t_edge.time_since_epoch()).count());
+        }
         std::this_thread::sleep_for(std::chrono::microseconds(PWM_PERIOD_US - pulse_width_us));
     }
 }
@@ -54,6 +61,10 @@ void Servo::smoothRotateTo(int target_angle) {
     gpiod_line_set_value(line, 0);
 }
 
+void Servo::onNextEdge(std::function<void(int64_t)> hook) {
+    edge_hook = std::move(hook);
+}
+
 void Servo::release() {
     gpiod_line_set_value(line, 0);
 }
@@ -13,36 +13,79 @@ ServoController::~ServoController() {
     right.release();
 }
 
+void ServoController::onNextAction(std::function<void(int64_t)> first_edge, std::function<void()> display_flushed) {
+    pending_edge = std::move(first_edge);
+    pending_display = std::move(display_flushed);
+}
+
+void ServoController::setThreadHooks(std::function<void(const char*)> enter, std::function<void()> leave) {
+    thread_enter = std::move(enter);
+    thread_leave = std::move(leave);
+}
+
+// software PWM is timing critical, keep it on its own thread role
+std::thread ServoController::pwmThread(std::function<void()> fn) {
+    return std::thread([this, fn]() {
+        if (thread_enter) thread_enter("pwm");
+        fn();
+        if (thread_leave) thread_leave();
+    });
+}
+
+// hand the pending edge hook to both servos, whichever pulses first reports it
+void ServoController::armHooks() {
+    if (pending_edge) {
+        left.onNextEdge(pending_edge);
+        right.onNextEdge(pending_edge);
+        pending_edge = nullptr;
+    }
+}
+
 void ServoController::displayStatus(const std::string& status) {
     if (status == "stand") showStandUp();
     else if (status == "sleep") showSleep();
     // Can extend to more states
+
+    if (pending_display) {
+        pending_display();
+    }
 }
 
 void ServoController::standUp() {
+    armHooks();
     displayStatus("stand");
-    std::thread t1([&]() { left.smoothRotateTo(180); });
-    std::thread t2([&]() { right.smoothRotateTo(180); });
+    pending_display = nullptr;
+    std::thread t1 = pwmThread([&]() { left.smoothRotateTo(180); });
+    std::thread t2 = pwmThread([&]() { right.smoothRotateTo(180); });
     t1.join(); t2.join();
 }
 
 void ServoController::sleep() {
+    armHooks();
     displayStatus("sleep");
-    std::thread t1([&]() { left.smoothRotateTo(0); });
-    std::thread t2([&]() { right.smoothRotateTo(0); });
+    pending_display = nullptr;
+    std::thread t1 = pwmThread([&]() { left.smoothRotateTo(0); });
+    std::thread t2 = pwmThread([&]() { right.smoothRotateTo(0); });
     t1.join(); t2.join();
 }
 
 void ServoController::moveForward() {
-    std::thread t1([&]() { left.smoothRotateTo(90); });
-    std::thread t2([&]() { right.smoothRotateTo(90); });
+    armHooks();
+    pending_display = nullptr;
+    std::thread t1 = pwmThread([&]() { left.smoothRotateTo(90); });
+    std::thread t2 = pwmThread([&]() { right.smoothRotateTo(90); });
     t1.join(); t2.join();
 }
 
 void ServoController::alternate() {
-    for (int i = 0; i < 6; ++i) {
-        std::cout << "[Cycle " << i + 1 << "] GPIO12 -> 90°, GPIO13 -> 180°" << std::endl;
-        right.smoothRotateTo(90);
-        left.smoothRotateTo(180);
-    }
+    armHooks();
+    pending_display = nullptr;
+    std::thread t = pwmThread([&]() {
+        for (int i = 0; i < 6; ++i) {
+            std::cout << "[Cycle " << i + 1 << "] GPIO12 -> 90°, GPIO13 -> 180°" << std::endl;
+            right.smoothRotateTo(90);
+            left.smoothRotateTo(180);
+        }
+    });
+    t.join();
 }
@@ -1,5 +1,7 @@
 #pragma once
 #include "Servo.h"
+#include <functional>
+#include <thread>
 
 class ServoController {
 public:
@@ -11,8 +13,21 @@ public:
     void moveForward();
     void alternate();
 
+    // hooks for the next action only: first servo edge, OLED frame flushed
+    void onNextAction(std::function<void(int64_t)> first_edge, std::function<void()> display_flushed);
+
+    // run by every PWM thread on start and exit, e.g. to pin it with the "pwm" role
+    void setThreadHooks(std::function<void(const char*)> enter, std::function<void()> leave);
+
 private:
     Servo left;
     Servo right;
+    std::function<void(int64_t)> pending_edge;
+    std::function<void()> pending_display;
+    std::function<void(const char*)> thread_enter;
+    std::function<void()> thread_leave;
+
+    void armHooks();
+    std::thread pwmThread(std::function<void()> fn);
     void displayStatus(const std::string& status); // new OLED helper
 };
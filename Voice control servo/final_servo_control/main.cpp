@@ -1,5 +1,6 @@
 #include "whisper_fuzzy.h"
 #include "ServoController.h"
+#include <chrono>
 #include <iostream>
 #include <thread>
 #include <cstring>
@@ -9,10 +10,24 @@
 using ActionCallback = std::function<void()>;
 std::map<std::string, ActionCallback> commandMap;
 
+struct app_t {
+    whisper_fuzzy_t* w;
+    ServoController* controller;
+};
+
 static int whisper_user_callback(size_t, const char*, const char* code, void* userdata) {
-    if (!code) return -1;
+    if (!code || !userdata) return -1;
+    app_t& app = *(app_t*)userdata;
     std::string cmd(code);
-    if (commandMap.count(cmd)) commandMap[cmd]();
+    if (commandMap.count(cmd)) {
+        // servo edge and OLED flush close the latency trace of this utterance
+        whisper_fuzzy_t* w = app.w;
+        const uint64_t trace_id = whisper_fuzzy_trace_current(w);
+        app.controller->onNextAction(
+            [w, trace_id](int64_t t_edge) { whisper_fuzzy_trace_mark(w, trace_id, WHISPER_TRACE_SERVO_EDGE, t_edge); },
+            [w, trace_id]() { whisper_fuzzy_trace_mark(w, trace_id, WHISPER_TRACE_OLED_FLUSH, 0); });
+        commandMap[cmd]();
+    }
     return 0;
 }
 
@@ -20,12 +35,21 @@ int main(int argc, char* argv[]) {
     whisper_fuzzy_t* w = whisper_fuzzy_init(argc, argv);
     if (!w) return -1;
 
+    // the OLED is drawn synchronously from the callback, on the "dispatch" thread
+    const auto t_init = std::chrono::steady_clock::now();
     ServoController controller;
+    whisper_fuzzy_startup_mark(w, "oled/gpio", std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - t_init).count());
+
+    controller.setThreadHooks(
+        [w](const char* role) { whisper_fuzzy_thread_enter(w, role); },
+        [w]() { whisper_fuzzy_thread_leave(w); });
     commandMap["0x06"] = [&]() { controller.standUp(); };
     commandMap["0x05"] = [&]() { controller.sleep(); };
     commandMap["0x00"] = [&]() { controller.alternate(); };
 
-    whisper_fuzzy(w, whisper_user_callback, nullptr);
+    app_t app = { w, &controller };
+    whisper_fuzzy(w, whisper_user_callback, &app);
     whisper_fuzzy_exit(w);
     return 0;
 }
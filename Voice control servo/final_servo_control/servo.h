@@ -1,5 +1,7 @@
 #pragma once
 #include <gpiod.h>
+#include <cstdint>
+#include <functional>
 #include <string>
 
 class Servo {
@@ -11,11 +13,15 @@ public:
     void smoothRotateTo(int angle);   // smooth transition
     void release();
 
+    // called once after the next pulse of the PWM output, with the steady clock ns of its rising edge
+    void onNextEdge(std::function<void(int64_t)> hook);
+
 private:
     int pin;
     std::string label;
     gpiod_chip* chip;
     gpiod_line* line;
+    std::function<void(int64_t)> edge_hook;
 
     void generatePWM(int pulse_width_us, int duration_ms);
 };